@@ -0,0 +1,88 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "AsyncLoader.h"
+#include "MshLoader.h"
+#include "MeshRegistry.h"
+
+using namespace NCL;
+using namespace Rendering;
+
+namespace {
+	const uint32_t LOADER_THREADS = 2;
+
+	//Queues load on the loader pool, returning a handle to its result. Load returns nullptr if it fails.
+	template<typename T>
+	AsyncLoadHandle<T> StartLoad(int priority, std::function<std::unique_ptr<T>()> load) {
+		std::shared_ptr<AsyncLoadData<T>> data = std::make_shared<AsyncLoadData<T>>();
+
+		AsyncLoader::GetLoaderPool().Submit([data, load]() {
+			{
+				std::unique_lock<std::mutex> lock(data->mutex);
+				if (data->state == AsyncLoadState::Cancelled) {
+					return;
+				}
+				data->state = AsyncLoadState::Loading;
+			}
+			std::unique_ptr<T> result = load();
+			{
+				std::unique_lock<std::mutex> lock(data->mutex);
+				if (data->state == AsyncLoadState::Cancelled) {
+					return;
+				}
+				data->state	 = result ? AsyncLoadState::Loaded : AsyncLoadState::Failed;
+				data->result = std::move(result);
+			}
+			data->signal.notify_all();
+		}, priority);
+
+		return AsyncLoadHandle<T>(data);
+	}
+}
+
+ThreadPool& AsyncLoader::GetLoaderPool() {
+	static ThreadPool pool(LOADER_THREADS);
+	return pool;
+}
+
+AsyncLoadHandle<Mesh> AsyncLoader::LoadMesh(const std::string& filename, const MeshFactory& factory, int priority, bool keepQuantised) {
+	return StartLoad<Mesh>(priority, [filename, factory, keepQuantised]() {
+		UniqueMesh mesh = factory();
+		if (!mesh) {
+			return UniqueMesh();
+		}
+		//The registry's queries mustn't read the mesh while this thread is filling it in
+		MeshRegistry::SetLoading(mesh.get(), true);
+		bool loaded = MshLoader::LoadMesh(filename, *mesh, keepQuantised);
+		MeshRegistry::SetLoading(mesh.get(), false);
+		if (!loaded) {
+			return UniqueMesh();
+		}
+		return mesh;
+	});
+}
+
+AsyncLoadHandle<MeshAnimation> AsyncLoader::LoadAnimation(const std::string& filename, int priority) {
+	return StartLoad<MeshAnimation>(priority, [filename]() {
+		UniqueMeshAnim anim = std::make_unique<MeshAnimation>(filename);
+		if (anim->GetFrameCount() == 0) {
+			return UniqueMeshAnim();
+		}
+		return anim;
+	});
+}
+
+AsyncLoadHandle<MeshMaterial> AsyncLoader::LoadMaterial(const std::string& filename, int priority) {
+	return StartLoad<MeshMaterial>(priority, [filename]() {
+		std::unique_ptr<MeshMaterial> material = std::make_unique<MeshMaterial>(filename);
+		if (!material->GetMaterialForLayer(0)) {
+			return std::unique_ptr<MeshMaterial>();
+		}
+		return material;
+	});
+}
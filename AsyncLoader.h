@@ -0,0 +1,112 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Mesh.h"
+#include "MeshAnimation.h"
+#include "MeshMaterial.h"
+#include "ThreadPool.h"
+
+namespace NCL::Rendering {
+	enum class AsyncLoadState {
+		Queued,
+		Loading,
+		Loaded,
+		Failed,
+		Cancelled
+	};
+
+	//Shared between an AsyncLoadHandle and the worker running its load
+	template<typename T>
+	struct AsyncLoadData {
+		std::mutex				mutex;
+		std::condition_variable signal;
+		AsyncLoadState			state = AsyncLoadState::Queued;
+		std::unique_ptr<T>		result;
+
+		bool IsFinished() const {
+			return state != AsyncLoadState::Queued && state != AsyncLoadState::Loading;
+		}
+	};
+
+	//Tracks a load started by AsyncLoader. Handles can be copied, and all refer to the same load.
+	template<typename T>
+	class AsyncLoadHandle {
+	public:
+		AsyncLoadHandle() {}
+		AsyncLoadHandle(std::shared_ptr<AsyncLoadData<T>> data) : data(data) {}
+
+		bool IsValid() const {
+			return data != nullptr;
+		}
+
+		AsyncLoadState GetState() const {
+			std::unique_lock<std::mutex> lock(data->mutex);
+			return data->state;
+		}
+
+		//True once the load has been completed, failed, or been cancelled
+		bool IsDone() const {
+			std::unique_lock<std::mutex> lock(data->mutex);
+			return data->IsFinished();
+		}
+
+		AsyncLoadState Wait() const {
+			std::unique_lock<std::mutex> lock(data->mutex);
+			data->signal.wait(lock, [&] { return data->IsFinished(); });
+			return data->state;
+		}
+
+		//A queued load will never start, and a running one has its result thrown away.
+		//Returns false if the load had already finished.
+		bool Cancel() {
+			{
+				std::unique_lock<std::mutex> lock(data->mutex);
+				if (data->IsFinished()) {
+					return false;
+				}
+				data->state = AsyncLoadState::Cancelled;
+			}
+			data->signal.notify_all();
+			return true;
+		}
+
+		//Returns nullptr unless the load has completed. The result can only be taken once.
+		std::unique_ptr<T> TakeResult() {
+			std::unique_lock<std::mutex> lock(data->mutex);
+			return data->state == AsyncLoadState::Loaded ? std::move(data->result) : nullptr;
+		}
+
+	protected:
+		std::shared_ptr<AsyncLoadData<T>> data;
+	};
+
+	/*
+	Loads assets on background workers, so that streaming them in doesn't stall the
+	calling thread. File reading and decoding are all done by the workers - a loaded
+	mesh just needs UploadToGPU calling on the render thread.
+	*/
+	class AsyncLoader {
+	public:
+		//Creates the renderer's own Mesh type for a load to fill in, as Mesh itself is abstract
+		using MeshFactory = std::function<UniqueMesh()>;
+
+		//Loads with a higher priority are started first
+		static AsyncLoadHandle<Mesh>			LoadMesh(const std::string& filename, const MeshFactory& factory, int priority = 0, bool keepQuantised = false);
+		static AsyncLoadHandle<MeshAnimation>	LoadAnimation(const std::string& filename, int priority = 0);
+		static AsyncLoadHandle<MeshMaterial>	LoadMaterial(const std::string& filename, int priority = 0);
+
+		//Loads run on their own workers, so blocking file reads don't hold up the global pool.
+		//Large files still spread their decoding out across the global pool.
+		static ThreadPool& GetLoaderPool();
+
+	protected:
+		AsyncLoader() {}
+		~AsyncLoader() {}
+	};
+}
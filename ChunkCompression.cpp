@@ -0,0 +1,487 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "ChunkCompression.h"
+#include "GameTimer.h"
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <cstring>
+
+using namespace NCL;
+
+namespace {
+	//Compressed data starts with this, then the stored size of each block, then the blocks.
+	//A block stored at its uncompressed size holds the filtered data as it is.
+	struct CompressedHeader {
+		uint64_t rawSize;
+		uint32_t filter;
+		uint32_t blockCount;
+	};
+
+	const size_t MIN_MATCH		= 4;
+	const size_t LAST_LITERALS	= 8;	//Matches stop short of the block end, so the decoder can copy in 8s
+	const size_t MAX_OFFSET		= 65535;
+	const int	 HASH_BITS		= 14;
+
+	/*
+	Each LZ sequence is a token byte holding 4 bits of literal length and 4 bits
+	of match length, any extra length bytes for the literals, the literals, a
+	16 bit match offset, and then any extra match length bytes. Lengths of 15
+	continue in following bytes, each of 255 meaning another byte follows. The
+	final sequence is literals only.
+	*/
+	uint32_t Read32(const uint8_t* p) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	uint32_t HashSequence(uint32_t sequence) {
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	uint8_t* WriteLength(uint8_t* output, size_t length) {
+		while (length >= 255) {
+			*output++ = 255;
+			length -= 255;
+		}
+		*output++ = (uint8_t)length;
+		return output;
+	}
+
+	bool ReadLength(const uint8_t*& input, const uint8_t* inputEnd, size_t& length) {
+		uint8_t b;
+		do {
+			if (input == inputEnd) {
+				return false;
+			}
+			b = *input++;
+			length += b;
+		} while (b == 255);
+		return true;
+	}
+
+	uint8_t* WriteLiterals(uint8_t* output, const uint8_t* literals, size_t literalLength, uint8_t matchToken) {
+		*output++ = (uint8_t)((std::min<size_t>(literalLength, 15) << 4) | matchToken);
+		if (literalLength >= 15) {
+			output = WriteLength(output, literalLength - 15);
+		}
+		memcpy(output, literals, literalLength);
+		return output + literalLength;
+	}
+
+	//Copies 8 bytes at a time, and so may write up to 7 bytes past output + length
+	void WildCopy(uint8_t* output, const uint8_t* input, size_t length) {
+		uint8_t* end = output + length;
+		do {
+			memcpy(output, input, 8);
+			output	+= 8;
+			input	+= 8;
+		} while (output < end);
+	}
+
+	uint32_t ZigZag(uint32_t delta, int bits) {
+		return (delta << 1) ^ (uint32_t)(((int32_t)(delta << (32 - bits))) >> 31);
+	}
+
+	uint32_t UnZigZag(uint32_t value) {
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	size_t FilterStride(ChunkFilter filter) {
+		switch (filter) {
+		case ChunkFilter::Delta16:
+		case ChunkFilter::Shuffle2: return 2;
+		case ChunkFilter::Delta32:
+		case ChunkFilter::Shuffle4: return 4;
+		default:					return 1;
+		}
+	}
+
+	bool IsDeltaFilter(ChunkFilter filter) {
+		return filter == ChunkFilter::Delta16 || filter == ChunkFilter::Delta32;
+	}
+
+	//Interleaves 4 byte planes back into 32 bit values
+	void Unshuffle4(const uint8_t* input, size_t count, uint8_t* output) {
+		const uint8_t* p0 = input;
+		const uint8_t* p1 = input + count;
+		const uint8_t* p2 = input + count * 2;
+		const uint8_t* p3 = input + count * 3;
+		size_t i = 0;
+#ifdef NCL_SIMD_SSE
+		for (; i + 16 <= count; i += 16) {
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(p0 + i));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(p1 + i));
+			__m128i b2 = _mm_loadu_si128((const __m128i*)(p2 + i));
+			__m128i b3 = _mm_loadu_si128((const __m128i*)(p3 + i));
+
+			__m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+			__m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+			__m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+			__m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+
+			__m128i* out = (__m128i*)(output + i * 4);
+			_mm_storeu_si128(out,		_mm_unpacklo_epi16(lo01, lo23));
+			_mm_storeu_si128(out + 1,	_mm_unpackhi_epi16(lo01, lo23));
+			_mm_storeu_si128(out + 2,	_mm_unpacklo_epi16(hi01, hi23));
+			_mm_storeu_si128(out + 3,	_mm_unpackhi_epi16(hi01, hi23));
+		}
+#endif
+		for (; i < count; ++i) {
+			output[i * 4]		= p0[i];
+			output[i * 4 + 1]	= p1[i];
+			output[i * 4 + 2]	= p2[i];
+			output[i * 4 + 3]	= p3[i];
+		}
+	}
+
+	void Unshuffle2(const uint8_t* input, size_t count, uint8_t* output) {
+		const uint8_t* p0 = input;
+		const uint8_t* p1 = input + count;
+		size_t i = 0;
+#ifdef NCL_SIMD_SSE
+		for (; i + 16 <= count; i += 16) {
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(p0 + i));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(p1 + i));
+
+			__m128i* out = (__m128i*)(output + i * 2);
+			_mm_storeu_si128(out,		_mm_unpacklo_epi8(b0, b1));
+			_mm_storeu_si128(out + 1,	_mm_unpackhi_epi8(b0, b1));
+		}
+#endif
+		for (; i < count; ++i) {
+			output[i * 2]		= p0[i];
+			output[i * 2 + 1]	= p1[i];
+		}
+	}
+
+	//Running sum of zigzagged deltas, in place
+	template<typename T>
+	void UndoDeltas(uint8_t* data, size_t count) {
+		T value = 0;
+		for (size_t i = 0; i < count; ++i) {
+			T z;
+			memcpy(&z, data + i * sizeof(T), sizeof(T));
+			value += (T)UnZigZag(z);
+			memcpy(data + i * sizeof(T), &value, sizeof(T));
+		}
+	}
+}
+
+size_t ChunkCompression::LZCompress(const uint8_t* input, size_t size, uint8_t* output) {
+	uint8_t* op		= output;
+	size_t	 anchor = 0;
+
+	if (size > MIN_MATCH + LAST_LITERALS) {
+		std::vector<uint32_t> table(1 << HASH_BITS, 0);
+		size_t matchLimit = size - LAST_LITERALS;
+		size_t pos = 1;
+
+		while (pos + MIN_MATCH <= matchLimit) {
+			uint32_t sequence	= Read32(input + pos);
+			uint32_t hash		= HashSequence(sequence);
+			size_t	 candidate	= table[hash];
+			table[hash] = (uint32_t)pos;
+
+			if (pos - candidate > MAX_OFFSET || Read32(input + candidate) != sequence) {
+				pos += 1 + ((pos - anchor) >> 6); //Skip through incompressible data faster
+				continue;
+			}
+			size_t length = MIN_MATCH;
+			while (pos + length + 8 <= matchLimit) {
+				uint64_t a, b;
+				memcpy(&a, input + pos + length, 8);
+				memcpy(&b, input + candidate + length, 8);
+				if (a != b) {
+					break;
+				}
+				length += 8;
+			}
+			while (pos + length < matchLimit && input[pos + length] == input[candidate + length]) {
+				++length;
+			}
+			while (pos > anchor && candidate > 0 && input[pos - 1] == input[candidate - 1]) {
+				--pos;
+				--candidate;
+				++length;
+			}
+			size_t offset		= pos - candidate;
+			size_t matchExtra	= length - MIN_MATCH;
+
+			op = WriteLiterals(op, input + anchor, pos - anchor, (uint8_t)std::min<size_t>(matchExtra, 15));
+			*op++ = (uint8_t)(offset & 0xFF);
+			*op++ = (uint8_t)(offset >> 8);
+			if (matchExtra >= 15) {
+				op = WriteLength(op, matchExtra - 15);
+			}
+			pos		+= length;
+			anchor	= pos;
+			if (pos + MIN_MATCH <= matchLimit) {
+				table[HashSequence(Read32(input + pos - 2))] = (uint32_t)(pos - 2);
+			}
+		}
+	}
+	op = WriteLiterals(op, input + anchor, size - anchor, 0);
+	return op - output;
+}
+
+bool ChunkCompression::LZDecompress(const uint8_t* input, size_t size, uint8_t* output, size_t outputSize) {
+	const uint8_t* ip		= input;
+	const uint8_t* ipEnd	= input + size;
+	uint8_t*	   op		= output;
+	uint8_t*	   opEnd	= output + outputSize;
+
+	while (ip < ipEnd) {
+		uint8_t token = *ip++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength)) {
+			return false;
+		}
+		if (literalLength > (size_t)(ipEnd - ip) || literalLength > (size_t)(opEnd - op)) {
+			return false;
+		}
+		if (literalLength + 8 <= (size_t)(ipEnd - ip) && literalLength + 8 <= (size_t)(opEnd - op)) {
+			WildCopy(op, ip, literalLength);
+		}
+		else {
+			memcpy(op, ip, literalLength);
+		}
+		ip += literalLength;
+		op += literalLength;
+
+		if (ip == ipEnd) {
+			break;
+		}
+		if (ipEnd - ip < 2) {
+			return false;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - output)) {
+			return false;
+		}
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength)) {
+			return false;
+		}
+		matchLength += MIN_MATCH;
+		if (matchLength > (size_t)(opEnd - op)) {
+			return false;
+		}
+		const uint8_t* match = op - offset;
+		if (offset >= 8 && matchLength + 8 <= (size_t)(opEnd - op)) {
+			WildCopy(op, match, matchLength);
+		}
+		else if (matchLength + 8 <= (size_t)(opEnd - op)) {
+			//Short offsets repeat a pattern, so once a whole number of repeats covers 8 bytes,
+			//the rest can be copied 8 bytes at a time from that far back
+			size_t step = offset * ((8 + offset - 1) / offset);
+			size_t head = std::min(step, matchLength);
+			for (size_t i = 0; i < head; ++i) {
+				op[i] = match[i];
+			}
+			if (matchLength > head) {
+				WildCopy(op + head, op + head - step, matchLength - head);
+			}
+		}
+		else {
+			for (size_t i = 0; i < matchLength; ++i) {
+				op[i] = match[i];
+			}
+		}
+		op += matchLength;
+	}
+	return op == opEnd;
+}
+
+void ChunkCompression::Filter(ChunkFilter filter, const uint8_t* input, size_t size, uint8_t* output) {
+	size_t stride	= FilterStride(filter);
+	size_t count	= size / stride;
+	size_t tail		= count * stride;
+
+	if (IsDeltaFilter(filter)) {
+		int		 bits		= (int)stride * 8;
+		uint32_t previous	= 0;
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t value = 0;
+			memcpy(&value, input + i * stride, stride);
+			uint32_t z = ZigZag(value - previous, bits);
+			previous = value;
+			for (size_t b = 0; b < stride; ++b) {
+				output[b * count + i] = (uint8_t)(z >> (b * 8));
+			}
+		}
+	}
+	else if (stride > 1) {
+		for (size_t i = 0; i < count; ++i) {
+			for (size_t b = 0; b < stride; ++b) {
+				output[b * count + i] = input[i * stride + b];
+			}
+		}
+	}
+	else {
+		tail = 0;
+	}
+	memcpy(output + tail, input + tail, size - tail);
+}
+
+void ChunkCompression::Unfilter(ChunkFilter filter, const uint8_t* input, size_t size, uint8_t* output) {
+	size_t stride	= FilterStride(filter);
+	size_t count	= size / stride;
+	size_t tail		= count * stride;
+
+	//The byte planes are put back first, so the deltas can be summed as whole integers
+	if (stride == 4) {
+		Unshuffle4(input, count, output);
+	}
+	else if (stride == 2) {
+		Unshuffle2(input, count, output);
+	}
+	else {
+		tail = 0;
+	}
+	if (filter == ChunkFilter::Delta32) {
+		UndoDeltas<uint32_t>(output, count);
+	}
+	else if (filter == ChunkFilter::Delta16) {
+		UndoDeltas<uint16_t>(output, count);
+	}
+	memcpy(output + tail, input + tail, size - tail);
+}
+
+void ChunkCompression::Compress(const void* data, size_t size, ChunkFilter filter, std::string& output, CompressionStats* stats) {
+	GameTimer timer;
+	const uint8_t* input = (const uint8_t*)data;
+
+	CompressedHeader header;
+	header.rawSize		= size;
+	header.filter		= (uint32_t)filter;
+	header.blockCount	= (uint32_t)((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+	size_t start = output.size();
+	output.append((const char*)&header, sizeof(header));
+	output.append(header.blockCount * sizeof(uint32_t), 0);
+
+	std::vector<uint8_t> filtered(std::min(size, BLOCK_SIZE));
+	std::vector<uint8_t> packed(LZBound(BLOCK_SIZE));
+
+	for (uint32_t i = 0; i < header.blockCount; ++i) {
+		size_t blockSize = std::min(BLOCK_SIZE, size - i * BLOCK_SIZE);
+		Filter(filter, input + i * BLOCK_SIZE, blockSize, filtered.data());
+
+		uint32_t storedSize = (uint32_t)LZCompress(filtered.data(), blockSize, packed.data());
+		if (storedSize >= blockSize) {
+			storedSize = (uint32_t)blockSize;
+			output.append((const char*)filtered.data(), blockSize);
+		}
+		else {
+			output.append((const char*)packed.data(), storedSize);
+		}
+		memcpy(&output[start + sizeof(header) + i * sizeof(uint32_t)], &storedSize, sizeof(uint32_t));
+	}
+	if (stats) {
+		stats->rawBytes		+= size;
+		stats->storedBytes	+= output.size() - start;
+		stats->seconds		+= timer.GetTotalTimeSeconds();
+	}
+}
+
+bool ChunkCompression::GetDecompressedSize(const void* data, size_t size, size_t& outputSize) {
+	CompressedHeader header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	outputSize = (size_t)header.rawSize;
+	return true;
+}
+
+size_t ChunkCompression::GetHeaderSize(size_t rawSize) {
+	return sizeof(CompressedHeader) + ((rawSize + BLOCK_SIZE - 1) / BLOCK_SIZE) * sizeof(uint32_t);
+}
+
+bool ChunkCompression::ReadBlockLayout(const void* header, size_t headerSize, size_t compressedSize, BlockLayout& layout) {
+	const uint8_t* input = (const uint8_t*)header;
+
+	CompressedHeader fixedHeader;
+	if (headerSize < sizeof(fixedHeader)) {
+		return false;
+	}
+	memcpy(&fixedHeader, input, sizeof(fixedHeader));
+
+	if (fixedHeader.filter >= (uint32_t)ChunkFilter::MAX_FILTERS || fixedHeader.rawSize > SIZE_MAX / 2 ||
+		fixedHeader.blockCount != (fixedHeader.rawSize + BLOCK_SIZE - 1) / BLOCK_SIZE ||
+		headerSize < GetHeaderSize((size_t)fixedHeader.rawSize)) {
+		return false;
+	}
+	layout.rawSize	= (size_t)fixedHeader.rawSize;
+	layout.filter	= (ChunkFilter)fixedHeader.filter;
+	layout.offsets.resize(fixedHeader.blockCount + 1);
+	layout.offsets[0] = GetHeaderSize(layout.rawSize);
+	for (uint32_t i = 0; i < fixedHeader.blockCount; ++i) {
+		uint32_t storedSize;
+		memcpy(&storedSize, input + sizeof(fixedHeader) + i * sizeof(uint32_t), sizeof(uint32_t));
+		if (storedSize > LZBound(BLOCK_SIZE)) {
+			return false;
+		}
+		layout.offsets[i + 1] = layout.offsets[i] + storedSize;
+	}
+	return layout.offsets.back() == compressedSize;
+}
+
+bool ChunkCompression::DecompressBlock(const BlockLayout& layout, size_t block, const void* blockData, void* output, std::vector<uint8_t>& scratch) {
+	size_t		   blockSize  = layout.GetBlockSize(block);
+	size_t		   storedSize = layout.offsets[block + 1] - layout.offsets[block];
+	const uint8_t* input	  = (const uint8_t*)blockData;
+	uint8_t*	   dest		  = (uint8_t*)output;
+
+	if (storedSize == blockSize) {
+		Unfilter(layout.filter, input, blockSize, dest);
+		return true;
+	}
+	if (layout.filter == ChunkFilter::None) {
+		return LZDecompress(input, storedSize, dest, blockSize);
+	}
+	scratch.resize(blockSize);
+	if (!LZDecompress(input, storedSize, scratch.data(), blockSize)) {
+		return false;
+	}
+	Unfilter(layout.filter, scratch.data(), blockSize, dest);
+	return true;
+}
+
+bool ChunkCompression::Decompress(const void* data, size_t size, void* output, size_t outputSize, CompressionStats* stats) {
+	GameTimer timer;
+	const uint8_t* input = (const uint8_t*)data;
+
+	BlockLayout layout;
+	if (!ReadBlockLayout(data, size, size, layout) || layout.rawSize != outputSize) {
+		return false;
+	}
+	uint8_t*		  dest	 = (uint8_t*)output;
+	std::atomic<bool> failed = false;
+
+	ThreadPool::GetGlobalPool().ParallelFor(layout.GetBlockCount(), 1, [&](size_t first, size_t last) {
+		std::vector<uint8_t> scratch;
+		for (size_t i = first; i < last; ++i) {
+			if (!DecompressBlock(layout, i, input + layout.offsets[i], dest + i * BLOCK_SIZE, scratch)) {
+				failed = true;
+			}
+		}
+	});
+	if (stats) {
+		stats->rawBytes		+= outputSize;
+		stats->storedBytes	+= size;
+		stats->seconds		+= timer.GetTotalTimeSeconds();
+	}
+	return !failed;
+}
@@ -0,0 +1,99 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include <cstdint>
+
+namespace NCL {
+	//Reversible transforms applied to a chunk before compressing it, to expose more redundancy
+	enum class ChunkFilter : uint32_t {
+		None,
+		Delta16,	//Zigzagged differences between consecutive 16 bit integers, split into byte planes
+		Delta32,	//As above, for 32 bit integers - best suited to index buffers
+		Shuffle2,	//Groups the bytes of 16 bit values into planes
+		Shuffle4,	//Groups the bytes of 32 bit values into planes - best suited to float arrays
+		MAX_FILTERS
+	};
+
+	struct CompressionStats {
+		size_t	rawBytes	= 0;
+		size_t	storedBytes = 0;
+		double	seconds		= 0.0;
+
+		void Add(const CompressionStats& other) {
+			rawBytes	+= other.rawBytes;
+			storedBytes += other.storedBytes;
+			seconds		+= other.seconds;
+		}
+
+		double GetRatio() const {
+			return storedBytes ? (double)rawBytes / storedBytes : 1.0;
+		}
+
+		//In megabytes of uncompressed data per second
+		double GetThroughput() const {
+			return seconds > 0.0 ? rawBytes / (seconds * 1024.0 * 1024.0) : 0.0;
+		}
+	};
+
+	/*
+	Lossless compression for asset file chunks. Data is filtered and then compressed
+	with a byte oriented LZ77 codec in independent 1MB blocks, so blocks can be
+	decompressed in parallel. Blocks that don't shrink are stored as they are.
+	*/
+	class ChunkCompression {
+	public:
+		static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+		//Appends the compressed form of data to output
+		static void Compress(const void* data, size_t size, ChunkFilter filter, std::string& output, CompressionStats* stats = nullptr);
+
+		//Output must be exactly the size the data was before compression.
+		//Blocks are spread across the global thread pool.
+		static bool Decompress(const void* data, size_t size, void* output, size_t outputSize, CompressionStats* stats = nullptr);
+
+		//Reads the uncompressed size from the start of compressed data
+		static bool GetDecompressedSize(const void* data, size_t size, size_t& outputSize);
+
+		//Where each block of some compressed data is, so they can be decompressed one at a time
+		struct BlockLayout {
+			size_t				rawSize = 0;
+			ChunkFilter			filter	= ChunkFilter::None;
+			std::vector<size_t> offsets;	//Start of each block within the compressed data, then the end
+
+			size_t GetBlockCount() const {
+				return offsets.empty() ? 0 : offsets.size() - 1;
+			}
+
+			size_t GetBlockSize(size_t block) const {
+				return std::min(BLOCK_SIZE, rawSize - block * BLOCK_SIZE);
+			}
+		};
+		//How many bytes from the start of the compressed data ReadBlockLayout needs
+		static size_t GetHeaderSize(size_t rawSize);
+		static bool ReadBlockLayout(const void* header, size_t headerSize, size_t compressedSize, BlockLayout& layout);
+
+		//Output must have room for layout.GetBlockSize(block) bytes. Scratch is reused between calls.
+		static bool DecompressBlock(const BlockLayout& layout, size_t block, const void* blockData, void* output, std::vector<uint8_t>& scratch);
+
+		//The LZ codec on its own. Output must have room for LZBound(size) bytes.
+		static size_t LZCompress(const uint8_t* input, size_t size, uint8_t* output);
+		static bool	  LZDecompress(const uint8_t* input, size_t size, uint8_t* output, size_t outputSize);
+
+		static size_t LZBound(size_t size) {
+			return size + size / 255 + 16;
+		}
+
+	protected:
+		ChunkCompression() {}
+		~ChunkCompression() {}
+
+		static void Filter(ChunkFilter filter, const uint8_t* input, size_t size, uint8_t* output);
+		static void Unfilter(ChunkFilter filter, const uint8_t* input, size_t size, uint8_t* output);
+	};
+}
@@ -0,0 +1,362 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "CompressedAnimation.h"
+#include "MeshAnimation.h"
+
+#include <cstring>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	//Smallest three only stores the 3 smallest components, which are within +-1/sqrt(2)
+	const float SQRT_HALF = 0.70710678f;
+
+	float MaxQuantised(int bits) {
+		return (float)((1u << bits) - 1);
+	}
+
+	uint32_t Quantise(float value, float base, float step, float maxValue) {
+		if (step == 0.0f) {
+			return 0;
+		}
+		return (uint32_t)std::clamp(std::round((value - base) / step), 0.0f, maxValue);
+	}
+
+	void EncodeRotation(Quaternion q, int bits, uint8_t* output) {
+		const float* c = &q.x;
+		int largest = 0;
+		for (int i = 1; i < 4; ++i) {
+			if (std::abs(c[i]) > std::abs(c[largest])) {
+				largest = i;
+			}
+		}
+		float	 sign		= c[largest] < 0.0f ? -1.0f : 1.0f; //q and -q are the same rotation
+		float	 maxValue	= MaxQuantised(bits);
+		uint32_t v[3];
+		for (int i = 0, j = 0; i < 4; ++i) {
+			if (i != largest) {
+				v[j++] = Quantise(c[i] * sign, -SQRT_HALF, 2.0f * SQRT_HALF / maxValue, maxValue);
+			}
+		}
+		if (bits == 10) {
+			uint32_t packed = (uint32_t)largest << 30 | v[0] << 20 | v[1] << 10 | v[2];
+			memcpy(output, &packed, sizeof(packed));
+		}
+		else {
+			uint16_t packed[3] = {
+				(uint16_t)(v[0] | (largest & 1) << 15),
+				(uint16_t)(v[1] | (largest >> 1) << 15),
+				(uint16_t)v[2]
+			};
+			memcpy(output, packed, sizeof(packed));
+		}
+	}
+
+	void DecodeRotation(const uint8_t* input, int bits, float* output) {
+		uint32_t v[3];
+		int		 largest;
+		if (bits == 10) {
+			uint32_t packed;
+			memcpy(&packed, input, sizeof(packed));
+			largest = packed >> 30;
+			v[0]	= (packed >> 20) & 0x3FF;
+			v[1]	= (packed >> 10) & 0x3FF;
+			v[2]	= packed & 0x3FF;
+		}
+		else {
+			uint16_t packed[3];
+			memcpy(packed, input, sizeof(packed));
+			largest = (packed[0] >> 15) | (packed[1] >> 15) << 1;
+			v[0]	= packed[0] & 0x7FFF;
+			v[1]	= packed[1] & 0x7FFF;
+			v[2]	= packed[2];
+		}
+		float step	= 2.0f * SQRT_HALF / MaxQuantised(bits);
+		float sum	= 0.0f;
+		for (int i = 0, j = 0; i < 4; ++i) {
+			if (i != largest) {
+				output[i] = v[j++] * step - SQRT_HALF;
+				sum += output[i] * output[i];
+			}
+		}
+		output[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+	}
+}
+
+CompressedAnimation::CompressedAnimation() {
+	jointCount	= 0;
+	frameCount	= 0;
+	frameRate	= 0.0f;
+	frameStride = 0;
+}
+
+CompressedAnimation::~CompressedAnimation() {
+}
+
+bool CompressedAnimation::Compress(const MeshAnimation& anim, const AnimationErrorBudget& budget) {
+	size_t joints = anim.GetJointCount();
+	size_t frames = anim.GetFrameCount();
+	if (joints == 0 || frames == 0) {
+		std::cout << __FUNCTION__ << " can't compress an empty animation!\n";
+		return false;
+	}
+	std::vector<JointTransform> poses(joints * frames);
+	for (size_t f = 0; f < frames; ++f) {
+		const Matrix4* frame = anim.GetJointData(f);
+		for (size_t j = 0; j < joints; ++j) {
+			JointTransform& t = poses[f * joints + j];
+			t = JointTransform::FromMatrix(frame[j]);
+			t.rotation.Normalise();
+		}
+	}
+	jointCount	= joints;
+	frameCount	= frames;
+	frameRate	= anim.GetFrameRate();
+	tracks.assign(joints * 3, Track());
+
+	//Picks the cheapest format for a rotation track that stays within budget
+	auto ChooseRotationFormat = [&](size_t joint, Track& track) {
+		const Quaternion& first = poses[joint].rotation;
+		float constantError = 0.0f;
+		float error32		= 0.0f;
+		float error48		= 0.0f;
+		for (size_t f = 0; f < frames; ++f) {
+			const Quaternion& q = poses[f * joints + joint].rotation;
+			constantError = std::max(constantError, JointTransform::AngleBetween(q, first));
+
+			uint8_t encoded[6];
+			Quaternion decoded;
+			EncodeRotation(q, 10, encoded);
+			DecodeRotation(encoded, 10, &decoded.x);
+			error32 = std::max(error32, JointTransform::AngleBetween(q, decoded));
+
+			EncodeRotation(q, 15, encoded);
+			DecodeRotation(encoded, 15, &decoded.x);
+			error48 = std::max(error48, JointTransform::AngleBetween(q, decoded));
+		}
+		if (constantError <= budget.rotation) {
+			track.format = TrackFormat::Constant;
+			memcpy(track.base, &first.x, sizeof(float) * 4);
+		}
+		else if (error32 <= budget.rotation) {
+			track.format = TrackFormat::Rotation32;
+		}
+		else if (error48 <= budget.rotation) {
+			track.format = TrackFormat::Rotation48;
+		}
+		else {
+			track.format = TrackFormat::RotationFull;
+		}
+	};
+	//Translations and scales are quantised over their range
+	auto ChooseVectorFormat = [&](size_t joint, Vector3 JointTransform::* member, float allowedError, Track& track) {
+		Vector3 minValue = poses[joint].*member;
+		Vector3 maxValue = minValue;
+		for (size_t f = 1; f < frames; ++f) {
+			minValue = Vector::Min(minValue, poses[f * joints + joint].*member);
+			maxValue = Vector::Max(maxValue, poses[f * joints + joint].*member);
+		}
+		Vector3 centre = (minValue + maxValue) * 0.5f;
+		if (Vector::Length(maxValue - centre) <= allowedError) {
+			track.format = TrackFormat::Constant;
+			memcpy(track.base, &centre.x, sizeof(float) * 3);
+			return;
+		}
+		track.format = TrackFormat::Full;
+		for (int bits : { 8, 16 }) {
+			float maxQ = MaxQuantised(bits);
+			float base[3], step[3];
+			for (int i = 0; i < 3; ++i) {
+				base[i] = minValue[i];
+				step[i] = (maxValue[i] - minValue[i]) / maxQ;
+			}
+			float error = 0.0f;
+			for (size_t f = 0; f < frames && error <= allowedError; ++f) {
+				const Vector3& v = poses[f * joints + joint].*member;
+				Vector3 decoded;
+				for (int i = 0; i < 3; ++i) {
+					decoded[i] = base[i] + Quantise(v[i], base[i], step[i], maxQ) * step[i];
+				}
+				error = std::max(error, Vector::Length(decoded - v));
+			}
+			if (error <= allowedError) {
+				track.format = bits == 8 ? TrackFormat::Quantised8 : TrackFormat::Quantised16;
+				memcpy(track.base, base, sizeof(base));
+				memcpy(track.step, step, sizeof(step));
+				break;
+			}
+		}
+	};
+	auto FormatSize = [](TrackFormat format) -> uint32_t {
+		switch (format) {
+		case TrackFormat::Quantised8:	return 3;
+		case TrackFormat::Quantised16:	return 6;
+		case TrackFormat::Full:			return 12;
+		case TrackFormat::Rotation32:	return 4;
+		case TrackFormat::Rotation48:	return 6;
+		case TrackFormat::RotationFull:	return 16;
+		default:						return 0;
+		}
+	};
+
+	frameStride = 0;
+	for (size_t j = 0; j < joints; ++j) {
+		ChooseRotationFormat(j, tracks[j * 3]);
+		ChooseVectorFormat(j, &JointTransform::translation, budget.translation, tracks[j * 3 + 1]);
+		ChooseVectorFormat(j, &JointTransform::scale, budget.scale, tracks[j * 3 + 2]);
+		for (int k = 0; k < 3; ++k) {
+			tracks[j * 3 + k].offset = (uint32_t)frameStride;
+			frameStride += FormatSize(tracks[j * 3 + k].format);
+		}
+	}
+
+	frameData.assign(frames * frameStride, 0);
+	for (size_t f = 0; f < frames; ++f) {
+		uint8_t* record = frameData.data() + f * frameStride;
+		for (size_t j = 0; j < joints; ++j) {
+			const JointTransform& pose = poses[f * joints + j];
+			const Vector3* vectors[3] = { nullptr, &pose.translation, &pose.scale };
+
+			for (int k = 0; k < 3; ++k) {
+				const Track& track = tracks[j * 3 + k];
+				uint8_t* output = record + track.offset;
+				switch (track.format) {
+				case TrackFormat::Rotation32: EncodeRotation(pose.rotation, 10, output); break;
+				case TrackFormat::Rotation48: EncodeRotation(pose.rotation, 15, output); break;
+				case TrackFormat::RotationFull: memcpy(output, &pose.rotation.x, sizeof(float) * 4); break;
+				case TrackFormat::Full:		  memcpy(output, &vectors[k]->x, sizeof(Vector3)); break;
+				case TrackFormat::Quantised8:
+				case TrackFormat::Quantised16: {
+					int bits = track.format == TrackFormat::Quantised8 ? 8 : 16;
+					for (int i = 0; i < 3; ++i) {
+						uint32_t v = Quantise((*vectors[k])[i], track.base[i], track.step[i], MaxQuantised(bits));
+						if (bits == 8) {
+							output[i] = (uint8_t)v;
+						}
+						else {
+							uint16_t v16 = (uint16_t)v;
+							memcpy(output + i * 2, &v16, sizeof(v16));
+						}
+					}
+				}break;
+				default: break;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+size_t CompressedAnimation::GetMemoryUsage() const {
+	return sizeof(*this) + tracks.size() * sizeof(Track) + frameData.size();
+}
+
+void CompressedAnimation::DecodeTrack(const Track& track, const uint8_t* record, float* output) const {
+	const uint8_t* input = record + track.offset;
+	switch (track.format) {
+	case TrackFormat::Constant:		memcpy(output, track.base, sizeof(float) * 4);	break;
+	case TrackFormat::Rotation32:	DecodeRotation(input, 10, output);				break;
+	case TrackFormat::Rotation48:	DecodeRotation(input, 15, output);				break;
+	case TrackFormat::RotationFull:	memcpy(output, input, sizeof(float) * 4);		break;
+	case TrackFormat::Full:			memcpy(output, input, sizeof(float) * 3);		break;
+	case TrackFormat::Quantised8: {
+		for (int i = 0; i < 3; ++i) {
+			output[i] = track.base[i] + input[i] * track.step[i];
+		}
+	}break;
+	case TrackFormat::Quantised16: {
+		uint16_t v[3];
+		memcpy(v, input, sizeof(v));
+		for (int i = 0; i < 3; ++i) {
+			output[i] = track.base[i] + v[i] * track.step[i];
+		}
+	}break;
+	}
+}
+
+void CompressedAnimation::DecodeJoint(size_t joint, const uint8_t* record, JointTransform& output) const {
+	float values[3][4];
+	for (int k = 0; k < 3; ++k) {
+		DecodeTrack(tracks[joint * 3 + k], record, values[k]);
+	}
+	output.rotation		= Quaternion(values[0][0], values[0][1], values[0][2], values[0][3]);
+	output.translation	= Vector3(values[1][0], values[1][1], values[1][2]);
+	output.scale		= Vector3(values[2][0], values[2][1], values[2][2]);
+}
+
+void CompressedAnimation::GetFrame(size_t frame, JointTransform* output) const {
+	if (frameCount == 0) {
+		return;
+	}
+	const uint8_t* record = GetRecord(std::min(frame, frameCount - 1));
+	for (size_t j = 0; j < jointCount; ++j) {
+		DecodeJoint(j, record, output[j]);
+	}
+}
+
+void CompressedAnimation::GetFrame(size_t frame, Matrix4* output) const {
+	if (frameCount == 0) {
+		return;
+	}
+	const uint8_t* record = GetRecord(std::min(frame, frameCount - 1));
+	for (size_t j = 0; j < jointCount; ++j) {
+		JointTransform t;
+		DecodeJoint(j, record, t);
+		output[j] = t.ToMatrix();
+	}
+}
+
+void CompressedAnimation::GetFrameFraction(float time, size_t& frame, size_t& nextFrame, float& t) const {
+	float position = std::clamp(time * frameRate, 0.0f, (float)(frameCount - 1));
+	frame		= std::min((size_t)position, frameCount - 1);
+	nextFrame	= std::min(frame + 1, frameCount - 1);
+	t			= position - frame;
+}
+
+void CompressedAnimation::Sample(float time, JointTransform* output) const {
+	if (frameCount == 0) {
+		return;
+	}
+	size_t	frame;
+	size_t	nextFrame;
+	float	t;
+	GetFrameFraction(time, frame, nextFrame, t);
+
+	const uint8_t* a = GetRecord(frame);
+	const uint8_t* b = GetRecord(nextFrame);
+	for (size_t j = 0; j < jointCount; ++j) {
+		JointTransform from;
+		JointTransform to;
+		DecodeJoint(j, a, from);
+		DecodeJoint(j, b, to);
+		output[j] = JointTransform::Blend(from, to, t);
+	}
+}
+
+void CompressedAnimation::Sample(float time, Matrix4* output) const {
+	if (frameCount == 0) {
+		return;
+	}
+	size_t	frame;
+	size_t	nextFrame;
+	float	t;
+	GetFrameFraction(time, frame, nextFrame, t);
+
+	const uint8_t* a = GetRecord(frame);
+	const uint8_t* b = GetRecord(nextFrame);
+	for (size_t j = 0; j < jointCount; ++j) {
+		JointTransform from;
+		JointTransform to;
+		DecodeJoint(j, a, from);
+		DecodeJoint(j, b, to);
+		output[j] = JointTransform::Blend(from, to, t).ToMatrix();
+	}
+}
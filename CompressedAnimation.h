@@ -0,0 +1,99 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Skeleton.h"
+
+namespace NCL::Rendering {
+	class MeshAnimation;
+
+	//The largest error a compressed track may have, measured against the source animation
+	struct AnimationErrorBudget {
+		float rotation		= 0.001f;	//In radians
+		float translation	= 0.0001f;	//In the animation's units
+		float scale			= 0.0001f;
+	};
+
+	/*
+	A MeshAnimation stored as per-joint rotation, translation and scale tracks.
+	Tracks that don't change are stored once, rotations are quantised with the
+	smallest three method, and translations and scales are quantised over their
+	range. Each track uses the smallest format that keeps within the error budget.
+
+	Output is in the source animation's joint order, and in the same space as
+	MeshAnimation's matrices - model space, ready for MeshSkinner's palette.
+	*/
+	class CompressedAnimation {
+	public:
+		CompressedAnimation();
+		~CompressedAnimation();
+
+		bool Compress(const MeshAnimation& anim, const AnimationErrorBudget& budget = AnimationErrorBudget());
+
+		size_t GetJointCount() const {
+			return jointCount;
+		}
+
+		size_t GetFrameCount() const {
+			return frameCount;
+		}
+
+		float GetFrameRate() const {
+			return frameRate;
+		}
+
+		float GetAnimationTime() const {
+			return frameCount / (float)frameRate;
+		}
+
+		//In bytes
+		size_t GetMemoryUsage() const;
+
+		//Output must have room for GetJointCount() entries
+		void GetFrame(size_t frame, JointTransform* output) const;
+		void GetFrame(size_t frame, Matrix4* output) const;
+
+		//Interpolates between the frames either side of time, in seconds, clamped to the clip
+		void Sample(float time, JointTransform* output) const;
+		void Sample(float time, Matrix4* output) const;
+
+	protected:
+		enum class TrackFormat : uint8_t {
+			Constant,
+			Quantised8,		//Per component, over the track's range
+			Quantised16,
+			Full,			//Plain floats, for ranges too large to quantise within the budget
+			Rotation32,		//Smallest three, 10 bits per component
+			Rotation48,		//Smallest three, 15 bits per component
+			RotationFull,	//Plain floats, for budgets tighter than 15 bits can reach
+		};
+
+		struct Track {
+			TrackFormat format	= TrackFormat::Constant;
+			uint32_t	offset	= 0;	//Within each frame's record
+			float		base[4] = {};	//The constant value, or the range minimum
+			float		step[3] = {};	//Range covered by each quantisation step
+		};
+
+		void DecodeTrack(const Track& track, const uint8_t* record, float* output) const;
+		void DecodeJoint(size_t joint, const uint8_t* record, JointTransform& output) const;
+
+		const uint8_t* GetRecord(size_t frame) const {
+			return frameData.data() + frame * frameStride;
+		}
+
+		void GetFrameFraction(float time, size_t& frame, size_t& nextFrame, float& t) const;
+
+		size_t					jointCount;
+		size_t					frameCount;
+		float					frameRate;
+		size_t					frameStride;
+		std::vector<Track>		tracks;		//Rotation, translation, and scale per joint
+		std::vector<uint8_t>	frameData;	//Each frame's non-constant tracks, frameStride bytes per frame
+	};
+}
@@ -0,0 +1,220 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "GeometryPool.h"
+
+using namespace NCL;
+using namespace Rendering;
+
+namespace {
+	template<typename T>
+	void CopyAttribute(std::vector<T>& dest, const std::vector<T>& source, uint32_t offset, uint32_t count) {
+		if (dest.empty()) {
+			return; //Attribute isn't stored in this pool
+		}
+		if (source.size() >= count) {
+			std::copy(source.begin(), source.begin() + count, dest.begin() + offset);
+		}
+		else {
+			std::fill(dest.begin() + offset, dest.begin() + offset + count, T());
+		}
+	}
+}
+
+FreeListAllocator::FreeListAllocator(uint32_t capacity) : capacity(capacity), freeSpace(capacity) {
+	if (capacity > 0) {
+		freeBlocks[0] = capacity;
+	}
+}
+
+bool FreeListAllocator::Allocate(uint32_t size, uint32_t& offset) {
+	if (size == 0) {
+		offset = 0;
+		return true;
+	}
+	for (auto i = freeBlocks.begin(); i != freeBlocks.end(); ++i) {
+		if (i->second < size) {
+			continue;
+		}
+		offset = i->first;
+		uint32_t remaining = i->second - size;
+		freeBlocks.erase(i);
+		if (remaining > 0) {
+			freeBlocks[offset + size] = remaining;
+		}
+		freeSpace -= size;
+		return true;
+	}
+	return false;
+}
+
+void FreeListAllocator::Free(uint32_t offset, uint32_t size) {
+	if (size == 0) {
+		return;
+	}
+	freeSpace += size;
+	auto next = freeBlocks.lower_bound(offset);
+
+	if (next != freeBlocks.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size  += prev->second;
+			freeBlocks.erase(prev);
+		}
+	}
+	if (next != freeBlocks.end() && offset + size == next->first) {
+		size += next->second;
+		freeBlocks.erase(next);
+	}
+	freeBlocks[offset] = size;
+}
+
+uint32_t FreeListAllocator::GetLargestFreeBlock() const {
+	uint32_t largest = 0;
+	for (const auto& [offset, size] : freeBlocks) {
+		largest = std::max(largest, size);
+	}
+	return largest;
+}
+
+GeometryPool::GeometryPool(uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t attributeMask)
+	: vertexAllocator(vertexCapacity), indexAllocator(indexCapacity), attributeMask(attributeMask) {
+	if (HasAttribute(VertexAttribute::Positions))		{ positions.resize(vertexCapacity);		}
+	if (HasAttribute(VertexAttribute::TextureCoords))	{ texCoords.resize(vertexCapacity);		}
+	if (HasAttribute(VertexAttribute::Colours))			{ colours.resize(vertexCapacity);		}
+	if (HasAttribute(VertexAttribute::Normals))			{ normals.resize(vertexCapacity);		}
+	if (HasAttribute(VertexAttribute::Tangents))		{ tangents.resize(vertexCapacity);		}
+	if (HasAttribute(VertexAttribute::JointWeights))	{ skinWeights.resize(vertexCapacity);	}
+	if (HasAttribute(VertexAttribute::JointIndices))	{ skinIndices.resize(vertexCapacity);	}
+	if (HasAttribute(VertexAttribute::General_Vec4))	{ generalVec4s.resize(vertexCapacity);	}
+	if (HasAttribute(VertexAttribute::General_Integer))	{ generalIntegers.resize(vertexCapacity); }
+	indices.resize(indexCapacity);
+
+	ClearDirtyRanges();
+}
+
+GeometryPool::~GeometryPool() {
+}
+
+GeometryHandle GeometryPool::AddMesh(const Mesh& mesh) {
+	uint32_t vertexCount	= (uint32_t)mesh.GetVertexCount();
+	uint32_t meshIndices	= (uint32_t)mesh.GetIndexCount();
+	uint32_t indexCount		= meshIndices > 0 ? meshIndices : vertexCount;
+
+	GeometryAllocation a;
+	if (!vertexAllocator.Allocate(vertexCount, a.vertexOffset)) {
+		std::cout << __FUNCTION__ << " pool has no room for " << vertexCount << " vertices!\n";
+		return INVALID_GEOMETRY;
+	}
+	if (!indexAllocator.Allocate(indexCount, a.indexOffset)) {
+		std::cout << __FUNCTION__ << " pool has no room for " << indexCount << " indices!\n";
+		vertexAllocator.Free(a.vertexOffset, vertexCount);
+		return INVALID_GEOMETRY;
+	}
+	a.vertexCount	= vertexCount;
+	a.indexCount	= indexCount;
+
+	CopyAttribute(positions,		mesh.GetPositionData(),			a.vertexOffset, vertexCount);
+	CopyAttribute(texCoords,		mesh.GetTextureCoordData(),		a.vertexOffset, vertexCount);
+	CopyAttribute(colours,			mesh.GetColourData(),			a.vertexOffset, vertexCount);
+	CopyAttribute(normals,			mesh.GetNormalData(),			a.vertexOffset, vertexCount);
+	CopyAttribute(tangents,			mesh.GetTangentData(),			a.vertexOffset, vertexCount);
+	CopyAttribute(skinWeights,		mesh.GetSkinWeightData(),		a.vertexOffset, vertexCount);
+	CopyAttribute(skinIndices,		mesh.GetSkinIndexData(),		a.vertexOffset, vertexCount);
+	CopyAttribute(generalVec4s,		mesh.GetGeneralVec4Data(),		a.vertexOffset, vertexCount);
+	CopyAttribute(generalIntegers,	mesh.GetGeneralIntegerData(),	a.vertexOffset, vertexCount);
+
+	for (uint32_t i = 0; i < indexCount; ++i) {
+		indices[a.indexOffset + i] = meshIndices > 0 ? mesh.GetIndex(i) : i;
+	}
+
+	if (mesh.GetSubMeshCount() > 0) {
+		for (unsigned int i = 0; i < mesh.GetSubMeshCount(); ++i) {
+			SubMesh m = *mesh.GetSubMesh(i);
+			m.start += a.indexOffset;
+			m.base	+= a.vertexOffset;
+			a.subMeshes.push_back(m);
+		}
+	}
+	else {
+		SubMesh m;
+		m.start = a.indexOffset;
+		m.count = indexCount;
+		m.base	= a.vertexOffset;
+		a.subMeshes.push_back(m);
+	}
+
+	if (vertexCount > 0) {
+		dirtyVertexStart	= std::min(dirtyVertexStart, a.vertexOffset);
+		dirtyVertexEnd		= std::max(dirtyVertexEnd, a.vertexOffset + vertexCount);
+	}
+	if (indexCount > 0) {
+		dirtyIndexStart		= std::min(dirtyIndexStart, a.indexOffset);
+		dirtyIndexEnd		= std::max(dirtyIndexEnd, a.indexOffset + indexCount);
+	}
+
+	GeometryHandle handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		allocations[handle]		= std::move(a);
+		allocationUsed[handle]	= true;
+	}
+	else {
+		handle = (GeometryHandle)allocations.size();
+		allocations.push_back(std::move(a));
+		allocationUsed.push_back(true);
+	}
+	return handle;
+}
+
+void GeometryPool::RemoveMesh(GeometryHandle handle) {
+	if (handle >= allocations.size() || !allocationUsed[handle]) {
+		std::cout << __FUNCTION__ << " invalid geometry handle " << handle << "!\n";
+		return;
+	}
+	GeometryAllocation& a = allocations[handle];
+	vertexAllocator.Free(a.vertexOffset, a.vertexCount);
+	indexAllocator.Free(a.indexOffset, a.indexCount);
+
+	a = GeometryAllocation();
+	allocationUsed[handle] = false;
+	freeHandles.push_back(handle);
+}
+
+const GeometryAllocation* GeometryPool::GetAllocation(GeometryHandle handle) const {
+	if (handle >= allocations.size() || !allocationUsed[handle]) {
+		return nullptr;
+	}
+	return &allocations[handle];
+}
+
+bool GeometryPool::GetDrawCommands(GeometryHandle handle, std::vector<IndirectDrawCommand>& commands, uint32_t instanceCount, uint32_t baseInstance) const {
+	const GeometryAllocation* a = GetAllocation(handle);
+	if (!a) {
+		return false;
+	}
+	for (const SubMesh& m : a->subMeshes) {
+		IndirectDrawCommand c;
+		c.indexCount	= m.count;
+		c.instanceCount = instanceCount;
+		c.firstIndex	= m.start;
+		c.baseVertex	= m.base;
+		c.baseInstance	= baseInstance;
+		commands.push_back(c);
+	}
+	return true;
+}
+
+void GeometryPool::ClearDirtyRanges() {
+	dirtyVertexStart	= UINT32_MAX;
+	dirtyVertexEnd		= 0;
+	dirtyIndexStart		= UINT32_MAX;
+	dirtyIndexEnd		= 0;
+}
@@ -0,0 +1,147 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Mesh.h"
+
+namespace NCL::Rendering {
+	//First fit sub-allocator over a fixed range, merging neighbouring free blocks on release
+	class FreeListAllocator {
+	public:
+		FreeListAllocator(uint32_t capacity = 0);
+
+		bool Allocate(uint32_t size, uint32_t& offset);
+		void Free(uint32_t offset, uint32_t size);
+
+		uint32_t GetCapacity() const {
+			return capacity;
+		}
+
+		uint32_t GetFreeSpace() const {
+			return freeSpace;
+		}
+
+		uint32_t GetLargestFreeBlock() const;
+
+	protected:
+		std::map<uint32_t, uint32_t> freeBlocks; //Offset to size
+		uint32_t capacity;
+		uint32_t freeSpace;
+	};
+
+	//Matches the layout of both OpenGL's DrawElementsIndirectCommand and Vulkan's VkDrawIndexedIndirectCommand
+	struct IndirectDrawCommand {
+		uint32_t indexCount;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t  baseVertex;
+		uint32_t baseInstance;
+	};
+
+	using GeometryHandle = uint32_t;
+	const GeometryHandle INVALID_GEOMETRY = UINT32_MAX;
+
+	struct GeometryAllocation {
+		uint32_t vertexOffset	= 0;
+		uint32_t vertexCount	= 0;
+		uint32_t indexOffset	= 0;
+		uint32_t indexCount		= 0;
+		std::vector<SubMesh> subMeshes; //With start and base rewritten to offsets within the pool
+	};
+
+	/*
+	Packs the geometry of many meshes into one set of shared vertex and index
+	streams, so that a renderer can upload them as a few large buffers and draw
+	every mesh with a single multi-draw call. Only the attributes in the pool's
+	attribute mask are kept - meshes missing one of them are zero filled.
+
+	Indices are stored as 32 bit values relative to their sub-mesh's base vertex,
+	exactly as in Mesh, and meshes without indices are given a sequential set.
+	The pool only manages CPU side data; renderers should upload the dirty range
+	after adding meshes, and then call ClearDirtyRanges.
+	*/
+	class GeometryPool {
+	public:
+		//attributeMask has a bit set for each VertexAttribute::Type to store
+		GeometryPool(uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t attributeMask = 1 << VertexAttribute::Positions);
+		~GeometryPool();
+
+		GeometryHandle	AddMesh(const Mesh& mesh);
+		void			RemoveMesh(GeometryHandle handle);
+
+		const GeometryAllocation* GetAllocation(GeometryHandle handle) const;
+
+		//Appends one draw command per sub-mesh of the given mesh
+		bool GetDrawCommands(GeometryHandle handle, std::vector<IndirectDrawCommand>& commands, uint32_t instanceCount = 1, uint32_t baseInstance = 0) const;
+
+		bool HasAttribute(VertexAttribute::Type attribute) const {
+			return (attributeMask & (1 << attribute)) != 0;
+		}
+
+		const std::vector<Vector3>&		GetPositionData()		const { return positions;		}
+		const std::vector<Vector2>&		GetTextureCoordData()	const { return texCoords;		}
+		const std::vector<Vector4>&		GetColourData()			const { return colours;			}
+		const std::vector<Vector3>&		GetNormalData()			const { return normals;			}
+		const std::vector<Vector4>&		GetTangentData()		const { return tangents;		}
+		const std::vector<Vector4>&		GetSkinWeightData()		const { return skinWeights;		}
+		const std::vector<Vector4i>&	GetSkinIndexData()		const { return skinIndices;		}
+		const std::vector<Vector4>&		GetGeneralVec4Data()	const { return generalVec4s;	}
+		const std::vector<int>&			GetGeneralIntegerData()	const { return generalIntegers; }
+		const std::vector<unsigned int>& GetIndexData()			const { return indices;			}
+
+		//Ranges are [start, end), and are empty when start >= end
+		void GetDirtyVertexRange(uint32_t& start, uint32_t& end) const {
+			start	= dirtyVertexStart;
+			end		= dirtyVertexEnd;
+		}
+
+		void GetDirtyIndexRange(uint32_t& start, uint32_t& end) const {
+			start	= dirtyIndexStart;
+			end		= dirtyIndexEnd;
+		}
+
+		void ClearDirtyRanges();
+
+		size_t GetMeshCount() const {
+			return allocations.size() - freeHandles.size();
+		}
+
+		const FreeListAllocator& GetVertexAllocator() const {
+			return vertexAllocator;
+		}
+
+		const FreeListAllocator& GetIndexAllocator() const {
+			return indexAllocator;
+		}
+
+	protected:
+		FreeListAllocator	vertexAllocator;
+		FreeListAllocator	indexAllocator;
+		uint32_t			attributeMask;
+
+		std::vector<Vector3>		positions;
+		std::vector<Vector2>		texCoords;
+		std::vector<Vector4>		colours;
+		std::vector<Vector3>		normals;
+		std::vector<Vector4>		tangents;
+		std::vector<Vector4>		skinWeights;
+		std::vector<Vector4i>		skinIndices;
+		std::vector<Vector4>		generalVec4s;
+		std::vector<int>			generalIntegers;
+		std::vector<unsigned int>	indices;
+
+		std::vector<GeometryAllocation> allocations;
+		std::vector<bool>				allocationUsed;
+		std::vector<GeometryHandle>		freeHandles;
+
+		uint32_t dirtyVertexStart;
+		uint32_t dirtyVertexEnd;
+		uint32_t dirtyIndexStart;
+		uint32_t dirtyIndexEnd;
+	};
+}
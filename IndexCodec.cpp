@@ -0,0 +1,301 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "IndexCodec.h"
+
+using namespace NCL;
+using namespace Rendering;
+
+namespace {
+	const uint8_t CODEC_VERSION = 1;
+
+	const int EDGE_FIFO_SIZE	= 16;
+	const int VERTEX_FIFO_SIZE	= 16;
+
+	const uint8_t NO_EDGE_CODE		= 0xF0;	//High nibble 15 - triangle shares no recent edge
+	const uint8_t NEXT_CODE			= 0;	//Third vertex is the next unseen vertex
+	const uint8_t EXPLICIT_CODE		= 15;	//Third vertex follows as a varint delta
+	const uint8_t EXPLICIT_VERTEX	= 17;	//As above, for triangles with no shared edge
+
+	struct CodecState {
+		uint32_t edges[EDGE_FIFO_SIZE][2];
+		uint32_t vertices[VERTEX_FIFO_SIZE];
+		int		 edgeHead	= 0;
+		int		 vertexHead = 0;
+		uint32_t next		= 0;
+		uint32_t last		= 0;
+
+		CodecState() {
+			for (int i = 0; i < EDGE_FIFO_SIZE; ++i) {
+				edges[i][0] = UINT32_MAX;
+				edges[i][1] = UINT32_MAX;
+			}
+			for (int i = 0; i < VERTEX_FIFO_SIZE; ++i) {
+				vertices[i] = UINT32_MAX;
+			}
+		}
+
+		int FindEdge(uint32_t a, uint32_t b) const {
+			//The last slot is reserved, as a high nibble of 15 marks a triangle with no shared edge
+			for (int i = 0; i < EDGE_FIFO_SIZE - 1; ++i) {
+				int slot = (edgeHead - 1 - i) & (EDGE_FIFO_SIZE - 1);
+				if (edges[slot][0] == a && edges[slot][1] == b) {
+					return i;
+				}
+			}
+			return -1;
+		}
+
+		void GetEdge(int i, uint32_t& a, uint32_t& b) const {
+			int slot = (edgeHead - 1 - i) & (EDGE_FIFO_SIZE - 1);
+			a = edges[slot][0];
+			b = edges[slot][1];
+		}
+
+		void PushEdge(uint32_t a, uint32_t b) {
+			edges[edgeHead][0] = a;
+			edges[edgeHead][1] = b;
+			edgeHead = (edgeHead + 1) & (EDGE_FIFO_SIZE - 1);
+		}
+
+		int FindVertex(uint32_t v, int limit) const {
+			for (int i = 0; i < limit; ++i) {
+				if (vertices[(vertexHead - 1 - i) & (VERTEX_FIFO_SIZE - 1)] == v) {
+					return i;
+				}
+			}
+			return -1;
+		}
+
+		uint32_t GetVertex(int i) const {
+			return vertices[(vertexHead - 1 - i) & (VERTEX_FIFO_SIZE - 1)];
+		}
+
+		void PushVertex(uint32_t v) {
+			vertices[vertexHead] = v;
+			vertexHead = (vertexHead + 1) & (VERTEX_FIFO_SIZE - 1);
+		}
+	};
+
+	void WriteVarint(std::vector<uint8_t>& out, uint64_t v) {
+		while (v >= 0x80) {
+			out.push_back((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((uint8_t)v);
+	}
+
+	bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint64_t& v) {
+		v = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (data >= end) {
+				return false;
+			}
+			uint8_t b = *data++;
+			v |= (uint64_t)(b & 0x7F) << shift;
+			if (!(b & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WriteDelta(std::vector<uint8_t>& out, uint32_t v, uint32_t last) {
+		int64_t delta = (int64_t)v - (int64_t)last;
+		WriteVarint(out, (uint64_t)((delta << 1) ^ (delta >> 63)));
+	}
+
+	bool ReadDelta(const uint8_t*& data, const uint8_t* end, uint32_t last, uint32_t& v) {
+		uint64_t zigzag = 0;
+		if (!ReadVarint(data, end, zigzag)) {
+			return false;
+		}
+		int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+		v = (uint32_t)((int64_t)last + delta);
+		return true;
+	}
+
+	template<typename T>
+	void EncodeIndices(const T* indices, size_t indexCount, std::vector<uint8_t>& output) {
+		CodecState state;
+		output.clear();
+		output.reserve(indexCount / 3 + 16);
+		output.push_back(CODEC_VERSION);
+
+		size_t triCount = indexCount / 3;
+		for (size_t t = 0; t < triCount; ++t) {
+			uint32_t tri[3] = { (uint32_t)indices[t * 3], (uint32_t)indices[t * 3 + 1], (uint32_t)indices[t * 3 + 2] };
+
+			int edge		= -1;
+			int rotation	= 0;
+			for (int r = 0; r < 3 && edge < 0; ++r) {
+				edge = state.FindEdge(tri[r], tri[(r + 1) % 3]);
+				rotation = r;
+			}
+
+			if (edge >= 0) {
+				uint32_t a = tri[rotation];
+				uint32_t b = tri[(rotation + 1) % 3];
+				uint32_t c = tri[(rotation + 2) % 3];
+
+				int fifo = state.FindVertex(c, EXPLICIT_CODE - 1);
+				if (c == state.next) {
+					output.push_back((uint8_t)(edge << 4) | NEXT_CODE);
+					state.next++;
+					state.PushVertex(c);
+				}
+				else if (fifo >= 0) {
+					output.push_back((uint8_t)((edge << 4) | (fifo + 1)));
+				}
+				else {
+					output.push_back((uint8_t)(edge << 4) | EXPLICIT_CODE);
+					WriteDelta(output, c, state.last);
+					state.PushVertex(c);
+				}
+				state.last = c;
+				state.PushEdge(c, b);
+				state.PushEdge(a, c);
+			}
+			else {
+				output.push_back(NO_EDGE_CODE);
+				for (int i = 0; i < 3; ++i) {
+					uint32_t v = tri[i];
+					int fifo = state.FindVertex(v, VERTEX_FIFO_SIZE);
+					if (v == state.next) {
+						output.push_back(NEXT_CODE);
+						state.next++;
+						state.PushVertex(v);
+					}
+					else if (fifo >= 0) {
+						output.push_back((uint8_t)(fifo + 1));
+					}
+					else {
+						output.push_back(EXPLICIT_VERTEX);
+						WriteDelta(output, v, state.last);
+						state.PushVertex(v);
+					}
+					state.last = v;
+				}
+				state.PushEdge(tri[1], tri[0]);
+				state.PushEdge(tri[2], tri[1]);
+				state.PushEdge(tri[0], tri[2]);
+			}
+		}
+		//Any trailing indices that don't form a triangle are stored as-is
+		for (size_t i = triCount * 3; i < indexCount; ++i) {
+			WriteVarint(output, indices[i]);
+		}
+	}
+
+	template<typename T>
+	bool DecodeIndices(const uint8_t* data, size_t dataSize, T* indices, size_t indexCount) {
+		const uint8_t* end = data + dataSize;
+		if (dataSize == 0 || *data++ != CODEC_VERSION) {
+			return false;
+		}
+		CodecState state;
+
+		size_t triCount = indexCount / 3;
+		for (size_t t = 0; t < triCount; ++t) {
+			if (data >= end) {
+				return false;
+			}
+			uint8_t code = *data++;
+			uint32_t tri[3];
+
+			if ((code & 0xF0) != NO_EDGE_CODE) {
+				uint32_t a, b, c;
+				state.GetEdge(code >> 4, a, b);
+
+				int vertexCode = code & 0x0F;
+				if (vertexCode == NEXT_CODE) {
+					c = state.next++;
+					state.PushVertex(c);
+				}
+				else if (vertexCode == EXPLICIT_CODE) {
+					if (!ReadDelta(data, end, state.last, c)) {
+						return false;
+					}
+					state.PushVertex(c);
+				}
+				else {
+					c = state.GetVertex(vertexCode - 1);
+				}
+				state.last = c;
+				state.PushEdge(c, b);
+				state.PushEdge(a, c);
+
+				tri[0] = a;
+				tri[1] = b;
+				tri[2] = c;
+			}
+			else {
+				for (int i = 0; i < 3; ++i) {
+					if (data >= end) {
+						return false;
+					}
+					uint8_t vertexCode = *data++;
+					uint32_t v;
+					if (vertexCode == NEXT_CODE) {
+						v = state.next++;
+						state.PushVertex(v);
+					}
+					else if (vertexCode == EXPLICIT_VERTEX) {
+						if (!ReadDelta(data, end, state.last, v)) {
+							return false;
+						}
+						state.PushVertex(v);
+					}
+					else if (vertexCode <= VERTEX_FIFO_SIZE) {
+						v = state.GetVertex(vertexCode - 1);
+					}
+					else {
+						return false;
+					}
+					state.last = v;
+					tri[i] = v;
+				}
+				state.PushEdge(tri[1], tri[0]);
+				state.PushEdge(tri[2], tri[1]);
+				state.PushEdge(tri[0], tri[2]);
+			}
+			indices[t * 3]		= (T)tri[0];
+			indices[t * 3 + 1]	= (T)tri[1];
+			indices[t * 3 + 2]	= (T)tri[2];
+		}
+		for (size_t i = triCount * 3; i < indexCount; ++i) {
+			uint64_t v = 0;
+			if (!ReadVarint(data, end, v)) {
+				return false;
+			}
+			indices[i] = (T)v;
+		}
+		return true;
+	}
+}
+
+void IndexCodec::Encode(const unsigned int* indices, size_t indexCount, std::vector<uint8_t>& output) {
+	EncodeIndices(indices, indexCount, output);
+}
+
+void IndexCodec::Encode(const uint16_t* indices, size_t indexCount, std::vector<uint8_t>& output) {
+	EncodeIndices(indices, indexCount, output);
+}
+
+bool IndexCodec::Decode(const uint8_t* data, size_t dataSize, unsigned int* indices, size_t indexCount) {
+	return DecodeIndices(data, dataSize, indices, indexCount);
+}
+
+bool IndexCodec::Decode(const uint8_t* data, size_t dataSize, uint16_t* indices, size_t indexCount) {
+	return DecodeIndices(data, dataSize, indices, indexCount);
+}
+
+size_t IndexCodec::MaxIndexCount(size_t dataSize) {
+	//After the version byte
+	return dataSize > 0 ? (dataSize - 1) * 3 : 0;
+}
@@ -0,0 +1,46 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include <cstdint>
+
+namespace NCL::Rendering {
+	/*
+	Lossless compression for triangle list index buffers, intended for storing
+	indices on disk or at rest in memory, rather than for GPU use.
+
+	Each triangle is matched against a small FIFO of recently seen edges, and its
+	remaining vertex is coded as either the next unseen vertex, an entry in a FIFO
+	of recent vertices, or an explicit delta. For a vertex cache optimised mesh
+	most triangles need a single byte. Triangles may come back rotated (so a,b,c
+	might decode as b,c,a) but their winding is always preserved.
+	*/
+	class IndexCodec {
+	public:
+		static void Encode(const unsigned int* indices, size_t indexCount, std::vector<uint8_t>& output);
+		static void Encode(const uint16_t* indices, size_t indexCount, std::vector<uint8_t>& output);
+
+		static bool Decode(const uint8_t* data, size_t dataSize, unsigned int* indices, size_t indexCount);
+		static bool Decode(const uint8_t* data, size_t dataSize, uint16_t* indices, size_t indexCount);
+
+		//The most indices that dataSize bytes could decode to, as every triangle takes at least a byte
+		static size_t MaxIndexCount(size_t dataSize);
+
+		static void Encode(const std::vector<unsigned int>& indices, std::vector<uint8_t>& output) {
+			Encode(indices.data(), indices.size(), output);
+		}
+
+		static void Encode(const std::vector<uint16_t>& indices, std::vector<uint8_t>& output) {
+			Encode(indices.data(), indices.size(), output);
+		}
+
+	protected:
+		IndexCodec() {}
+		~IndexCodec() {}
+	};
+}
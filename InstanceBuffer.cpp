@@ -0,0 +1,142 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "InstanceBuffer.h"
+#include "GeometryPool.h"
+#include "ThreadPool.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	Matrix3x4 ToMatrix3x4(const Matrix4& m) {
+		Matrix3x4 out;
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 3; ++r) {
+				out.array[c][r] = m.array[c][r];
+			}
+		}
+		return out;
+	}
+
+	uint32_t ElementCount(uint32_t instanceCount, uint32_t stepRate) {
+		return (instanceCount + stepRate - 1) / stepRate;
+	}
+}
+
+InstanceBufferBuilder::InstanceBufferBuilder(uint32_t attributeMask) : attributeMask(attributeMask) {
+	for (uint32_t& rate : stepRates) {
+		rate = 1;
+	}
+}
+
+InstanceBufferBuilder::~InstanceBufferBuilder() {
+}
+
+void InstanceBufferBuilder::SetStepRate(InstanceAttribute::Type attribute, uint32_t stepRate) {
+	if (attribute >= InstanceAttribute::MAX_ATTRIBUTES || stepRate == 0) {
+		std::cout << __FUNCTION__ << " invalid attribute or step rate!\n";
+		return;
+	}
+	stepRates[attribute] = stepRate;
+}
+
+void InstanceBufferBuilder::Begin() {
+	addedBatches.clear();
+	addedTransforms.clear();
+	addedColours.clear();
+	addedCustoms.clear();
+	keyToBatch.clear();
+	batches.clear();
+}
+
+void InstanceBufferBuilder::AddInstance(uint32_t key, const Matrix4& transform, const Vector4& colour, const Vector4& custom) {
+	auto i = keyToBatch.emplace(key, (uint32_t)batches.size());
+	if (i.second) {
+		InstanceBatch b = {};
+		b.key = key;
+		batches.push_back(b);
+	}
+	uint32_t batch = i.first->second;
+	batches[batch].instanceCount++;
+
+	addedBatches.push_back(batch);
+	addedTransforms.push_back(transform);
+	if (HasAttribute(InstanceAttribute::Colour)) {
+		addedColours.push_back(colour);
+	}
+	if (HasAttribute(InstanceAttribute::General_Vec4)) {
+		addedCustoms.push_back(custom);
+	}
+}
+
+void InstanceBufferBuilder::Build() {
+	uint32_t elementTotals[InstanceAttribute::MAX_ATTRIBUTES] = {};
+	uint32_t instanceTotal = 0;
+	for (InstanceBatch& b : batches) {
+		b.firstInstance = instanceTotal;
+		instanceTotal += b.instanceCount;
+		for (uint32_t a = 0; a < InstanceAttribute::MAX_ATTRIBUTES; ++a) {
+			b.firstElement[a] = elementTotals[a];
+			elementTotals[a] += ElementCount(b.instanceCount, stepRates[a]);
+		}
+	}
+
+	//A stable counting sort, so instances keep the order they were added within a batch
+	std::vector<uint32_t> destination(addedBatches.size());
+	std::vector<uint32_t> fill(batches.size());
+	for (size_t i = 0; i < batches.size(); ++i) {
+		fill[i] = batches[i].firstInstance;
+	}
+	for (size_t i = 0; i < addedBatches.size(); ++i) {
+		destination[i] = fill[addedBatches[i]]++;
+	}
+
+	transforms.resize(HasAttribute(InstanceAttribute::Transform) ? elementTotals[InstanceAttribute::Transform] : 0);
+	colours.resize(HasAttribute(InstanceAttribute::Colour) ? elementTotals[InstanceAttribute::Colour] : 0);
+	customs.resize(HasAttribute(InstanceAttribute::General_Vec4) ? elementTotals[InstanceAttribute::General_Vec4] : 0);
+
+	ThreadPool::GetGlobalPool().ParallelFor(addedBatches.size(), 4096, [&](size_t start, size_t end) {
+		for (size_t i = start; i < end; ++i) {
+			const InstanceBatch& b	= batches[addedBatches[i]];
+			uint32_t local			= destination[i] - b.firstInstance;
+
+			auto Write = [&](InstanceAttribute::Type a, auto& stream, const auto& value) {
+				if (!stream.empty() && local % stepRates[a] == 0) {
+					stream[b.firstElement[a] + local / stepRates[a]] = value;
+				}
+			};
+			Write(InstanceAttribute::Transform, transforms, ToMatrix3x4(addedTransforms[i]));
+			if (!addedColours.empty()) {
+				Write(InstanceAttribute::Colour, colours, addedColours[i]);
+			}
+			if (!addedCustoms.empty()) {
+				Write(InstanceAttribute::General_Vec4, customs, addedCustoms[i]);
+			}
+		}
+	});
+}
+
+void InstanceBufferBuilder::GetStreams(std::vector<InstanceStream>& streams) const {
+	if (HasAttribute(InstanceAttribute::Transform)) {
+		streams.push_back({ InstanceAttribute::Transform, stepRates[InstanceAttribute::Transform], (uint32_t)sizeof(Matrix3x4), (uint32_t)transforms.size() });
+	}
+	if (HasAttribute(InstanceAttribute::Colour)) {
+		streams.push_back({ InstanceAttribute::Colour, stepRates[InstanceAttribute::Colour], (uint32_t)sizeof(Vector4), (uint32_t)colours.size() });
+	}
+	if (HasAttribute(InstanceAttribute::General_Vec4)) {
+		streams.push_back({ InstanceAttribute::General_Vec4, stepRates[InstanceAttribute::General_Vec4], (uint32_t)sizeof(Vector4), (uint32_t)customs.size() });
+	}
+}
+
+void InstanceBufferBuilder::GetDrawCommands(const GeometryPool& pool, std::vector<IndirectDrawCommand>& commands) const {
+	for (const InstanceBatch& b : batches) {
+		pool.GetDrawCommands(b.key, commands, b.instanceCount, b.firstInstance);
+	}
+}
@@ -0,0 +1,107 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Vector.h"
+#include "Matrix.h"
+
+#include <unordered_map>
+
+namespace NCL::Rendering {
+	using namespace NCL::Maths;
+	class GeometryPool;
+	struct IndirectDrawCommand;
+
+	namespace InstanceAttribute {
+		enum Type : uint32_t {
+			Transform,		//Matrix3x4 - the top 3 rows of a model matrix
+			Colour,
+			General_Vec4,
+			MAX_ATTRIBUTES
+		};
+
+		const std::string Names[InstanceAttribute::MAX_ATTRIBUTES] = {
+			std::string("Transform"),
+			std::string("Colour"),
+			std::string("General Vec4"),
+		};
+	};
+
+	//Describes how a renderer should bind one packed instance stream
+	struct InstanceStream {
+		InstanceAttribute::Type attribute;
+		uint32_t				stepRate;		//Instances drawn per element, as with a vertex attribute divisor
+		uint32_t				elementSize;	//In bytes
+		uint32_t				elementCount;
+	};
+
+	//All of the instances sharing a key, such as a mesh's GeometryHandle
+	struct InstanceBatch {
+		uint32_t key;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+		uint32_t firstElement[InstanceAttribute::MAX_ATTRIBUTES]; //Where this batch starts in each stream
+	};
+
+	/*
+	Collects the visible instances from a culling pass, and packs them so that all
+	instances with the same key are contiguous in every stream. Each batch can then
+	be drawn with a single instanced draw, using firstInstance as its base instance.
+
+	Streams with a step rate of N store one element per N instances of a batch,
+	taken from the first instance of each group. When using a step rate above 1,
+	bind the stream at the batch's firstElement rather than relying on base instance.
+	*/
+	class InstanceBufferBuilder {
+	public:
+		//attributeMask has a bit set for each InstanceAttribute::Type to store
+		InstanceBufferBuilder(uint32_t attributeMask = 1 << InstanceAttribute::Transform);
+		~InstanceBufferBuilder();
+
+		void SetStepRate(InstanceAttribute::Type attribute, uint32_t stepRate);
+
+		//Clears all instances, ready for the next frame
+		void Begin();
+
+		void AddInstance(uint32_t key, const Matrix4& transform, const Vector4& colour = Vector4(1, 1, 1, 1), const Vector4& custom = Vector4());
+
+		//Packs the instances added since Begin, in the order their keys were first seen
+		void Build();
+
+		bool HasAttribute(InstanceAttribute::Type attribute) const {
+			return (attributeMask & (1 << attribute)) != 0;
+		}
+
+		const std::vector<InstanceBatch>&	GetBatches()		const { return batches;		}
+		const std::vector<Matrix3x4>&		GetTransformData()	const { return transforms;	}
+		const std::vector<Vector4>&			GetColourData()		const { return colours;		}
+		const std::vector<Vector4>&			GetGeneralVec4Data()const { return customs;		}
+
+		//Only streams in the attribute mask are returned
+		void GetStreams(std::vector<InstanceStream>& streams) const;
+
+		//Appends draw commands for every batch, treating each batch key as a GeometryHandle in pool
+		void GetDrawCommands(const GeometryPool& pool, std::vector<IndirectDrawCommand>& commands) const;
+
+	protected:
+		uint32_t attributeMask;
+		uint32_t stepRates[InstanceAttribute::MAX_ATTRIBUTES];
+
+		//Instances as they were added
+		std::vector<uint32_t>	addedBatches;
+		std::vector<Matrix4>	addedTransforms;
+		std::vector<Vector4>	addedColours;
+		std::vector<Vector4>	addedCustoms;
+		std::unordered_map<uint32_t, uint32_t> keyToBatch;
+
+		std::vector<InstanceBatch>	batches;
+		std::vector<Matrix3x4>		transforms;
+		std::vector<Vector4>		colours;
+		std::vector<Vector4>		customs;
+	};
+}
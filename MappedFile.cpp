@@ -0,0 +1,113 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace NCL;
+
+MappedFile::MappedFile() {
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	fileHandle		= INVALID_HANDLE_VALUE;
+	mappingHandle	= nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filepath) {
+	Close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		std::cout << __FUNCTION__ << " can't open " << filepath << "!\n";
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		std::cout << __FUNCTION__ << " " << filepath << " is empty!\n";
+		Close();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		std::cout << __FUNCTION__ << " can't map " << filepath << "!\n";
+		Close();
+		return false;
+	}
+	data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		std::cout << __FUNCTION__ << " can't map " << filepath << "!\n";
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cout << __FUNCTION__ << " can't open " << filepath << "!\n";
+		return false;
+	}
+	struct stat fileInfo;
+	if (fstat(fd, &fileInfo) != 0 || fileInfo.st_size == 0) {
+		std::cout << __FUNCTION__ << " " << filepath << " is empty!\n";
+		close(fd);
+		return false;
+	}
+	//Shared, so every process mapping the same file reads the same physical pages
+	void* mapping = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); //The mapping keeps its own reference to the file
+	if (mapping == MAP_FAILED) {
+		std::cout << __FUNCTION__ << " can't map " << filepath << "!\n";
+		return false;
+	}
+	data = (const char*)mapping;
+	size = (size_t)fileInfo.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+	}
+	fileHandle		= INVALID_HANDLE_VALUE;
+	mappingHandle	= nullptr;
+#else
+	if (data) {
+		munmap((void*)data, size);
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,45 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+
+namespace NCL {
+	//A read only view of a whole file, memory mapped by the OS
+	class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		//Takes a full file path - no asset directory is prepended
+		bool Open(const std::string& filepath);
+		void Close();
+
+		bool IsOpen() const {
+			return data != nullptr;
+		}
+
+		const char* GetData() const {
+			return data;
+		}
+
+		size_t GetSize() const {
+			return size;
+		}
+
+	protected:
+		const char* data;
+		size_t		size;
+#ifdef _WIN32
+		void*		fileHandle;
+		void*		mappingHandle;
+#endif
+	};
+}
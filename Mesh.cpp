@@ -4,17 +4,239 @@
 #include "Matrix.h"
 
 #include "Maths.h"
+#include "ThreadPool.h"
+#include "MeshRegistry.h"
+#include "SIMD.h"
+
+#include <atomic>
+#include <cfloat>
+#include <cstring>
+#include <unordered_map>
 
 using namespace NCL;
 using namespace Rendering;
 using namespace Maths;
 
+namespace {
+	struct PositionKey {
+		uint32_t x;
+		uint32_t y;
+		uint32_t z;
+
+		bool operator==(const PositionKey& k) const {
+			return x == k.x && y == k.y && z == k.z;
+		}
+	};
+
+	struct PositionKeyHash {
+		size_t operator()(const PositionKey& k) const {
+			return (size_t)k.x * 73856093u ^ (size_t)k.y * 19349663u ^ (size_t)k.z * 83492791u;
+		}
+	};
+
+	float CornerAngle(const Vector3& corner, const Vector3& a, const Vector3& b) {
+		Vector3 e1 = Vector::Normalise(a - corner);
+		Vector3 e2 = Vector::Normalise(b - corner);
+		return acos(std::clamp(Vector::Dot(e1, e2), -1.0f, 1.0f));
+	}
+
+	//Lists the triangle corners touching each vertex, as compressed sparse rows, so
+	//per-vertex sums can be gathered in parallel without any atomics
+	void BuildCornerLists(const std::vector<uint32_t>& cornerVerts, size_t vertexCount, std::vector<uint32_t>& offsets, std::vector<uint32_t>& corners) {
+		offsets.assign(vertexCount + 1, 0);
+		for (uint32_t v : cornerVerts) {
+			offsets[v + 1]++;
+		}
+		for (size_t i = 0; i < vertexCount; ++i) {
+			offsets[i + 1] += offsets[i];
+		}
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		corners.resize(cornerVerts.size());
+		for (size_t c = 0; c < cornerVerts.size(); ++c) {
+			corners[fill[cornerVerts[c]]++] = (uint32_t)c;
+		}
+	}
+
+	//MikkTSpace's test for a usable length or area
+	bool NotZero(float f) {
+		return std::abs(f) > FLT_MIN;
+	}
+
+	bool SamePosition(const Vector3& a, const Vector3& b) {
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	//A vertex's position, normal, and texture coordinate, compared exactly as MikkTSpace does
+	struct TangentSpaceKey {
+		uint32_t values[8];
+		uint64_t hash;
+
+		TangentSpaceKey() = default;
+
+		TangentSpaceKey(const Vector3& position, const Vector3& normal, const Vector2& texCoord) {
+			const float attributes[8] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, texCoord.x, texCoord.y };
+			hash = 0;
+			for (int i = 0; i < 8; ++i) {
+				float f = attributes[i] + 0.0f; //So -0 matches 0
+				memcpy(&values[i], &f, sizeof(float));
+				hash = (hash ^ values[i]) * 0x100000001B3ull;
+			}
+			hash ^= hash >> 32;
+		}
+
+		bool operator==(const TangentSpaceKey& k) const {
+			return memcmp(values, k.values, sizeof(values)) == 0;
+		}
+	};
+
+	struct TangentTriangle {
+		bool	orientPreserving	= false;	//Texture space isn't mirrored
+		bool	groupWithAny		= true;		//No usable texture space, so it takes on its neighbours' tangents
+		bool	degenerate			= false;	//Two corners share a position
+	};
+
+	Vector3 AnyPerpendicular(const Vector3& n) {
+		Vector3 axis = std::abs(n.x) < 0.9f ? Vector3(1, 0, 0) : Vector3(0, 1, 0);
+		return Vector::Normalise(Vector::Cross(n, axis));
+	}
+
+	void PositionMinMax(const Vector3* p, size_t count, Vector3& outMin, Vector3& outMax) {
+		outMin = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		outMax = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		size_t i = 0;
+#ifdef NCL_SIMD_SSE
+		static_assert(sizeof(Vector3) == sizeof(float) * 3, "Vector3 must be tightly packed");
+		//4 positions fill 3 registers exactly, so each lane always holds the same axis
+		size_t blocks = count / 4;
+		if (blocks > 0) {
+			const float* f = &p[0].x;
+			__m128 min0 = _mm_loadu_ps(f);
+			__m128 min1 = _mm_loadu_ps(f + 4);
+			__m128 min2 = _mm_loadu_ps(f + 8);
+			__m128 max0 = min0;
+			__m128 max1 = min1;
+			__m128 max2 = min2;
+
+			for (size_t b = 1; b < blocks; ++b) {
+				const float* block = f + b * 12;
+				__m128 v0 = _mm_loadu_ps(block);
+				__m128 v1 = _mm_loadu_ps(block + 4);
+				__m128 v2 = _mm_loadu_ps(block + 8);
+				min0 = _mm_min_ps(min0, v0);
+				min1 = _mm_min_ps(min1, v1);
+				min2 = _mm_min_ps(min2, v2);
+				max0 = _mm_max_ps(max0, v0);
+				max1 = _mm_max_ps(max1, v1);
+				max2 = _mm_max_ps(max2, v2);
+			}
+			float mins[12];
+			float maxs[12];
+			_mm_storeu_ps(mins, min0);
+			_mm_storeu_ps(mins + 4, min1);
+			_mm_storeu_ps(mins + 8, min2);
+			_mm_storeu_ps(maxs, max0);
+			_mm_storeu_ps(maxs + 4, max1);
+			_mm_storeu_ps(maxs + 8, max2);
+
+			for (int lane = 0; lane < 12; ++lane) {
+				outMin[lane % 3] = std::min(outMin[lane % 3], mins[lane]);
+				outMax[lane % 3] = std::max(outMax[lane % 3], maxs[lane]);
+			}
+			i = blocks * 4;
+		}
+#endif
+		for (; i < count; ++i) {
+			outMin = Vector::Min(outMin, p[i]);
+			outMax = Vector::Max(outMax, p[i]);
+		}
+	}
+
+	size_t CountNonFinite(const float* data, size_t count) {
+		size_t found	= 0;
+		size_t i		= 0;
+#ifdef NCL_SIMD_SSE
+		//NaNs fail every comparison, so testing |x| <= FLT_MAX catches both NaN and infinity
+		const __m128 absMask	= _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		const __m128 maxFloat	= _mm_set1_ps(FLT_MAX);
+		for (; i + 4 <= count; i += 4) {
+			__m128 v	= _mm_and_ps(_mm_loadu_ps(data + i), absMask);
+			int bad		= _mm_movemask_ps(_mm_cmpnle_ps(v, maxFloat));
+			if (bad) {
+				found += (bad & 1) + ((bad >> 1) & 1) + ((bad >> 2) & 1) + ((bad >> 3) & 1);
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			if (!std::isfinite(data[i])) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+	template<typename T>
+	size_t CountIndicesOutOfRange(const T* data, size_t count, uint32_t limit) {
+		size_t found	= 0;
+		size_t i		= 0;
+#ifdef NCL_SIMD_SSE
+		//SSE2 only has signed compares, so flip the top bits to compare unsigned values
+		const __m128i flip		= _mm_set1_epi32((int)0x80000000);
+		const __m128i maxIndex	= _mm_xor_si128(_mm_set1_epi32((int)(limit - 1)), flip);
+		if (limit > 0) {
+			for (; i + 8 <= count; i += 8) {
+				__m128i a;
+				__m128i b;
+				if constexpr (sizeof(T) == 2) {
+					__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+					a = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+					b = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+				}
+				else {
+					a = _mm_loadu_si128((const __m128i*)(data + i));
+					b = _mm_loadu_si128((const __m128i*)(data + i + 4));
+				}
+				__m128i badA = _mm_cmpgt_epi32(_mm_xor_si128(a, flip), maxIndex);
+				__m128i badB = _mm_cmpgt_epi32(_mm_xor_si128(b, flip), maxIndex);
+				int bad = _mm_movemask_ps(_mm_castsi128_ps(badA)) | (_mm_movemask_ps(_mm_castsi128_ps(badB)) << 4);
+				while (bad) {
+					found += bad & 1;
+					bad >>= 1;
+				}
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			if ((uint32_t)data[i] >= limit) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+	BoundingVolume BoundsFromBox(const Vector3& boxMin, const Vector3& boxMax) {
+		BoundingVolume v;
+		if (boxMin.x > boxMax.x) {
+			return v; //Nothing was covered
+		}
+		v.boxMin		= boxMin;
+		v.boxMax		= boxMax;
+		v.sphereCentre	= (boxMin + boxMax) * 0.5f;
+		return v;
+	}
+}
+
 Mesh::Mesh()	{
-	primType = GeometryPrimitive::Triangles;
-	assetID  = 0;
+	primType	= GeometryPrimitive::Triangles;
+	indexFormat = IndexFormat::UnsignedInt;
+	assetID		= 0;
+	boundsDirty		= true;
+	faceDataDirty	= true;
+
+	MeshRegistry::Register(this);
 }
 
 Mesh::~Mesh()	{
+	MeshRegistry::Unregister(this);
 }
 
 bool Mesh::HasTriangle(unsigned int i) const {
@@ -33,9 +255,10 @@ bool	Mesh::GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int&
 		return false;
 	}
 	if (GetIndexCount() > 0) {
-		a = indices[(i * 3)];
-		b = indices[(i * 3) + 1];
-		c = indices[(i * 3) + 2];
+		int base = GetBaseVertexForIndex(i * 3);
+		a = GetIndex((i * 3))	  + base;
+		b = GetIndex((i * 3) + 1) + base;
+		c = GetIndex((i * 3) + 2) + base;
 	}
 	else {
 		a = (i * 3);
@@ -59,6 +282,10 @@ bool Mesh::GetTriangle(unsigned int i, Vector3& va, Vector3& vb, Vector3& vc) co
 }
 
 bool Mesh::GetNormalForTri(unsigned int i, Vector3& n) const {
+	if (!faceDataDirty && i < facePlanes.size()) {
+		n = facePlanes[i].GetNormal();
+		return true;
+	}
 	Vector3 a, b, c;
 
 	bool hasTri = GetTriangle(i, a, b, c);
@@ -73,6 +300,900 @@ bool Mesh::GetNormalForTri(unsigned int i, Vector3& n) const {
 	return true;
 }
 
+size_t Mesh::GetPositionWeldMap(std::vector<uint32_t>& remap) const {
+	std::unordered_map<PositionKey, uint32_t, PositionKeyHash> firstAtPosition;
+	firstAtPosition.reserve(positions.size());
+	remap.resize(positions.size());
+
+	for (uint32_t v = 0; v < (uint32_t)positions.size(); ++v) {
+		PositionKey k;
+		memcpy(&k, &positions[v], sizeof(PositionKey));
+		remap[v] = firstAtPosition.emplace(k, v).first->second;
+	}
+	return firstAtPosition.size();
+}
+
+bool Mesh::GenerateNormals(NormalWeighting::Type weighting) {
+	if (primType != GeometryPrimitive::Triangles || positions.empty()) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " is not a triangle list with vertex positions!\n";
+		return false;
+	}
+	ThreadPool& pool		= ThreadPool::GetGlobalPool();
+	size_t triCount			= GetPrimitiveCount();
+	size_t vertexCount		= positions.size();
+
+	std::vector<uint32_t>	cornerVerts(triCount * 3);
+	std::vector<Vector3>	cornerNormals(triCount * 3);
+	std::atomic<bool>		badIndex = false;
+
+	pool.ParallelFor(triCount, 4096, [&](size_t start, size_t end) {
+		for (size_t t = start; t < end; ++t) {
+			unsigned int v[3];
+			GetVertexIndicesForTri((unsigned int)t, v[0], v[1], v[2]);
+			if (v[0] >= vertexCount || v[1] >= vertexCount || v[2] >= vertexCount) {
+				badIndex = true;
+				return;
+			}
+			const Vector3& a = positions[v[0]];
+			const Vector3& b = positions[v[1]];
+			const Vector3& c = positions[v[2]];
+
+			Vector3 n = Vector::Cross(b - a, c - a); //Length is twice the triangle area
+			for (int i = 0; i < 3; ++i) {
+				cornerVerts[t * 3 + i] = v[i];
+			}
+			if (weighting == NormalWeighting::Area) {
+				for (int i = 0; i < 3; ++i) {
+					cornerNormals[t * 3 + i] = n;
+				}
+			}
+			else {
+				n = Vector::Normalise(n);
+				cornerNormals[t * 3]	 = n * CornerAngle(a, b, c);
+				cornerNormals[t * 3 + 1] = n * CornerAngle(b, c, a);
+				cornerNormals[t * 3 + 2] = n * CornerAngle(c, a, b);
+			}
+		}
+	});
+	if (badIndex) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " has an out of range index!\n";
+		return false;
+	}
+
+	std::vector<uint32_t> welded;
+	GetPositionWeldMap(welded);
+	for (uint32_t& v : cornerVerts) {
+		v = welded[v];
+	}
+
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> corners;
+	BuildCornerLists(cornerVerts, vertexCount, offsets, corners);
+
+	std::vector<Vector3> weldedNormals(vertexCount);
+	pool.ParallelFor(vertexCount, 8192, [&](size_t start, size_t end) {
+		for (size_t v = start; v < end; ++v) {
+			Vector3 sum;
+			for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+				sum += cornerNormals[corners[i]];
+			}
+			weldedNormals[v] = Vector::Normalise(sum);
+		}
+	});
+
+	normals.resize(vertexCount);
+	pool.ParallelFor(vertexCount, 8192, [&](size_t start, size_t end) {
+		for (size_t v = start; v < end; ++v) {
+			normals[v] = weldedNormals[welded[v]];
+		}
+	});
+	return true;
+}
+
+bool Mesh::GenerateTangents() {
+	if (primType != GeometryPrimitive::Triangles || positions.empty()) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " is not a triangle list with vertex positions!\n";
+		return false;
+	}
+	size_t vertexCount = positions.size();
+	if (texCoords.size() != vertexCount) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " needs texture coordinates to generate tangents!\n";
+		return false;
+	}
+	if (normals.size() != vertexCount && !GenerateNormals()) {
+		return false;
+	}
+	ThreadPool& pool	= ThreadPool::GetGlobalPool();
+	size_t triCount		= GetPrimitiveCount();
+	size_t cornerCount	= triCount * 3;
+
+	std::vector<uint32_t>			cornerVerts(cornerCount);
+	std::vector<TangentTriangle>	triangles(triCount);
+	std::vector<Vector3>			cornerTangents(cornerCount);
+	std::atomic<bool>				badIndex = false;
+
+	//Each triangle's texture space direction, as MikkTSpace's InitTriInfo builds it. Each corner's share
+	//of its vertex's tangent is the direction projected onto the plane of the corner's normal, weighted
+	//by the corner's angle in that plane, as in MikkTSpace's EvalTspace.
+	pool.ParallelFor(triCount, 4096, [&](size_t start, size_t end) {
+		for (size_t t = start; t < end; ++t) {
+			unsigned int v[3];
+			if (!GetVertexIndicesForTri((unsigned int)t, v[0], v[1], v[2]) || v[0] >= vertexCount || v[1] >= vertexCount || v[2] >= vertexCount) {
+				badIndex = true;
+				return;
+			}
+			for (int i = 0; i < 3; ++i) {
+				cornerVerts[t * 3 + i] = v[i];
+			}
+			const Vector3& p0 = positions[v[0]];
+			const Vector3& p1 = positions[v[1]];
+			const Vector3& p2 = positions[v[2]];
+
+			TangentTriangle& tri = triangles[t];
+			tri.degenerate = SamePosition(p0, p1) || SamePosition(p0, p2) || SamePosition(p1, p2);
+
+			Vector3 d1	= p1 - p0;
+			Vector3 d2	= p2 - p0;
+			Vector2 t21 = texCoords[v[1]] - texCoords[v[0]];
+			Vector2 t31 = texCoords[v[2]] - texCoords[v[0]];
+
+			float area	= t21.x * t31.y - t21.y * t31.x; //Twice the signed area in texture space
+			Vector3 os	= d1 * t31.y - d2 * t21.y;
+			Vector3 ot	= d2 * t21.x - d1 * t31.x;
+			tri.orientPreserving = area > 0.0f;
+			if (NotZero(area)) {
+				float sign		= tri.orientPreserving ? 1.0f : -1.0f;
+				float lengthS	= Vector::Length(os);
+				float lengthT	= Vector::Length(ot);
+				os					= NotZero(lengthS) ? os * (sign / lengthS) : os;
+				tri.groupWithAny	= !NotZero(lengthS / std::abs(area)) || !NotZero(lengthT / std::abs(area));
+			}
+			for (int i = 0; tri.groupWithAny == false && i < 3; ++i) {
+				const Vector3& n	= normals[v[i]];
+				const Vector3& p	= positions[v[i]];
+				Vector3 toPrev		= positions[v[(i + 2) % 3]] - p;
+				Vector3 toNext		= positions[v[(i + 1) % 3]] - p;
+				toPrev = Vector::Normalise(toPrev - n * Vector::Dot(n, toPrev));
+				toNext = Vector::Normalise(toNext - n * Vector::Dot(n, toNext));
+				float angle = std::acos(std::clamp(Vector::Dot(toPrev, toNext), -1.0f, 1.0f));
+				cornerTangents[t * 3 + i] = Vector::Normalise(os - n * Vector::Dot(n, os)) * angle;
+			}
+		}
+	});
+	if (badIndex) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " has an out of range index!\n";
+		return false;
+	}
+
+	//MikkTSpace treats vertices with the same position, normal, and texture coordinate as one. Keys are
+	//built in parallel, then matched in an open addressed table, which needs no allocation per vertex.
+	std::vector<uint32_t> welded(vertexCount);
+	{
+		std::vector<TangentSpaceKey> keys(vertexCount);
+		pool.ParallelFor(vertexCount, 8192, [&](size_t start, size_t end) {
+			for (size_t v = start; v < end; ++v) {
+				keys[v] = TangentSpaceKey(positions[v], normals[v], texCoords[v]);
+			}
+		});
+		size_t tableSize = 1;
+		while (tableSize < vertexCount * 2) {
+			tableSize <<= 1;
+		}
+		std::vector<uint32_t> table(tableSize, UINT32_MAX);
+		for (uint32_t v = 0; v < (uint32_t)vertexCount; ++v) {
+			size_t slot = keys[v].hash & (tableSize - 1);
+			while (table[slot] != UINT32_MAX && !(keys[table[slot]] == keys[v])) {
+				slot = (slot + 1) & (tableSize - 1);
+			}
+			if (table[slot] == UINT32_MAX) {
+				table[slot] = v;
+			}
+			welded[v] = table[slot];
+		}
+	}
+	std::vector<uint32_t> cornerWelded(cornerCount);
+	for (size_t c = 0; c < cornerCount; ++c) {
+		cornerWelded[c] = welded[cornerVerts[c]];
+	}
+	std::vector<uint32_t> fanOffsets;
+	std::vector<uint32_t> fanCorners;
+	BuildCornerLists(cornerWelded, vertexCount, fanOffsets, fanCorners);
+
+	//Pairs up triangles across their edges as MikkTSpace does - in triangle order, each edge takes the
+	//first later unpaired edge running the other way. Edges are paired by the task for their lower vertex.
+	const uint32_t NO_TRIANGLE = UINT32_MAX;
+	std::vector<uint32_t> neighbours(cornerCount, NO_TRIANGLE); //Across the edge from each corner to the next
+	pool.ParallelFor(vertexCount, 4096, [&](size_t start, size_t end) {
+		struct FanEdge {
+			uint32_t other;
+			uint32_t edge;
+			bool	 outgoing;
+		};
+		std::vector<FanEdge> edges;
+		for (size_t v = start; v < end; ++v) {
+			edges.clear();
+			for (uint32_t i = fanOffsets[v]; i < fanOffsets[v + 1]; ++i) {
+				uint32_t c = fanCorners[i];
+				uint32_t t = c / 3;
+				if (triangles[t].degenerate) {
+					continue;
+				}
+				uint32_t next = t * 3 + (c + 1) % 3;
+				uint32_t prev = t * 3 + (c + 2) % 3;
+				if (cornerWelded[next] > v) {
+					edges.push_back({ cornerWelded[next], c, true });
+				}
+				if (cornerWelded[prev] > v) {
+					edges.push_back({ cornerWelded[prev], prev, false });
+				}
+			}
+			std::sort(edges.begin(), edges.end(), [](const FanEdge& a, const FanEdge& b) {
+				return a.other != b.other ? a.other < b.other : a.edge < b.edge;
+			});
+			for (size_t i = 0; i < edges.size(); ++i) {
+				if (neighbours[edges[i].edge] != NO_TRIANGLE) {
+					continue;
+				}
+				for (size_t j = i + 1; j < edges.size() && edges[j].other == edges[i].other; ++j) {
+					if (edges[j].outgoing != edges[i].outgoing && neighbours[edges[j].edge] == NO_TRIANGLE) {
+						neighbours[edges[i].edge] = edges[j].edge / 3;
+						neighbours[edges[j].edge] = edges[i].edge / 3;
+						break;
+					}
+				}
+			}
+		}
+	});
+
+	//Each vertex's corners are flood filled into groups of connected triangles with the same texture
+	//space orientation, as MikkTSpace's Build4RuleGroups does. Triangles with no texture space take the
+	//orientation of the first group to reach them, so this runs serially, in MikkTSpace's order.
+	const uint32_t NO_GROUP = UINT32_MAX;
+	std::vector<uint32_t>	cornerGroups(cornerCount, NO_GROUP);
+	std::vector<bool>		groupOrientations;
+	std::vector<uint32_t>	stack;
+	for (uint32_t c = 0; c < (uint32_t)cornerCount; ++c) {
+		const TangentTriangle& seed = triangles[c / 3];
+		if (seed.degenerate || seed.groupWithAny || cornerGroups[c] != NO_GROUP) {
+			continue;
+		}
+		uint32_t group	= (uint32_t)groupOrientations.size();
+		bool	 orient	= seed.orientPreserving;
+		uint32_t vertex = cornerWelded[c];
+		groupOrientations.push_back(orient);
+		cornerGroups[c] = group;
+
+		stack.assign({ neighbours[c], neighbours[c / 3 * 3 + (c + 2) % 3] });
+		while (!stack.empty()) {
+			uint32_t t = stack.back();
+			stack.pop_back();
+			if (t == NO_TRIANGLE) {
+				continue;
+			}
+			uint32_t corner = t * 3;
+			while (cornerWelded[corner] != vertex) {
+				++corner;
+			}
+			if (cornerGroups[corner] != NO_GROUP) {
+				continue;
+			}
+			TangentTriangle& tri = triangles[t];
+			if (tri.groupWithAny && cornerGroups[t * 3] == NO_GROUP && cornerGroups[t * 3 + 1] == NO_GROUP && cornerGroups[t * 3 + 2] == NO_GROUP) {
+				tri.orientPreserving = orient;
+			}
+			if (tri.orientPreserving != orient) {
+				continue;
+			}
+			cornerGroups[corner] = group;
+			stack.push_back(neighbours[corner]);
+			stack.push_back(neighbours[t * 3 + (corner + 2) % 3]);
+		}
+	}
+
+	//Each group's tangent is the sum of its corners' shares. With MikkTSpace's default angular
+	//threshold of 180 degrees, a group is never split any further.
+	size_t groupCount = groupOrientations.size();
+	std::vector<uint32_t> groupOffsets;
+	std::vector<uint32_t> groupCorners;
+	{
+		std::vector<uint32_t> groupOfCorner(cornerGroups);
+		for (uint32_t& g : groupOfCorner) {
+			g = std::min<uint32_t>(g, (uint32_t)groupCount); //Ungrouped corners are listed last, and ignored
+		}
+		BuildCornerLists(groupOfCorner, groupCount + 1, groupOffsets, groupCorners);
+	}
+	std::vector<Vector3> groupTangents(groupCount);
+	pool.ParallelFor(groupCount, 4096, [&](size_t start, size_t end) {
+		for (size_t g = start; g < end; ++g) {
+			Vector3 sum;
+			for (uint32_t i = groupOffsets[g]; i < groupOffsets[g + 1]; ++i) {
+				sum += cornerTangents[groupCorners[i]];
+			}
+			groupTangents[g] = Vector::Normalise(sum);
+		}
+	});
+
+	//Degenerate triangles copy the tangent of their vertex's first usable corner, as in MikkTSpace's DegenEpilogue
+	std::vector<Vector4> cornerFrames(cornerCount);
+	auto GroupTangent = [&](uint32_t c) {
+		uint32_t g = cornerGroups[c];
+		if (g == NO_GROUP || Vector::LengthSquared(groupTangents[g]) == 0.0f) {
+			return Vector4(AnyPerpendicular(normals[cornerVerts[c]]), 1.0f); //No texture space to follow
+		}
+		return Vector4(groupTangents[g], groupOrientations[g] ? 1.0f : -1.0f);
+	};
+	pool.ParallelFor(cornerCount, 8192, [&](size_t start, size_t end) {
+		for (size_t c = start; c < end; ++c) {
+			uint32_t source = (uint32_t)c;
+			if (triangles[c / 3].degenerate) {
+				uint32_t v = cornerWelded[c];
+				for (uint32_t i = fanOffsets[v]; i < fanOffsets[v + 1]; ++i) {
+					if (!triangles[fanCorners[i] / 3].degenerate) {
+						source = fanCorners[i];
+						break;
+					}
+				}
+			}
+			cornerFrames[c] = GroupTangent(source);
+		}
+	});
+
+	//Vertices whose corners ended up with different tangents are split, with the first tangent
+	//staying on the original vertex, and the others each going to a new vertex on the end
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> corners;
+	BuildCornerLists(cornerVerts, vertexCount, offsets, corners);
+
+	std::vector<uint32_t> cornerCopies(cornerCount, 0);	//Which of its vertex's tangents each corner uses
+	std::vector<uint32_t> splitStarts(vertexCount + 1, 0);
+	tangents.resize(vertexCount);
+	pool.ParallelFor(vertexCount, 8192, [&](size_t start, size_t end) {
+		std::vector<uint32_t> distinct; //The first corner with each different tangent
+		for (size_t v = start; v < end; ++v) {
+			distinct.clear();
+			for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+				uint32_t c		= corners[i];
+				uint32_t copy	= 0;
+				while (copy < distinct.size() && memcmp(&cornerFrames[distinct[copy]], &cornerFrames[c], sizeof(Vector4)) != 0) {
+					++copy;
+				}
+				if (copy == distinct.size()) {
+					distinct.push_back(c);
+				}
+				cornerCopies[c] = copy;
+			}
+			tangents[v]			= distinct.empty() ? Vector4(AnyPerpendicular(normals[v]), 1.0f) : cornerFrames[distinct[0]];
+			splitStarts[v + 1]	= distinct.empty() ? 0 : (uint32_t)distinct.size() - 1;
+		}
+	});
+	for (size_t v = 0; v < vertexCount; ++v) {
+		splitStarts[v + 1] += splitStarts[v];
+	}
+	size_t splitCount = splitStarts[vertexCount];
+	DiscardQuantised(VertexAttribute::Tangents);
+	if (splitCount == 0) {
+		return true;
+	}
+
+	std::vector<uint32_t> splitSources(splitCount);
+	std::vector<Vector4>  splitTangents(splitCount);
+	bool wideIndices = false;
+	for (size_t c = 0; c < cornerCount; ++c) {
+		if (cornerCopies[c] == 0) {
+			continue;
+		}
+		uint32_t v		= cornerVerts[c];
+		uint32_t split	= splitStarts[v] + cornerCopies[c] - 1;
+		splitSources[split]		= v;
+		splitTangents[split]	= cornerFrames[c];
+		wideIndices |= vertexCount + split - GetBaseVertexForIndex(c) > UINT16_MAX;
+	}
+	if (indexFormat == IndexFormat::UnsignedShort && wideIndices) {
+		indices.assign(shortIndices.begin(), shortIndices.end());
+		shortIndices.clear();
+		indexFormat = IndexFormat::UnsignedInt;
+	}
+	for (size_t c = 0; c < cornerCount; ++c) {
+		if (cornerCopies[c] == 0) {
+			continue;
+		}
+		uint32_t index = (uint32_t)(vertexCount + splitStarts[cornerVerts[c]] + cornerCopies[c] - 1 - GetBaseVertexForIndex(c));
+		if (indexFormat == IndexFormat::UnsignedShort) {
+			shortIndices[c] = (uint16_t)index;
+		}
+		else {
+			indices[c] = index;
+		}
+	}
+
+	auto SplitAttribute = [&](auto& attribute) {
+		if (attribute.size() != vertexCount) {
+			return;
+		}
+		attribute.resize(vertexCount + splitCount);
+		for (size_t i = 0; i < splitCount; ++i) {
+			attribute[vertexCount + i] = attribute[splitSources[i]];
+		}
+	};
+	SplitAttribute(positions);
+	SplitAttribute(texCoords);
+	SplitAttribute(colours);
+	SplitAttribute(normals);
+	SplitAttribute(skinWeights);
+	SplitAttribute(skinIndices);
+	SplitAttribute(generalVec4s);
+	SplitAttribute(generalIntegers);
+	tangents.insert(tangents.end(), splitTangents.begin(), splitTangents.end());
+
+	//New vertices come after every existing one, so their morph entries can go on the end
+	for (MorphTarget& target : morphTargets) {
+		for (size_t i = 0; i < splitCount; ++i) {
+			auto entry = std::lower_bound(target.vertexIndices.begin(), target.vertexIndices.end(), splitSources[i]);
+			if (entry == target.vertexIndices.end() || *entry != splitSources[i]) {
+				continue;
+			}
+			size_t e = entry - target.vertexIndices.begin();
+			target.vertexIndices.push_back((uint32_t)(vertexCount + i));
+			target.positionDeltas.push_back(Vector3(target.positionDeltas[e]));
+			if (!target.normalDeltas.empty()) {
+				target.normalDeltas.push_back(Vector3(target.normalDeltas[e]));
+			}
+			if (!target.tangentDeltas.empty()) {
+				target.tangentDeltas.push_back(Vector3(target.tangentDeltas[e]));
+			}
+		}
+	}
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		DiscardQuantised((VertexAttribute::Type)i);
+	}
+	InvalidateCachedData();
+	return true;
+}
+
+const BoundingVolume& Mesh::GetBounds() const {
+	if (boundsDirty) {
+		CalculateBounds();
+	}
+	return bounds;
+}
+
+const BoundingVolume& Mesh::GetSubMeshBounds(size_t subMesh) const {
+	if (boundsDirty) {
+		CalculateBounds();
+	}
+	if (subMesh >= subMeshBounds.size()) {
+		return bounds;
+	}
+	return subMeshBounds[subMesh];
+}
+
+void Mesh::CalculateBounds() const {
+	Vector3 boxMin;
+	Vector3 boxMax;
+	PositionMinMax(positions.data(), positions.size(), boxMin, boxMax);
+	bounds = BoundsFromBox(boxMin, boxMax);
+
+	float radiusSquared = 0.0f;
+	for (const Vector3& p : positions) {
+		radiusSquared = std::max(radiusSquared, Vector::LengthSquared(p - bounds.sphereCentre));
+	}
+	bounds.sphereRadius = sqrt(radiusSquared);
+
+	subMeshBounds.resize(subMeshes.size());
+	ThreadPool::GetGlobalPool().ParallelFor(subMeshes.size(), 1, [&](size_t start, size_t end) {
+		for (size_t s = start; s < end; ++s) {
+			const SubMesh& m	= subMeshes[s];
+			size_t first		= std::min<size_t>(m.start, GetIndexCount());
+			size_t last			= std::min<size_t>((size_t)m.start + m.count, GetIndexCount());
+
+			Vector3 subMin(FLT_MAX, FLT_MAX, FLT_MAX);
+			Vector3 subMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+#ifdef NCL_SIMD_SSE
+			__m128 vMin = _mm_set1_ps(FLT_MAX);
+			__m128 vMax = _mm_set1_ps(-FLT_MAX);
+			for (size_t i = first; i < last; ++i) {
+				size_t v = (size_t)GetIndex(i) + m.base;
+				if (v < positions.size()) {
+					const Vector3& p = positions[v];
+					__m128 vp = _mm_setr_ps(p.x, p.y, p.z, p.z);
+					vMin = _mm_min_ps(vMin, vp);
+					vMax = _mm_max_ps(vMax, vp);
+				}
+			}
+			float mins[4];
+			float maxs[4];
+			_mm_storeu_ps(mins, vMin);
+			_mm_storeu_ps(maxs, vMax);
+			subMin = Vector3(mins[0], mins[1], mins[2]);
+			subMax = Vector3(maxs[0], maxs[1], maxs[2]);
+#else
+			for (size_t i = first; i < last; ++i) {
+				size_t v = (size_t)GetIndex(i) + m.base;
+				if (v < positions.size()) {
+					subMin = Vector::Min(subMin, positions[v]);
+					subMax = Vector::Max(subMax, positions[v]);
+				}
+			}
+#endif
+			BoundingVolume& sub = subMeshBounds[s];
+			sub = BoundsFromBox(subMin, subMax);
+
+			float subRadiusSquared = 0.0f;
+			for (size_t i = first; i < last; ++i) {
+				size_t v = (size_t)GetIndex(i) + m.base;
+				if (v < positions.size()) {
+					subRadiusSquared = std::max(subRadiusSquared, Vector::LengthSquared(positions[v] - sub.sphereCentre));
+				}
+			}
+			sub.sphereRadius = sqrt(subRadiusSquared);
+		}
+	});
+	boundsDirty = false;
+}
+
+void Mesh::SetBounds(const BoundingVolume& meshBounds, const std::vector<BoundingVolume>& newSubMeshBounds) {
+	bounds			= meshBounds;
+	subMeshBounds	= newSubMeshBounds;
+	subMeshBounds.resize(subMeshes.size(), meshBounds);
+	boundsDirty		= false;
+}
+
+const std::vector<Plane>& Mesh::GetFacePlanes() const {
+	if (faceDataDirty) {
+		CalculateFaceData();
+	}
+	return facePlanes;
+}
+
+const std::vector<uint32_t>& Mesh::GetTriangleAdjacency() const {
+	if (faceDataDirty) {
+		CalculateFaceData();
+	}
+	return triangleAdjacency;
+}
+
+void Mesh::CalculateFaceData() const {
+	facePlanes.clear();
+	triangleAdjacency.clear();
+	faceDataDirty = false;
+
+	if (primType != GeometryPrimitive::Triangles) {
+		return;
+	}
+	ThreadPool& pool	= ThreadPool::GetGlobalPool();
+	size_t triCount		= GetPrimitiveCount();
+	size_t vertexCount	= positions.size();
+
+	std::vector<uint32_t> triVerts(triCount * 3);
+	facePlanes.resize(triCount);
+	pool.ParallelFor(triCount, 4096, [&](size_t start, size_t end) {
+		for (size_t t = start; t < end; ++t) {
+			unsigned int a, b, c;
+			if (!GetVertexIndicesForTri((unsigned int)t, a, b, c)) {
+				a = b = c = UINT32_MAX; //Out of range, so it gets no plane, and its edges are never welded
+			}
+			triVerts[t * 3]		= a;
+			triVerts[t * 3 + 1] = b;
+			triVerts[t * 3 + 2] = c;
+			if (a < vertexCount && b < vertexCount && c < vertexCount) {
+				facePlanes[t] = Plane::PlaneFromTri(positions[a], positions[b], positions[c]);
+			}
+		}
+	});
+
+	//Edges are matched by position, so triangles either side of a UV seam still count as adjacent
+	std::vector<uint32_t> welded;
+	GetPositionWeldMap(welded);
+
+	struct EdgeRecord {
+		uint64_t key;		//Welded vertex pair, smallest first
+		uint32_t corner;	//Triangle * 3 + edge
+		bool	 reversed;
+	};
+	const size_t BUCKET_COUNT = 256;
+	auto EdgeBucket = [](uint64_t key) {
+		return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 56);
+	};
+
+	//Edges are hashed into buckets, which can then each be matched up independently
+	std::vector<EdgeRecord> records(triCount * 3);
+	pool.ParallelFor(triCount, 4096, [&](size_t start, size_t end) {
+		for (size_t t = start; t < end; ++t) {
+			for (int e = 0; e < 3; ++e) {
+				uint32_t a = triVerts[t * 3 + e];
+				uint32_t b = triVerts[t * 3 + (e + 1) % 3];
+				a = a < vertexCount ? welded[a] : a;
+				b = b < vertexCount ? welded[b] : b;
+
+				EdgeRecord& r	= records[t * 3 + e];
+				r.reversed		= a > b;
+				r.key			= r.reversed ? ((uint64_t)b << 32 | a) : ((uint64_t)a << 32 | b);
+				r.corner		= (uint32_t)(t * 3 + e);
+			}
+		}
+	});
+
+	std::vector<uint32_t> bucketStart(BUCKET_COUNT + 1, 0);
+	for (const EdgeRecord& r : records) {
+		bucketStart[EdgeBucket(r.key) + 1]++;
+	}
+	for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+		bucketStart[i + 1] += bucketStart[i];
+	}
+	std::vector<EdgeRecord> bucketed(records.size());
+	std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+	for (const EdgeRecord& r : records) {
+		bucketed[fill[EdgeBucket(r.key)]++] = r;
+	}
+
+	triangleAdjacency.assign(triCount * 3, NO_ADJACENT_TRIANGLE);
+	pool.ParallelFor(BUCKET_COUNT, 4, [&](size_t start, size_t end) {
+		for (size_t bucket = start; bucket < end; ++bucket) {
+			EdgeRecord* first	= bucketed.data() + bucketStart[bucket];
+			EdgeRecord* last	= bucketed.data() + bucketStart[bucket + 1];
+			std::sort(first, last, [](const EdgeRecord& a, const EdgeRecord& b) {
+				return a.key < b.key;
+			});
+			while (first < last) {
+				EdgeRecord* run = first + 1;
+				while (run < last && run->key == first->key) {
+					++run;
+				}
+				//Only manifold edges, used once in each direction, are linked
+				if (run - first == 2 && first[0].reversed != first[1].reversed) {
+					triangleAdjacency[first[0].corner] = first[1].corner / 3;
+					triangleAdjacency[first[1].corner] = first[0].corner / 3;
+				}
+				first = run;
+			}
+		}
+	});
+}
+
+size_t Mesh::GetSilhouetteEdges(const Vector4& light, std::vector<unsigned int>& edgeIndices) const {
+	const std::vector<Plane>&		planes		= GetFacePlanes();
+	const std::vector<uint32_t>&	adjacency	= GetTriangleAdjacency();
+	size_t triCount = planes.size();
+
+	std::vector<uint8_t> facing(triCount);
+	ThreadPool& pool = ThreadPool::GetGlobalPool();
+	pool.ParallelFor(triCount, 8192, [&](size_t start, size_t end) {
+		for (size_t t = start; t < end; ++t) {
+			const Plane& p = planes[t];
+			facing[t] = (Vector::Dot(p.GetNormal(), Vector3(light)) + p.GetDistance() * light.w) > 0.0f;
+		}
+	});
+
+	//Each batch collects its own edges, which are joined in order afterwards
+	const size_t batchSize = 8192;
+	std::vector<std::vector<unsigned int>> batchEdges((triCount + batchSize - 1) / batchSize);
+	pool.ParallelFor(triCount, batchSize, [&](size_t start, size_t end) {
+		std::vector<unsigned int>& edges = batchEdges[start / batchSize];
+		for (size_t t = start; t < end; ++t) {
+			if (!facing[t]) {
+				continue;
+			}
+			unsigned int v[3];
+			GetVertexIndicesForTri((unsigned int)t, v[0], v[1], v[2]);
+			for (int e = 0; e < 3; ++e) {
+				uint32_t neighbour = adjacency[t * 3 + e];
+				if (neighbour == NO_ADJACENT_TRIANGLE || !facing[neighbour]) {
+					edges.push_back(v[e]);
+					edges.push_back(v[(e + 1) % 3]);
+				}
+			}
+		}
+	});
+
+	size_t oldSize = edgeIndices.size();
+	for (const std::vector<unsigned int>& edges : batchEdges) {
+		edgeIndices.insert(edgeIndices.end(), edges.begin(), edges.end());
+	}
+	return (edgeIndices.size() - oldSize) / 2;
+}
+
+bool Mesh::Validate(MeshValidationReport& report) const {
+	report = MeshValidationReport();
+	size_t vertexCount	= positions.size();
+	ThreadPool& pool	= ThreadPool::GetGlobalPool();
+
+	if (positions.empty()) {
+		report.issues |= MeshIssue::NoPositions;
+	}
+
+	auto CheckAttribute = [&](VertexAttribute::Type attribute, size_t count, const float* data, size_t floatsPerVertex) {
+		if (count == 0) {
+			return;
+		}
+		if (count != vertexCount) {
+			report.issues				|= MeshIssue::BadAttributeCount;
+			report.badCountAttributes	|= 1 << attribute;
+		}
+		if (!data) {
+			return;
+		}
+		std::atomic<size_t> nonFinite = 0;
+		pool.ParallelFor(count * floatsPerVertex, 65536, [&](size_t start, size_t end) {
+			size_t found = CountNonFinite(data + start, end - start);
+			if (found) {
+				nonFinite += found;
+			}
+		});
+		if (nonFinite > 0) {
+			report.issues				|= MeshIssue::NonFiniteValue;
+			report.nonFiniteAttributes	|= 1 << attribute;
+			report.nonFiniteValueCount	+= nonFinite;
+		}
+	};
+	CheckAttribute(VertexAttribute::Positions,			positions.size(),		(const float*)positions.data(),		3);
+	CheckAttribute(VertexAttribute::Colours,			colours.size(),			(const float*)colours.data(),		4);
+	CheckAttribute(VertexAttribute::TextureCoords,		texCoords.size(),		(const float*)texCoords.data(),		2);
+	CheckAttribute(VertexAttribute::Normals,			normals.size(),			(const float*)normals.data(),		3);
+	CheckAttribute(VertexAttribute::Tangents,			tangents.size(),		(const float*)tangents.data(),		4);
+	CheckAttribute(VertexAttribute::JointWeights,		skinWeights.size(),		(const float*)skinWeights.data(),	4);
+	CheckAttribute(VertexAttribute::JointIndices,		skinIndices.size(),		nullptr,							0);
+	CheckAttribute(VertexAttribute::General_Vec4,		generalVec4s.size(),	(const float*)generalVec4s.data(),	4);
+	CheckAttribute(VertexAttribute::General_Integer,	generalIntegers.size(),	nullptr,							0);
+
+	size_t indexCount = GetIndexCount();
+	size_t perPrimitive = primType == GeometryPrimitive::Triangles ? 3 : (primType == GeometryPrimitive::Lines ? 2 : 1);
+	if (indexCount % perPrimitive != 0) {
+		report.issues |= MeshIssue::IncompletePrimitive;
+	}
+
+	//Index ranges to check, as start, count, and base vertex
+	std::vector<SubMesh> ranges;
+	if (subMeshes.empty()) {
+		SubMesh all;
+		all.count = (int)indexCount;
+		ranges.push_back(all);
+	}
+	for (const SubMesh& m : subMeshes) {
+		if (m.start < 0 || m.count < 0 || m.base < 0 || (size_t)m.start + m.count > indexCount) {
+			report.issues |= MeshIssue::SubMeshOutOfRange;
+			report.badSubMeshCount++;
+			continue;
+		}
+		if (m.count % perPrimitive != 0) {
+			report.issues |= MeshIssue::IncompletePrimitive;
+		}
+		ranges.push_back(m);
+	}
+
+	std::atomic<size_t> badIndices		= 0;
+	std::atomic<size_t> firstBadIndex	= SIZE_MAX;
+	pool.ParallelFor(ranges.size(), 1, [&](size_t startRange, size_t endRange) {
+		for (size_t r = startRange; r < endRange; ++r) {
+			const SubMesh& m = ranges[r];
+			//Indices must be below this for their vertex to exist
+			uint32_t limit = (size_t)m.base >= vertexCount ? 0 : (uint32_t)std::min<size_t>(vertexCount - m.base, UINT32_MAX);
+
+			pool.ParallelFor(m.count, 65536, [&](size_t start, size_t end) {
+				size_t first = m.start + start;
+				size_t count = end - start;
+				size_t found = indexFormat == IndexFormat::UnsignedShort ?
+					CountIndicesOutOfRange(shortIndices.data() + first, count, limit) :
+					CountIndicesOutOfRange(indices.data() + first, count, limit);
+				if (found == 0) {
+					return;
+				}
+				badIndices += found;
+				for (size_t i = first; i < first + count; ++i) {
+					if (GetIndex(i) >= limit) {
+						size_t current = firstBadIndex;
+						while (i < current && !firstBadIndex.compare_exchange_weak(current, i)) {
+						}
+						break;
+					}
+				}
+			});
+		}
+	});
+	if (badIndices > 0) {
+		report.issues			|= MeshIssue::IndexOutOfRange;
+		report.badIndexCount	= badIndices;
+		report.firstBadIndex	= firstBadIndex;
+	}
+
+	size_t jointCount = std::max(jointNames.size(), std::max(bindPose.size(), inverseBindPose.size()));
+	if (jointCount > 0 && skinIndices.size() == vertexCount) {
+		bool hasWeights = skinWeights.size() == vertexCount;
+		std::atomic<size_t> badJoints = 0;
+		pool.ParallelFor(vertexCount, 65536, [&](size_t start, size_t end) {
+			size_t found = 0;
+			for (size_t v = start; v < end; ++v) {
+				for (int i = 0; i < 4; ++i) {
+					if (hasWeights && skinWeights[v][i] == 0.0f) {
+						continue;
+					}
+					if (skinIndices[v][i] < 0 || (size_t)skinIndices[v][i] >= jointCount) {
+						found++;
+					}
+				}
+			}
+			if (found) {
+				badJoints += found;
+			}
+		});
+		if (badJoints > 0) {
+			report.issues				|= MeshIssue::SkinIndexOutOfRange;
+			report.badSkinIndexCount	= badJoints;
+		}
+	}
+	return report.IsValid();
+}
+
+size_t MeshMemoryFootprint::GetTotal() const {
+	size_t total = indices + subMeshes + skeleton + bindPoses + morphTargets + cachedData;
+	for (size_t a : attributes) {
+		total += a;
+	}
+	return total;
+}
+
+MeshMemoryFootprint& MeshMemoryFootprint::operator+=(const MeshMemoryFootprint& f) {
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		attributes[i] += f.attributes[i];
+	}
+	indices			+= f.indices;
+	subMeshes		+= f.subMeshes;
+	skeleton		+= f.skeleton;
+	bindPoses		+= f.bindPoses;
+	morphTargets	+= f.morphTargets;
+	cachedData		+= f.cachedData;
+	return *this;
+}
+
+namespace {
+	template<typename T>
+	size_t VectorBytes(const std::vector<T>& v) {
+		return v.capacity() * sizeof(T);
+	}
+
+	size_t StringBytes(const std::vector<std::string>& strings) {
+		size_t bytes = VectorBytes(strings);
+		for (const std::string& s : strings) {
+			//Short strings live inside the string object itself, so only count heap buffers
+			uintptr_t data	= (uintptr_t)s.data();
+			uintptr_t self	= (uintptr_t)&s;
+			if (data < self || data >= self + sizeof(std::string)) {
+				bytes += s.capacity() + 1;
+			}
+		}
+		return bytes;
+	}
+}
+
+MeshMemoryFootprint Mesh::GetMemoryFootprint() const {
+	MeshMemoryFootprint f;
+	f.attributes[VertexAttribute::Positions]		= VectorBytes(positions);
+	f.attributes[VertexAttribute::Colours]			= VectorBytes(colours);
+	f.attributes[VertexAttribute::TextureCoords]	= VectorBytes(texCoords);
+	f.attributes[VertexAttribute::Normals]			= VectorBytes(normals);
+	f.attributes[VertexAttribute::Tangents]			= VectorBytes(tangents);
+	f.attributes[VertexAttribute::JointWeights]		= VectorBytes(skinWeights);
+	f.attributes[VertexAttribute::JointIndices]		= VectorBytes(skinIndices);
+	f.attributes[VertexAttribute::General_Vec4]		= VectorBytes(generalVec4s);
+	f.attributes[VertexAttribute::General_Integer]	= VectorBytes(generalIntegers);
+
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		f.attributes[i] += VectorBytes(quantised[i].data);
+	}
+
+	f.indices		= VectorBytes(indices) + VectorBytes(shortIndices);
+	f.subMeshes		= VectorBytes(subMeshes) + VectorBytes(subMeshLookup) + StringBytes(subMeshNames);
+	f.skeleton		= StringBytes(jointNames) + VectorBytes(jointParents);
+	f.bindPoses		= VectorBytes(bindPose) + VectorBytes(inverseBindPose);
+	f.cachedData	= VectorBytes(subMeshBounds) + VectorBytes(facePlanes) + VectorBytes(triangleAdjacency);
+
+	f.morphTargets = VectorBytes(morphTargets);
+	for (const MorphTarget& t : morphTargets) {
+		f.morphTargets += VectorBytes(t.vertexIndices) + VectorBytes(t.positionDeltas) +
+			VectorBytes(t.normalDeltas) + VectorBytes(t.tangentDeltas);
+	}
+	return f;
+}
+
 int Mesh::GetIndexForJoint(const std::string& name) const {
 	for (int i = 0; i < jointNames.size(); ++i) {
 		if (jointNames[i] == name) {
@@ -83,30 +1204,178 @@ int Mesh::GetIndexForJoint(const std::string& name) const {
 }
 
 void Mesh::SetVertexPositions(const std::vector<Vector3>& newVerts) {
+	DiscardQuantised(VertexAttribute::Positions);
 	positions = newVerts;
+	InvalidateCachedData();
 }
 
 void Mesh::SetVertexTextureCoords(const std::vector<Vector2>& newTex) {
+	DiscardQuantised(VertexAttribute::TextureCoords);
 	texCoords = newTex;
 }
 
 void Mesh::SetVertexColours(const std::vector<Vector4>& newColours) {
+	DiscardQuantised(VertexAttribute::Colours);
 	colours = newColours;
 }
 
 void Mesh::SetVertexNormals(const std::vector<Vector3>& newNorms) {
+	DiscardQuantised(VertexAttribute::Normals);
 	normals = newNorms;
 }
 
 void Mesh::SetVertexTangents(const std::vector<Vector4>& newTans) {
+	DiscardQuantised(VertexAttribute::Tangents);
 	tangents = newTans;
 }
 
 void Mesh::SetVertexIndices(const std::vector<unsigned int>& newIndices) {
-	indices = newIndices;
+	indices		= newIndices;
+	indexFormat = IndexFormat::UnsignedInt;
+	shortIndices.clear();
+	InvalidateCachedData();
+}
+
+void Mesh::SetVertexIndices(const std::vector<uint16_t>& newIndices) {
+	shortIndices	= newIndices;
+	indexFormat		= IndexFormat::UnsignedShort;
+	indices.clear();
+	InvalidateCachedData();
+}
+
+void Mesh::SetVertexPositions(std::vector<Vector3>&& newVerts) {
+	DiscardQuantised(VertexAttribute::Positions);
+	positions = std::move(newVerts);
+	InvalidateCachedData();
+}
+
+void Mesh::SetVertexTextureCoords(std::vector<Vector2>&& newTex) {
+	DiscardQuantised(VertexAttribute::TextureCoords);
+	texCoords = std::move(newTex);
+}
+
+void Mesh::SetVertexColours(std::vector<Vector4>&& newColours) {
+	DiscardQuantised(VertexAttribute::Colours);
+	colours = std::move(newColours);
+}
+
+void Mesh::SetVertexNormals(std::vector<Vector3>&& newNorms) {
+	DiscardQuantised(VertexAttribute::Normals);
+	normals = std::move(newNorms);
+}
+
+void Mesh::SetVertexTangents(std::vector<Vector4>&& newTans) {
+	DiscardQuantised(VertexAttribute::Tangents);
+	tangents = std::move(newTans);
+}
+
+void Mesh::SetVertexIndices(std::vector<unsigned int>&& newIndices) {
+	indices		= std::move(newIndices);
+	indexFormat = IndexFormat::UnsignedInt;
+	shortIndices.clear();
+	InvalidateCachedData();
+}
+
+void Mesh::SetVertexIndices(std::vector<uint16_t>&& newIndices) {
+	shortIndices	= std::move(newIndices);
+	indexFormat		= IndexFormat::UnsignedShort;
+	indices.clear();
+	InvalidateCachedData();
+}
+
+int Mesh::GetBaseVertexForIndex(size_t i) const {
+	auto m = std::upper_bound(subMeshLookup.begin(), subMeshLookup.end(), i, [](size_t index, const SubMesh& sub) {
+		return index < (size_t)sub.start;
+	});
+	if (m == subMeshLookup.begin()) {
+		return 0;
+	}
+	--m;
+	return i < (size_t)m->start + m->count ? m->base : 0;
+}
+
+void Mesh::UpdateSubMeshLookup() {
+	subMeshLookup.clear();
+	for (const SubMesh& m : subMeshes) {
+		if (m.count > 0) {
+			subMeshLookup.push_back(m);
+		}
+	}
+	std::stable_sort(subMeshLookup.begin(), subMeshLookup.end(), [](const SubMesh& a, const SubMesh& b) {
+		return a.start < b.start;
+	});
+}
+
+bool Mesh::CompactIndices() {
+	if (indexFormat == IndexFormat::UnsignedShort) {
+		return true;
+	}
+	if (indices.empty()) {
+		return false;
+	}
+	if (subMeshes.empty()) {
+		if (*std::max_element(indices.begin(), indices.end()) > UINT16_MAX) {
+			return false;
+		}
+		shortIndices.assign(indices.begin(), indices.end());
+	}
+	else {
+		//Each index must belong to at most one sub-mesh for the rebasing to be valid.
+		//Indices outside every sub-mesh keep a base vertex of 0, so must fit as they are.
+		shortIndices.resize(indices.size());
+		auto CompactGap = [&](size_t start, size_t end) {
+			for (size_t i = start; i < end; ++i) {
+				if (indices[i] > UINT16_MAX) {
+					return false;
+				}
+				shortIndices[i] = (uint16_t)indices[i];
+			}
+			return true;
+		};
+		size_t covered = 0;
+		for (const SubMesh& m : subMeshLookup) {
+			if ((size_t)m.start < covered || (size_t)m.start + m.count > indices.size() || !CompactGap(covered, m.start)) {
+				shortIndices.clear();
+				return false;
+			}
+			covered = (size_t)m.start + m.count;
+		}
+		if (!CompactGap(covered, indices.size())) {
+			shortIndices.clear();
+			return false;
+		}
+
+		std::vector<unsigned int> minIndex(subMeshes.size(), 0);
+		for (size_t s = 0; s < subMeshes.size(); ++s) {
+			const SubMesh& m = subMeshes[s];
+			if (m.count <= 0) {
+				continue;
+			}
+			auto [minIt, maxIt] = std::minmax_element(indices.begin() + m.start, indices.begin() + m.start + m.count);
+			if (*maxIt - *minIt > UINT16_MAX) {
+				shortIndices.clear();
+				return false;
+			}
+			minIndex[s] = *minIt;
+		}
+
+		for (size_t s = 0; s < subMeshes.size(); ++s) {
+			SubMesh& m = subMeshes[s];
+			for (int i = m.start; i < m.start + m.count; ++i) {
+				shortIndices[i] = (uint16_t)(indices[i] - minIndex[s]);
+			}
+			m.base += (int)minIndex[s];
+		}
+		UpdateSubMeshLookup();
+	}
+	indices.clear();
+	indices.shrink_to_fit();
+	indexFormat = IndexFormat::UnsignedShort;
+	return true;
 }
 
 void Mesh::SetVertexSkinWeights(const std::vector<Vector4>& newSkinWeights) {
+	DiscardQuantised(VertexAttribute::JointWeights);
 	skinWeights = newSkinWeights;
 }
 
@@ -114,6 +1383,15 @@ void Mesh::SetVertexSkinIndices(const std::vector<Vector4i>& newSkinIndices) {
 	skinIndices = newSkinIndices;
 }
 
+void Mesh::SetVertexSkinWeights(std::vector<Vector4>&& newSkinWeights) {
+	DiscardQuantised(VertexAttribute::JointWeights);
+	skinWeights = std::move(newSkinWeights);
+}
+
+void Mesh::SetVertexSkinIndices(std::vector<Vector4i>&& newSkinIndices) {
+	skinIndices = std::move(newSkinIndices);
+}
+
 void Mesh::SetVertexGenericVec4s(const std::vector<Vector4>& newGenericVec4s) {
 	generalVec4s = newGenericVec4s;
 }
@@ -126,6 +1404,60 @@ void Mesh::SetDebugName(const std::string& newName) {
 	debugName = newName;
 }
 
+void Mesh::SetQuantisedAttribute(VertexAttribute::Type attribute, QuantisedAttribute&& data) {
+	quantised[attribute] = std::move(data);
+}
+
+const QuantisedAttribute* Mesh::GetQuantisedAttribute(VertexAttribute::Type attribute) const {
+	return quantised[attribute].IsEmpty() ? nullptr : &quantised[attribute];
+}
+
+bool Mesh::AddMorphTarget(const MorphTarget& target) {
+	size_t count = target.vertexIndices.size();
+	if (target.positionDeltas.size() != count ||
+		(!target.normalDeltas.empty() && target.normalDeltas.size() != count) ||
+		(!target.tangentDeltas.empty() && target.tangentDeltas.size() != count)) {
+		std::cout << __FUNCTION__ << " morph target " << target.name << " has mismatched delta counts!\n";
+		return false;
+	}
+	morphTargets.push_back(target);
+	MorphTarget& t = morphTargets.back();
+
+	if (!std::is_sorted(t.vertexIndices.begin(), t.vertexIndices.end())) {
+		std::vector<uint32_t> order(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return target.vertexIndices[a] < target.vertexIndices[b];
+		});
+		for (size_t i = 0; i < count; ++i) {
+			t.vertexIndices[i]	= target.vertexIndices[order[i]];
+			t.positionDeltas[i] = target.positionDeltas[order[i]];
+			if (!t.normalDeltas.empty()) {
+				t.normalDeltas[i] = target.normalDeltas[order[i]];
+			}
+			if (!t.tangentDeltas.empty()) {
+				t.tangentDeltas[i] = target.tangentDeltas[order[i]];
+			}
+		}
+	}
+	return true;
+}
+
+void Mesh::ClearMorphTargets() {
+	morphTargets.clear();
+}
+
+int Mesh::GetMorphTargetIndex(const std::string& name) const {
+	for (size_t i = 0; i < morphTargets.size(); ++i) {
+		if (morphTargets[i].name == name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
 void Mesh::SetJointNames(const std::vector < std::string >& newNames) {
 	jointNames = newNames;
 }
@@ -142,8 +1474,24 @@ void Mesh::SetInverseBindPose(const std::vector<Matrix4>& newMats) {
 	inverseBindPose = newMats;
 }
 
+void Mesh::SetBindPose(std::vector<Matrix4>&& newMats) {
+	bindPose = std::move(newMats);
+}
+
+void Mesh::SetInverseBindPose(std::vector<Matrix4>&& newMats) {
+	inverseBindPose = std::move(newMats);
+}
+
 void Mesh::SetSubMeshes(const std::vector < SubMesh>& meshes) {
 	subMeshes = meshes;
+	UpdateSubMeshLookup();
+	InvalidateCachedData();
+}
+
+void Mesh::SetSubMeshes(std::vector<SubMesh>&& meshes) {
+	subMeshes = std::move(meshes);
+	UpdateSubMeshLookup();
+	InvalidateCachedData();
 }
 
 void Mesh::SetSubMeshNames(const std::vector < std::string>& newNames) {
@@ -159,45 +1507,32 @@ void Mesh::CalculateInverseBindPose() {
 }
 
 bool Mesh::ValidateMeshData() {
-	if (GetPositionData().empty()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " does not have any vertex positions!\n";
-		return false;
+	MeshValidationReport report;
+	if (Validate(report)) {
+		return true;
 	}
-	if (!GetTextureCoordData().empty() && GetTextureCoordData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect texture coordinate attribute count!\n";
-		return false;
+	if (report.issues & MeshIssue::NoPositions) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " does not have any vertex positions!\n";
 	}
-	if (!GetColourData().empty() && GetColourData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect colour attribute count!\n";
-		return false;
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		if (report.badCountAttributes & (1 << i)) {
+			std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect " << VertexAttribute::Names[i] << " attribute count!\n";
+		}
+		if (report.nonFiniteAttributes & (1 << i)) {
+			std::cout << __FUNCTION__ << " mesh " << debugName << " has NaN or infinite " << VertexAttribute::Names[i] << " values!\n";
+		}
 	}
-	if (!GetNormalData().empty() && GetNormalData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect normal attribute count!\n";
-		return false;
+	if (report.issues & MeshIssue::IndexOutOfRange) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " has " << report.badIndexCount << " out of range indices, the first at " << report.firstBadIndex << "!\n";
 	}
-	if (!GetTangentData().empty() && GetTangentData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect tangent attribute count!\n";
-		return false;
+	if (report.issues & MeshIssue::SubMeshOutOfRange) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " has " << report.badSubMeshCount << " invalid sub-meshes!\n";
 	}
-
-	if (!GetSkinWeightData().empty() && GetSkinWeightData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect skin weight attribute count!\n";
-		return false;
+	if (report.issues & MeshIssue::IncompletePrimitive) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " has an index count that doesn't match its primitive type!\n";
 	}
-
-	if (!GetSkinIndexData().empty() && GetSkinIndexData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect skin index attribute count!\n";
-		return false;
+	if (report.issues & MeshIssue::SkinIndexOutOfRange) {
+		std::cout << __FUNCTION__ << " mesh " << debugName << " has " << report.badSkinIndexCount << " out of range joint indices!\n";
 	}
-
-	if (!GetGeneralVec4Data().empty() && GetGeneralVec4Data().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect generic vec4 attribute count!\n";
-		return false;
-	}
-
-	if (!GetGeneralIntegerData().empty() && GetGeneralIntegerData().size() != GetVertexCount()) {
-		std::cout << __FUNCTION__ << " mesh " << debugName << " has an incorrect generic integer attribute count!\n";
-		return false;
-	}
-	return true;
-}
\ No newline at end of file
+	return false;
+}
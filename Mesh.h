@@ -10,6 +10,8 @@ https://research.ncl.ac.uk/game/
 #include <cstdint>
 #include "Vector.h"
 #include "Matrix.h"
+#include "Plane.h"
+#include "QuantisedAttribute.h"
 
 namespace NCL::Rendering {
 	class RendererBase;
@@ -28,6 +30,13 @@ namespace NCL::Rendering {
 		};
 	};
 
+	namespace IndexFormat {
+		enum Type : uint32_t {
+			UnsignedInt,
+			UnsignedShort,
+		};
+	};
+
 	namespace VertexAttribute {
 		enum Type : uint32_t {
 			Positions,
@@ -55,6 +64,73 @@ namespace NCL::Rendering {
 		};
 	};
 
+	namespace NormalWeighting {
+		enum Type : uint32_t {
+			Area,	//Larger triangles have more influence
+			Angle,	//Each triangle is weighted by its angle at the vertex
+		};
+	};
+
+	const uint32_t NO_ADJACENT_TRIANGLE = UINT32_MAX;
+
+	namespace MeshIssue {
+		enum Type : uint32_t {
+			NoPositions				= 1 << 0,
+			BadAttributeCount		= 1 << 1,	//An attribute has data, but not one entry per vertex
+			NonFiniteValue			= 1 << 2,	//A NaN or infinity in a float attribute
+			IndexOutOfRange			= 1 << 3,	//An index plus its sub-mesh's base is past the last vertex
+			SubMeshOutOfRange		= 1 << 4,	//A sub-mesh covers indices that don't exist
+			IncompletePrimitive		= 1 << 5,	//An index count isn't a whole number of primitives
+			SkinIndexOutOfRange		= 1 << 6,	//A weighted joint index with no matching joint
+		};
+	};
+
+	//Bytes of CPU memory held by a mesh, including unused vector capacity
+	struct MeshMemoryFootprint {
+		size_t attributes[VertexAttribute::MAX_ATTRIBUTES] = {};
+		size_t indices		= 0;
+		size_t subMeshes	= 0;	//Including their names
+		size_t skeleton		= 0;	//Joint names and parents
+		size_t bindPoses	= 0;	//Both the bind pose and its inverse
+		size_t morphTargets = 0;
+		size_t cachedData	= 0;	//Bounds, face planes and adjacency
+
+		size_t GetTotal() const;
+
+		MeshMemoryFootprint& operator+=(const MeshMemoryFootprint& f);
+	};
+
+	struct MeshValidationReport {
+		uint32_t issues					= 0;	//MeshIssue flags
+		uint32_t badCountAttributes		= 0;	//A bit per VertexAttribute
+		uint32_t nonFiniteAttributes	= 0;	//A bit per VertexAttribute
+		size_t	 nonFiniteValueCount	= 0;
+		size_t	 badIndexCount			= 0;
+		size_t	 firstBadIndex			= SIZE_MAX;	//Position in the index buffer
+		size_t	 badSubMeshCount		= 0;
+		size_t	 badSkinIndexCount		= 0;
+
+		bool IsValid() const {
+			return issues == 0;
+		}
+	};
+
+	struct BoundingVolume {
+		Vector3 boxMin;
+		Vector3 boxMax;
+		Vector3 sphereCentre;
+		float	sphereRadius = 0.0f;
+	};
+
+	//A sparse set of per-vertex offsets, blended over the base mesh with a weight
+	struct MorphTarget {
+		std::string				name;
+		std::vector<uint32_t>	vertexIndices;	//In ascending order
+		std::vector<Vector3>	positionDeltas;
+		std::vector<Vector3>	normalDeltas;	//Either empty, or one per vertex index
+		std::vector<Vector3>	tangentDeltas;	//As above
+	};
+
 	struct SubMesh {
 		int start = 0;
 		int count = 0;
@@ -65,12 +141,18 @@ namespace NCL::Rendering {
 	public:		
 		virtual ~Mesh();
 
+		//Meshes register themselves with the MeshRegistry by address, and derived
+		//classes own GPU resources, so meshes can't be copied or moved
+		Mesh(const Mesh&)				= delete;
+		Mesh& operator=(const Mesh&)	= delete;
+
 		GeometryPrimitive::Type GetPrimitiveType() const {
 			return primType;
 		}
 
 		void SetPrimitiveType(GeometryPrimitive::Type type) {
-			primType = type;
+			primType		= type;
+			faceDataDirty	= true;
 		}
 
 		size_t GetPrimitiveCount(size_t subMesh) const {
@@ -115,7 +197,16 @@ namespace NCL::Rendering {
 		}
 
 		size_t GetIndexCount()  const {
-			return indices.size();
+			return indexFormat == IndexFormat::UnsignedShort ? shortIndices.size() : indices.size();
+		}
+
+		IndexFormat::Type GetIndexFormat() const {
+			return indexFormat;
+		}
+
+		//Returns the stored index, which is relative to its sub-mesh's base vertex
+		unsigned int GetIndex(size_t i) const {
+			return indexFormat == IndexFormat::UnsignedShort ? shortIndices[i] : indices[i];
 		}
 
 		size_t GetJointCount() const {
@@ -136,6 +227,8 @@ namespace NCL::Rendering {
 		void AddSubMesh(SubMesh sub, const std::string& newName = "") {
 			subMeshes.push_back(sub);
 			subMeshNames.push_back(newName);
+			UpdateSubMeshLookup();
+			InvalidateCachedData();
 		}
 
 		void AddSubMesh(int startIndex, int indexCount, int baseVertex, const std::string& newName = "") {
@@ -146,8 +239,34 @@ namespace NCL::Rendering {
 
 			subMeshes.push_back(m);
 			subMeshNames.push_back(newName);
+			UpdateSubMeshLookup();
+			InvalidateCachedData();
 		}
 
+		//Bounds are recalculated on first use after the positions, indices or
+		//sub-meshes change. This isn't thread safe, so call CalculateBounds
+		//before sharing a modified mesh between threads.
+		const BoundingVolume& GetBounds() const;
+		//Falls back to the whole mesh's bounds for an invalid sub-mesh
+		const BoundingVolume& GetSubMeshBounds(size_t subMesh) const;
+
+		void CalculateBounds() const;
+		//Allows loaders to supply precalculated bounds, which must match the current geometry
+		void SetBounds(const BoundingVolume& meshBounds, const std::vector<BoundingVolume>& newSubMeshBounds);
+
+		//Face planes and edge adjacency are also built on first use, with the same threading caveat
+		const std::vector<Plane>& GetFacePlanes() const;
+		//3 entries per triangle - the triangle across the edge from its vertex i to vertex i+1,
+		//or NO_ADJACENT_TRIANGLE for open and non-manifold edges
+		const std::vector<uint32_t>& GetTriangleAdjacency() const;
+
+		void CalculateFaceData() const;
+
+		//Appends the vertex index pairs of each edge where a triangle facing the light meets one
+		//facing away, or an open edge, wound as in the lit triangle. light is a position with
+		//w = 1, or a direction towards the light with w = 0. Returns the number of edges added.
+		size_t GetSilhouetteEdges(const Vector4& light, std::vector<unsigned int>& edgeIndices) const;
+
 		int GetIndexForJoint(const std::string &name) const;
 
 		const std::vector<Matrix4>& GetBindPose() const {
@@ -157,12 +276,15 @@ namespace NCL::Rendering {
 			return inverseBindPose;
 		}
 		void SetSubMeshes(const std::vector < SubMesh>& meshes);
+		void SetSubMeshes(std::vector<SubMesh>&& meshes);
 		void SetSubMeshNames(const std::vector < std::string>& newnames);
 
 		void SetJointNames(const std::vector < std::string > & newnames);
 		void SetJointParents(const std::vector<int>& newParents);
 		void SetBindPose(const std::vector<Matrix4>& newMats);
+		void SetBindPose(std::vector<Matrix4>&& newMats);
 		void SetInverseBindPose(const std::vector<Matrix4>& newMats);
+		void SetInverseBindPose(std::vector<Matrix4>&& newMats);
 		void CalculateInverseBindPose();
 
 		bool	GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int& b, unsigned int& c) const;
@@ -170,6 +292,10 @@ namespace NCL::Rendering {
 		bool	GetNormalForTri(unsigned int i, Vector3& n) const;
 		bool	HasTriangle(unsigned int i) const;
 
+		//Maps each vertex to the lowest numbered vertex with an identical position,
+		//returning the number of unique positions
+		size_t	GetPositionWeldMap(std::vector<uint32_t>& remap) const;
+
 		const std::vector<Vector3>&		GetPositionData()		const { return positions;	}
 		const std::vector<Vector2>&		GetTextureCoordData()	const { return texCoords;	}
 		const std::vector<Vector4>&		GetColourData()			const { return colours;		}
@@ -193,7 +319,9 @@ namespace NCL::Rendering {
 			return subMeshNames;
 		}
 
-		const std::vector<unsigned int>& GetIndexData()			const { return indices;		}
+		//Only one of these is populated at a time - check GetIndexFormat
+		const std::vector<unsigned int>&	GetIndexData()		const { return indices;		}
+		const std::vector<uint16_t>&		GetShortIndexData()	const { return shortIndices; }
 
 		void SetVertexPositions(const std::vector<Vector3>& newVerts);
 		void SetVertexTextureCoords(const std::vector<Vector2>& newTex);
@@ -202,15 +330,67 @@ namespace NCL::Rendering {
 		void SetVertexNormals(const std::vector<Vector3>& newNorms);
 		void SetVertexTangents(const std::vector<Vector4>& newTans);
 		void SetVertexIndices(const std::vector<unsigned int>& newIndices);
+		void SetVertexIndices(const std::vector<uint16_t>& newIndices);
+
+		//Move versions of the above, to avoid copying large attribute arrays when loading
+		void SetVertexPositions(std::vector<Vector3>&& newVerts);
+		void SetVertexTextureCoords(std::vector<Vector2>&& newTex);
+		void SetVertexColours(std::vector<Vector4>&& newColours);
+		void SetVertexNormals(std::vector<Vector3>&& newNorms);
+		void SetVertexTangents(std::vector<Vector4>&& newTans);
+		void SetVertexIndices(std::vector<unsigned int>&& newIndices);
+		void SetVertexIndices(std::vector<uint16_t>&& newIndices);
+
+		//Checks attribute counts, that every float is finite, and that every index
+		//(and joint index) is in range, in parallel. Prints nothing - returns IsValid.
+		bool Validate(MeshValidationReport& report) const;
+
+		//Switches to 16 bit index storage if every sub-mesh spans fewer than 65536
+		//vertices, adjusting each sub-mesh's base vertex to the lowest vertex it uses.
+		bool CompactIndices();
 
 		void SetVertexSkinWeights(const std::vector<Vector4>& newSkinWeights);
 		void SetVertexSkinIndices(const std::vector<Vector4i>& newSkinIndices);
+		void SetVertexSkinWeights(std::vector<Vector4>&& newSkinWeights);
+		void SetVertexSkinIndices(std::vector<Vector4i>&& newSkinIndices);
 
 		void SetVertexGenericVec4s(const std::vector<Vector4>& newGenericVec4s);
 		void SetVertexGenericIntegers(const std::vector<int>& newGenericInts);
 
 		void SetDebugName(const std::string& debugName);
 
+		//A quantised copy of an attribute, for uploading to the GPU as-is. Its float
+		//data may be empty if the mesh was loaded with quantised data kept, and setting
+		//the attribute's float data discards the quantised copy.
+		void SetQuantisedAttribute(VertexAttribute::Type attribute, QuantisedAttribute&& data);
+		//Returns nullptr if the attribute has no quantised copy
+		const QuantisedAttribute* GetQuantisedAttribute(VertexAttribute::Type attribute) const;
+
+		const std::string& GetDebugName() const {
+			return debugName;
+		}
+
+		MeshMemoryFootprint GetMemoryFootprint() const;
+
+		//Entries are sorted into vertex order if need be. Fails if the delta counts don't match.
+		bool AddMorphTarget(const MorphTarget& target);
+		void ClearMorphTargets();
+
+		const std::vector<MorphTarget>& GetMorphTargets() const {
+			return morphTargets;
+		}
+
+		//Returns -1 if there's no target with the name
+		int GetMorphTargetIndex(const std::string& name) const;
+
+		//Builds smooth vertex normals, shared between all vertices at the same position
+		bool GenerateNormals(NormalWeighting::Type weighting = NormalWeighting::Angle);
+		//Builds MikkTSpace tangents from the normals and texture coordinates, with the bitangent
+		//handedness stored in w, so normal maps baked against MikkTSpace shade correctly. Normals are
+		//generated if missing. Vertices whose triangles' tangent frames disagree, such as along a
+		//mirrored UV seam, are split, adding new vertices on the end.
+		bool GenerateTangents();
+
 		virtual void UploadToGPU(Rendering::RendererBase* renderer = nullptr) = 0;
 
 		uint32_t GetAssetID() const {
@@ -226,7 +406,21 @@ namespace NCL::Rendering {
 
 		virtual bool ValidateMeshData();
 
+		int GetBaseVertexForIndex(size_t i) const;
+		//Must be called whenever the sub-meshes change
+		void UpdateSubMeshLookup();
+
+		void InvalidateCachedData() {
+			boundsDirty		= true;
+			faceDataDirty	= true;
+		}
+
+		void DiscardQuantised(VertexAttribute::Type attribute) {
+			quantised[attribute] = QuantisedAttribute();
+		}
+
 		GeometryPrimitive::Type		primType;
+		IndexFormat::Type			indexFormat;
 		std::string					debugName;
 		uint32_t					assetID;
 
@@ -236,8 +430,10 @@ namespace NCL::Rendering {
 		std::vector<Vector3>		normals;
 		std::vector<Vector4>		tangents;
 		std::vector<unsigned int>	indices;
+		std::vector<uint16_t>		shortIndices;
 		std::vector<SubMesh>		subMeshes;
 		std::vector<std::string>	subMeshNames;
+		std::vector<SubMesh>		subMeshLookup;	//Sorted by start, so an index's sub-mesh can be binary searched
 
 		std::vector<Vector4>		generalVec4s;
 		std::vector<int>			generalIntegers;
@@ -248,6 +444,17 @@ namespace NCL::Rendering {
 		std::vector<int>			jointParents;
 		std::vector<Matrix4>		bindPose;
 		std::vector<Matrix4>		inverseBindPose;
+		std::vector<MorphTarget>	morphTargets;
+
+		QuantisedAttribute			quantised[VertexAttribute::MAX_ATTRIBUTES];
+
+		mutable BoundingVolume				bounds;
+		mutable std::vector<BoundingVolume>	subMeshBounds;
+		mutable bool						boundsDirty;
+
+		mutable std::vector<Plane>			facePlanes;
+		mutable std::vector<uint32_t>		triangleAdjacency;
+		mutable bool						faceDataDirty;
 	};
 
 	using UniqueMesh = std::unique_ptr<Mesh>;
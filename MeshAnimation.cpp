@@ -1,11 +1,129 @@
 #include "MeshAnimation.h"
 #include "Matrix.h"
+#include "Skeleton.h"
 #include "Assets.h"
+#include "SIMD.h"
+#include "ChunkCompression.h"
+
+#include <cstring>
+#include <cstdint>
 
 using namespace NCL;
 using namespace Rendering;
 using namespace Maths;
 
+namespace {
+	const uint32_t BINARY_MAGIC		= 0x4D4E414E; //"NANM"
+	const uint32_t BINARY_VERSION	= 2;
+	const uint64_t FRAME_ALIGNMENT	= 64;
+
+	const uint32_t FRAMES_COMPRESSED = 1; //The frames are a ChunkCompression payload of frameSize bytes
+
+	//Followed by the frames, jointCount * frameCount matrices at frameOffset, then
+	//if there are names, each as a 32 bit length and its characters at namesOffset
+	struct BinaryAnimHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t jointCount;
+		uint32_t frameCount;
+		float	 frameRate;
+		uint32_t nameCount;		//Either 0 or jointCount
+		uint32_t flags;
+		uint32_t reserved;
+		uint64_t frameOffset;
+		uint64_t frameSize;		//As stored in the file
+		uint64_t namesOffset;
+	};
+
+	static_assert(sizeof(BinaryAnimHeader) == 56, "Binary animation header must not be padded");
+
+	//How many joints BlendJoints works on at once
+	const size_t BLEND_WIDTH = 4;
+
+	//JointTransform::Blend on BLEND_WIDTH joints at once
+	void BlendJoints(const JointTransform* from, const JointTransform* to, float t, JointTransform* output) {
+#ifdef NCL_SIMD_SSE
+		__m128 vt = _mm_set1_ps(t);
+
+		//Transposed, so that each register holds one component of every joint's rotation
+		__m128 ax = _mm_loadu_ps(&from[0].rotation.x);
+		__m128 ay = _mm_loadu_ps(&from[1].rotation.x);
+		__m128 az = _mm_loadu_ps(&from[2].rotation.x);
+		__m128 aw = _mm_loadu_ps(&from[3].rotation.x);
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+		__m128 bx = _mm_loadu_ps(&to[0].rotation.x);
+		__m128 by = _mm_loadu_ps(&to[1].rotation.x);
+		__m128 bz = _mm_loadu_ps(&to[2].rotation.x);
+		__m128 bw = _mm_loadu_ps(&to[3].rotation.x);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+		//q and -q are the same rotation, so blend towards whichever is nearer
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+
+		__m128 rx = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bx, flip), ax), vt));
+		__m128 ry = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(by, flip), ay), vt));
+		__m128 rz = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bz, flip), az), vt));
+		__m128 rw = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(bw, flip), aw), vt));
+
+		__m128 length	= _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw))));
+		__m128 scale	= _mm_div_ps(_mm_set1_ps(1.0f), length);
+		rx = _mm_mul_ps(rx, scale);
+		ry = _mm_mul_ps(ry, scale);
+		rz = _mm_mul_ps(rz, scale);
+		rw = _mm_mul_ps(rw, scale);
+		_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+		_mm_storeu_ps(&output[0].rotation.x, rx);
+		_mm_storeu_ps(&output[1].rotation.x, ry);
+		_mm_storeu_ps(&output[2].rotation.x, rz);
+		_mm_storeu_ps(&output[3].rotation.x, rw);
+
+		for (Vector3 JointTransform::* member : { &JointTransform::translation, &JointTransform::scale }) {
+			for (int c = 0; c < 3; ++c) {
+				__m128 a = _mm_setr_ps((from[0].*member)[c], (from[1].*member)[c], (from[2].*member)[c], (from[3].*member)[c]);
+				__m128 b = _mm_setr_ps((to[0].*member)[c], (to[1].*member)[c], (to[2].*member)[c], (to[3].*member)[c]);
+				float r[4];
+				_mm_storeu_ps(r, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), vt)));
+				for (size_t i = 0; i < BLEND_WIDTH; ++i) {
+					(output[i].*member)[c] = r[i];
+				}
+			}
+		}
+#else
+		for (size_t i = 0; i < BLEND_WIDTH; ++i) {
+			output[i] = JointTransform::Blend(from[i], to[i], t);
+		}
+#endif
+	}
+
+	void StoreJoint(const JointTransform& joint, JointTransform& output) {
+		output = joint;
+	}
+
+	void StoreJoint(const JointTransform& joint, Matrix4& output) {
+		output = joint.ToMatrix();
+	}
+
+	template<typename T>
+	void BlendFrames(const Matrix4* from, const Matrix4* to, size_t jointCount, float t, T* output) {
+		JointTransform a[BLEND_WIDTH];
+		JointTransform b[BLEND_WIDTH];
+		JointTransform blended[BLEND_WIDTH];
+		for (size_t j = 0; j < jointCount; j += BLEND_WIDTH) {
+			size_t count = std::min(BLEND_WIDTH, jointCount - j);
+			for (size_t i = 0; i < BLEND_WIDTH; ++i) {
+				//The last few joints are padded out with copies of the first
+				a[i] = i < count ? JointTransform::FromMatrix(from[j + i]) : a[0];
+				b[i] = i < count ? JointTransform::FromMatrix(to[j + i]) : b[0];
+			}
+			BlendJoints(a, b, t, blended);
+			for (size_t i = 0; i < count; ++i) {
+				StoreJoint(blended[i], output[j + i]);
+			}
+		}
+	}
+}
+
 MeshAnimation::MeshAnimation() {
 	jointCount	= 0;
 	frameCount	= 0;
@@ -21,6 +139,20 @@ MeshAnimation::MeshAnimation(size_t jointCount, size_t frameCount, float frameRa
 }
 
 MeshAnimation::MeshAnimation(const std::string& filename) : MeshAnimation() {
+	std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+	if (!mapping->Open(Assets::MESHDIR + filename)) {
+		return;
+	}
+	uint32_t magic = 0;
+	if (mapping->GetSize() >= sizeof(BinaryAnimHeader)) {
+		memcpy(&magic, mapping->GetData(), sizeof(magic));
+	}
+	if (magic == BINARY_MAGIC) {
+		LoadBinary(mapping);
+		return;
+	}
+	mapping.reset();
+
 	std::ifstream file(Assets::MESHDIR + filename);
 
 	std::string filetype;
@@ -60,9 +192,180 @@ const Matrix4* MeshAnimation::GetJointData(size_t frame) const {
 	if (frame >= frameCount) {
 		return nullptr;
 	}
-	int matStart = frame * jointCount;
+	return GetFrames() + frame * jointCount;
+}
+
+bool MeshAnimation::GetFrameFraction(float time, bool loop, size_t& frame, size_t& nextFrame, float& t) const {
+	float position = time * frameRate;
+	if (loop) {
+		position = std::fmod(position, (float)frameCount);
+		if (position < 0.0f) {
+			position += frameCount;
+		}
+	}
+	else {
+		position = std::clamp(position, 0.0f, (float)(frameCount - 1));
+	}
+	frame		= std::min((size_t)position, frameCount - 1);
+	nextFrame	= frame + 1 < frameCount ? frame + 1 : (loop ? 0 : frame);
+	t			= position - frame;
+	return t > 0.0f && nextFrame != frame;
+}
+
+void MeshAnimation::Sample(float time, JointTransform* output, bool loop) const {
+	if (frameCount == 0) {
+		return;
+	}
+	size_t	frame;
+	size_t	nextFrame;
+	float	t;
+	if (!GetFrameFraction(time, loop, frame, nextFrame, t)) {
+		const Matrix4* joints = GetJointData(frame);
+		for (size_t j = 0; j < jointCount; ++j) {
+			output[j] = JointTransform::FromMatrix(joints[j]);
+		}
+		return;
+	}
+	BlendFrames(GetJointData(frame), GetJointData(nextFrame), jointCount, t, output);
+}
+
+void MeshAnimation::Sample(float time, Matrix4* output, bool loop) const {
+	if (frameCount == 0) {
+		return;
+	}
+	size_t	frame;
+	size_t	nextFrame;
+	float	t;
+	if (!GetFrameFraction(time, loop, frame, nextFrame, t)) {
+		memcpy(output, GetJointData(frame), sizeof(Matrix4) * jointCount);
+		return;
+	}
+	BlendFrames(GetJointData(frame), GetJointData(nextFrame), jointCount, t, output);
+}
+
+bool MeshAnimation::LoadBinary(std::shared_ptr<MappedFile> file) {
+	const char* data = file->GetData();
+	size_t		size = file->GetSize();
+
+	BinaryAnimHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.version != BINARY_VERSION) {
+		std::cout << __FUNCTION__ << " Animation file has incompatible version!\n";
+		return false;
+	}
+	//Counts too large to address would wrap around to a small or empty frame size
+	if (header.jointCount != 0 && header.frameCount > (SIZE_MAX / sizeof(Matrix4)) / header.jointCount) {
+		std::cout << __FUNCTION__ << " Animation file has too many frames!\n";
+		return false;
+	}
+	uint64_t frameBytes = (uint64_t)header.jointCount * header.frameCount * sizeof(Matrix4);
+	bool	 compressed = (header.flags & FRAMES_COMPRESSED) != 0;
+	if (header.frameOffset % FRAME_ALIGNMENT != 0 || header.frameOffset > size || header.frameSize > size - header.frameOffset ||
+		(!compressed && header.frameSize != frameBytes)) {
+		std::cout << __FUNCTION__ << " Animation file has truncated frame data!\n";
+		return false;
+	}
+	if (header.nameCount != 0 && header.nameCount != header.jointCount) {
+		std::cout << __FUNCTION__ << " Animation file has the wrong number of joint names!\n";
+		return false;
+	}
+	std::vector<std::string> names(header.nameCount);
+	uint64_t offset		= header.namesOffset;
+	bool	 namesValid = true;
+	for (std::string& name : names) {
+		uint32_t length = 0;
+		if (offset > size || size - offset < sizeof(length)) {
+			namesValid = false;
+			break;
+		}
+		memcpy(&length, data + offset, sizeof(length));
+		offset += sizeof(length);
+		if (length > size - offset) {
+			namesValid = false;
+			break;
+		}
+		name.assign(data + offset, length);
+		offset += length;
+	}
+	if (!namesValid) {
+		std::cout << __FUNCTION__ << " Animation file has truncated joint names!\n";
+		return false;
+	}
+	//Compressed frames are expanded into memory, and the mapping is no longer needed
+	if (compressed) {
+		//Checked before allocating, as every block of frames needs an entry in the compressed header
+		size_t packedBytes = 0;
+		if (!ChunkCompression::GetDecompressedSize(data + header.frameOffset, (size_t)header.frameSize, packedBytes) ||
+			packedBytes != frameBytes || ChunkCompression::GetHeaderSize(packedBytes) > header.frameSize) {
+			std::cout << __FUNCTION__ << " Animation file has corrupt compressed frames!\n";
+			return false;
+		}
+		std::vector<Matrix4> frames((size_t)frameBytes / sizeof(Matrix4));
+		if (!ChunkCompression::Decompress(data + header.frameOffset, (size_t)header.frameSize, frames.data(), (size_t)frameBytes)) {
+			std::cout << __FUNCTION__ << " Animation file has corrupt compressed frames!\n";
+			return false;
+		}
+		allJoints = std::move(frames);
+	}
+	else {
+		mappedFrames	= (const Matrix4*)(data + header.frameOffset);
+		mappedFile		= file;
+	}
+	jointCount		= header.jointCount;
+	frameCount		= header.frameCount;
+	frameRate		= header.frameRate;
+	jointNames		= std::move(names);
+	return true;
+}
+
+bool MeshAnimation::SaveBinary(const std::string& filename, bool compress) const {
+	if (!jointNames.empty() && jointNames.size() != jointCount) {
+		std::cout << __FUNCTION__ << " can't save an animation with the wrong number of joint names!\n";
+		return false;
+	}
+	size_t		frameBytes	= jointCount * frameCount * sizeof(Matrix4);
+	const char* frames		= (const char*)GetFrames();
+
+	//Frames that don't shrink are left uncompressed, so they can still be mapped
+	std::string packed;
+	if (compress) {
+		ChunkCompression::Compress(frames, frameBytes, ChunkFilter::Shuffle4, packed);
+		compress = packed.size() < frameBytes;
+	}
+	size_t storedBytes = compress ? packed.size() : frameBytes;
 
-	Matrix4* dataStart = (Matrix4*)allJoints.data();
+	BinaryAnimHeader header;
+	header.magic		= BINARY_MAGIC;
+	header.version		= BINARY_VERSION;
+	header.jointCount	= (uint32_t)jointCount;
+	header.frameCount	= (uint32_t)frameCount;
+	header.frameRate	= frameRate;
+	header.nameCount	= (uint32_t)jointNames.size();
+	header.flags		= compress ? FRAMES_COMPRESSED : 0;
+	header.reserved		= 0;
+	header.frameOffset	= (sizeof(header) + FRAME_ALIGNMENT - 1) & ~(FRAME_ALIGNMENT - 1);
+	header.frameSize	= storedBytes;
+	header.namesOffset	= jointNames.empty() ? 0 : header.frameOffset + storedBytes;
 
-	return dataStart + matStart;
+	std::string output((size_t)header.frameOffset, 0);
+	memcpy(&output[0], &header, sizeof(header));
+	if (compress) {
+		output += packed;
+	}
+	else {
+		output.append(frames, frameBytes);
+	}
+	for (const std::string& name : jointNames) {
+		uint32_t length = (uint32_t)name.size();
+		output.append((const char*)&length, sizeof(length));
+		output += name;
+	}
+	std::ofstream file(filename, std::ios::binary);
+	file.write(output.data(), output.size());
+	if (!file) {
+		std::cout << __FUNCTION__ << " can't write to " << filename << "!\n";
+		return false;
+	}
+	return true;
 }
\ No newline at end of file
@@ -9,8 +9,11 @@ https://research.ncl.ac.uk/game/
 #pragma once
 #include "Vector.h"
 #include "Matrix.h"
+#include "MappedFile.h"
 
 namespace NCL::Rendering {
+	struct JointTransform;
+
 	using UniqueMeshAnim = std::unique_ptr<class MeshAnimation>;
 	using SharedMeshAnim = std::shared_ptr<class MeshAnimation>;
 
@@ -18,6 +21,8 @@ namespace NCL::Rendering {
 	public:
 		MeshAnimation();
 		MeshAnimation(size_t jointCount, size_t frameCount, float frameRate, std::vector<Maths::Matrix4>& frames, const std::vector<std::string>& jointNames = {});
+		//Loads either a text "MeshAnim" file, or a binary one, whose frames are read
+		//straight from the memory mapped file rather than being copied, unless compressed
 		MeshAnimation(const std::string& filename);
 
 		virtual ~MeshAnimation();
@@ -44,13 +49,45 @@ namespace NCL::Rendering {
 
 		const Maths::Matrix4* GetJointData(size_t frame) const;
 
+		//Interpolates between the frames either side of time, in seconds. Looping wraps time
+		//around the clip, blending the last frame back into the first, otherwise time is clamped.
+		//Output must have room for GetJointCount() entries. Assumes the frames have no shear.
+		void Sample(float time, JointTransform* output, bool loop = true) const;
+		void Sample(float time, Maths::Matrix4* output, bool loop = true) const;
+
+		const std::vector<std::string>& GetJointNames() const {
+			return jointNames;
+		}
+
+		//True if the frames are in a memory mapped binary file. Processes
+		//mapping the same file all share its physical pages.
+		bool IsMapped() const {
+			return mappedFile != nullptr;
+		}
+
+		//Filename is a full path, not relative to the mesh asset directory. Compressed
+		//frames take less space on disk, but are expanded into memory rather than mapped.
+		bool SaveBinary(const std::string& filename, bool compress = false) const;
+
 	protected:
+		bool LoadBinary(std::shared_ptr<MappedFile> file);
+
+		//Returns false if time lands exactly on a frame, so there's nothing to blend
+		bool GetFrameFraction(float time, bool loop, size_t& frame, size_t& nextFrame, float& t) const;
+
+		const Maths::Matrix4* GetFrames() const {
+			return mappedFrames ? mappedFrames : allJoints.data();
+		}
+
 		size_t		jointCount;
 		size_t		frameCount;
 		float		frameRate;
 
 		std::vector<Maths::Matrix4>		allJoints;
 		std::vector<std::string>		jointNames;
+
+		std::shared_ptr<MappedFile>		mappedFile;		//Shared by any copies of this animation
+		const Maths::Matrix4*			mappedFrames = nullptr;
 	};
 }
 
@@ -0,0 +1,709 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "MeshBVH.h"
+#include "Mesh.h"
+#include "Assets.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <cfloat>
+#include <cstring>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	const int		BIN_COUNT			= 16;
+	const uint32_t	BVH_FILE_MAGIC		= 0x4856424E; //"NBVH"
+	const uint32_t	BVH_FILE_VERSION	= 1;
+	const uint32_t	PARALLEL_BIN_COUNT	= 1 << 16;	//Ranges larger than this are binned across the pool
+	const uint32_t	MAX_TREE_DEPTH		= 60;		//Keeps the traversal stacks below a fixed size
+	const int		MAX_STACK_DEPTH		= 64;
+
+	struct AABB {
+		Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+		void Grow(const Vector3& p) {
+			for (int i = 0; i < 3; ++i) {
+				min[i] = std::min(min[i], p[i]);
+				max[i] = std::max(max[i], p[i]);
+			}
+		}
+
+		void Grow(const AABB& b) {
+			for (int i = 0; i < 3; ++i) {
+				min[i] = std::min(min[i], b.min[i]);
+				max[i] = std::max(max[i], b.max[i]);
+			}
+		}
+
+		float Area() const {
+			if (min.x > max.x) {
+				return 0.0f;
+			}
+			Vector3 e = max - min;
+			return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	};
+
+	struct Bin {
+		AABB		bounds;
+		uint32_t	count = 0;
+	};
+
+	struct BuildTask {
+		uint32_t node;
+		uint32_t first;
+		uint32_t count;
+		uint32_t depth;
+	};
+
+	struct BuildData {
+		std::vector<Vector3>	centroids;
+		std::vector<AABB>		triBounds;
+		std::vector<uint32_t>*	triIndices;
+		uint32_t				maxLeafTris;
+	};
+
+	int BinFor(const Vector3& centroid, int axis, const AABB& centroidBounds, float scale) {
+		int bin = (int)((centroid[axis] - centroidBounds.min[axis]) * scale);
+		return std::clamp(bin, 0, BIN_COUNT - 1);
+	}
+
+	void BinRange(const BuildData& d, uint32_t first, uint32_t count, const AABB& centroidBounds, const float scale[3], Bin bins[3][BIN_COUNT]) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t tri = (*d.triIndices)[i];
+			for (int axis = 0; axis < 3; ++axis) {
+				Bin& b = bins[axis][BinFor(d.centroids[tri], axis, centroidBounds, scale[axis])];
+				b.bounds.Grow(d.triBounds[tri]);
+				b.count++;
+			}
+		}
+	}
+
+	//Splits a range of triangles in two using the surface area heuristic, returning
+	//false if the range should become a leaf instead
+	bool SplitRange(const BuildData& d, const BuildTask& task, uint32_t& leftCount, AABB& leftBounds, AABB& rightBounds, bool parallel) {
+		if (task.count <= d.maxLeafTris || task.depth >= MAX_TREE_DEPTH) {
+			return false;
+		}
+		ThreadPool& pool = ThreadPool::GetGlobalPool();
+		std::mutex	mergeMutex;
+		parallel = parallel && task.count >= PARALLEL_BIN_COUNT;
+
+		AABB centroidBounds;
+		auto GrowCentroids = [&](size_t start, size_t end) {
+			AABB local;
+			for (size_t i = start; i < end; ++i) {
+				local.Grow(d.centroids[(*d.triIndices)[task.first + i]]);
+			}
+			std::unique_lock<std::mutex> lock(mergeMutex);
+			centroidBounds.Grow(local);
+		};
+		if (parallel) {
+			pool.ParallelFor(task.count, PARALLEL_BIN_COUNT / 4, GrowCentroids);
+		}
+		else {
+			GrowCentroids(0, task.count);
+		}
+
+		float scale[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+			scale[axis] = extent > 0.0f ? BIN_COUNT / extent : 0.0f;
+		}
+
+		Bin bins[3][BIN_COUNT];
+		if (parallel) {
+			pool.ParallelFor(task.count, PARALLEL_BIN_COUNT / 4, [&](size_t start, size_t end) {
+				Bin local[3][BIN_COUNT];
+				BinRange(d, task.first + (uint32_t)start, (uint32_t)(end - start), centroidBounds, scale, local);
+				std::unique_lock<std::mutex> lock(mergeMutex);
+				for (int axis = 0; axis < 3; ++axis) {
+					for (int i = 0; i < BIN_COUNT; ++i) {
+						bins[axis][i].bounds.Grow(local[axis][i].bounds);
+						bins[axis][i].count += local[axis][i].count;
+					}
+				}
+			});
+		}
+		else {
+			BinRange(d, task.first, task.count, centroidBounds, scale, bins);
+		}
+
+		float	bestCost	= FLT_MAX;
+		int		bestAxis	= -1;
+		int		bestSplit	= 0;
+
+		for (int axis = 0; axis < 3; ++axis) {
+			if (scale[axis] == 0.0f) {
+				continue;
+			}
+			float		rightArea[BIN_COUNT];
+			uint32_t	rightCount[BIN_COUNT];
+			AABB		rightAccum;
+			uint32_t	rightSum = 0;
+			for (int i = BIN_COUNT - 1; i > 0; --i) {
+				rightAccum.Grow(bins[axis][i].bounds);
+				rightSum += bins[axis][i].count;
+				rightArea[i]	= rightAccum.Area();
+				rightCount[i]	= rightSum;
+			}
+			AABB		leftAccum;
+			uint32_t	leftSum = 0;
+			for (int i = 0; i < BIN_COUNT - 1; ++i) {
+				leftAccum.Grow(bins[axis][i].bounds);
+				leftSum += bins[axis][i].count;
+				if (leftSum == 0 || rightCount[i + 1] == 0) {
+					continue;
+				}
+				float cost = leftAccum.Area() * leftSum + rightArea[i + 1] * rightCount[i + 1];
+				if (cost < bestCost) {
+					bestCost	= cost;
+					bestAxis	= axis;
+					bestSplit	= i;
+				}
+			}
+		}
+		if (bestAxis < 0) {
+			return false; //Every centroid is in the same place
+		}
+
+		std::vector<uint32_t>& tris = *d.triIndices;
+		auto mid = std::partition(tris.begin() + task.first, tris.begin() + task.first + task.count, [&](uint32_t tri) {
+			return BinFor(d.centroids[tri], bestAxis, centroidBounds, scale[bestAxis]) <= bestSplit;
+		});
+		leftCount = (uint32_t)(mid - (tris.begin() + task.first));
+
+		leftBounds	= AABB();
+		rightBounds = AABB();
+		for (int i = 0; i < BIN_COUNT; ++i) {
+			(i <= bestSplit ? leftBounds : rightBounds).Grow(bins[bestAxis][i].bounds);
+		}
+		return leftCount > 0 && leftCount < task.count;
+	}
+
+	void SetBounds(BVHNode& n, const AABB& b) {
+		n.boundsMin = b.min;
+		n.boundsMax = b.max;
+	}
+
+	//Subdivides every task on the stack. Tasks with no more than deferCount triangles
+	//are moved into deferred rather than being processed, if deferred is provided.
+	void BuildNodes(const BuildData& d, std::vector<BVHNode>& nodes, std::vector<BuildTask>& stack,
+		uint32_t deferCount, std::vector<BuildTask>* deferred, bool parallel) {
+		while (!stack.empty()) {
+			BuildTask task = stack.back();
+			stack.pop_back();
+
+			if (deferred && task.count <= deferCount) {
+				deferred->push_back(task);
+				continue;
+			}
+			uint32_t	leftCount = 0;
+			AABB		leftBounds;
+			AABB		rightBounds;
+
+			if (!SplitRange(d, task, leftCount, leftBounds, rightBounds, parallel)) {
+				nodes[task.node].leftFirst	= task.first;
+				nodes[task.node].triCount	= task.count;
+				continue;
+			}
+			uint32_t left = (uint32_t)nodes.size();
+			nodes.emplace_back();
+			nodes.emplace_back();
+			SetBounds(nodes[left], leftBounds);
+			SetBounds(nodes[left + 1], rightBounds);
+
+			nodes[task.node].leftFirst	= left;
+			nodes[task.node].triCount	= 0;
+
+			stack.push_back({ left + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 });
+			stack.push_back({ left,		task.first, leftCount, task.depth + 1 });
+		}
+	}
+
+	bool RayAABB(const Vector3& origin, const Vector3& invDir, const BVHNode& n, float maxDistance, float& entry) {
+		float tMin = 0.0f;
+		float tMax = maxDistance;
+		for (int i = 0; i < 3; ++i) {
+			float t1 = (n.boundsMin[i] - origin[i]) * invDir[i];
+			float t2 = (n.boundsMax[i] - origin[i]) * invDir[i];
+			tMin = std::max(tMin, std::min(t1, t2));
+			tMax = std::min(tMax, std::max(t1, t2));
+		}
+		entry = tMin;
+		return tMin <= tMax;
+	}
+
+	bool RayTriangle(const Vector3& origin, const Vector3& dir, const Vector3& a, const Vector3& b, const Vector3& c, float& t, float& u, float& v) {
+		Vector3 e1	= b - a;
+		Vector3 e2	= c - a;
+		Vector3 p	= Vector::Cross(dir, e2);
+		float det	= Vector::Dot(e1, p);
+		if (std::abs(det) < 1e-12f) {
+			return false;
+		}
+		float invDet = 1.0f / det;
+		Vector3 s = origin - a;
+		u = Vector::Dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+		Vector3 q = Vector::Cross(s, e1);
+		v = Vector::Dot(dir, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+		t = Vector::Dot(e2, q) * invDet;
+		return t >= 0.0f;
+	}
+
+	float DistanceSquaredToAABB(const Vector3& p, const BVHNode& n) {
+		float d = 0.0f;
+		for (int i = 0; i < 3; ++i) {
+			float v = std::clamp(p[i], n.boundsMin[i], n.boundsMax[i]) - p[i];
+			d += v * v;
+		}
+		return d;
+	}
+
+	//From Real-Time Collision Detection, Ericson 2005
+	Vector3 ClosestPointOnTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c) {
+		Vector3 ab = b - a;
+		Vector3 ac = c - a;
+		Vector3 ap = p - a;
+		float d1 = Vector::Dot(ab, ap);
+		float d2 = Vector::Dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) {
+			return a;
+		}
+		Vector3 bp = p - b;
+		float d3 = Vector::Dot(ab, bp);
+		float d4 = Vector::Dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) {
+			return b;
+		}
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+			return a + ab * (d1 / (d1 - d3));
+		}
+		Vector3 cp = p - c;
+		float d5 = Vector::Dot(ab, cp);
+		float d6 = Vector::Dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) {
+			return c;
+		}
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+			return a + ac * (d2 / (d2 - d6));
+		}
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+		float denom = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	struct BVHFileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t nodeCount;
+		uint32_t triCount;
+	};
+}
+
+MeshBVH::MeshBVH() {
+}
+
+MeshBVH::~MeshBVH() {
+}
+
+bool MeshBVH::Build(const Mesh& mesh, uint32_t maxLeafTris) {
+	nodes.clear();
+	triIndices.clear();
+	triPositions.clear();
+
+	if (mesh.GetPrimitiveType() != GeometryPrimitive::Triangles) {
+		std::cout << __FUNCTION__ << " can only build a BVH for triangle lists!\n";
+		return false;
+	}
+	const std::vector<Vector3>& positions = mesh.GetPositionData();
+	const uint32_t triCount = (uint32_t)mesh.GetPrimitiveCount();
+	if (triCount == 0) {
+		return false;
+	}
+
+	ThreadPool& pool = ThreadPool::GetGlobalPool();
+
+	BuildData d;
+	d.centroids.resize(triCount);
+	d.triBounds.resize(triCount);
+	d.triIndices	= &triIndices;
+	d.maxLeafTris	= std::max(maxLeafTris, 1u);
+
+	triIndices.resize(triCount);
+	triPositions.resize((size_t)triCount * 3);
+
+	std::atomic<bool> badIndex = false;
+	pool.ParallelFor(triCount, 4096, [&](size_t start, size_t end) {
+		for (size_t t = start; t < end; ++t) {
+			unsigned int a, b, c;
+			mesh.GetVertexIndicesForTri((unsigned int)t, a, b, c);
+			if (a >= positions.size() || b >= positions.size() || c >= positions.size()) {
+				badIndex = true;
+				continue;
+			}
+			AABB& bounds = d.triBounds[t];
+			bounds.Grow(positions[a]);
+			bounds.Grow(positions[b]);
+			bounds.Grow(positions[c]);
+			d.centroids[t]	= (positions[a] + positions[b] + positions[c]) / 3.0f;
+			triIndices[t]	= (uint32_t)t;
+		}
+	});
+	if (badIndex) {
+		std::cout << __FUNCTION__ << " mesh has an out of range index!\n";
+		triIndices.clear();
+		triPositions.clear();
+		return false;
+	}
+
+	AABB rootBounds;
+	for (const AABB& b : d.triBounds) {
+		rootBounds.Grow(b);
+	}
+	nodes.reserve((size_t)triCount * 2);
+	nodes.emplace_back();
+	SetBounds(nodes[0], rootBounds);
+
+	//The top of the tree is built serially (binning each node in parallel), until there
+	//are enough independent subtrees to keep every thread busy building one each.
+	uint32_t subtreeCount = std::max<uint32_t>(1024, triCount / ((pool.GetThreadCount() + 1) * 8));
+
+	std::vector<BuildTask> stack = { { 0, 0, triCount, 0 } };
+	std::vector<BuildTask> deferred;
+	BuildNodes(d, nodes, stack, subtreeCount, &deferred, true);
+
+	std::vector<std::vector<BVHNode>> subtrees(deferred.size());
+	pool.ParallelFor(deferred.size(), 1, [&](size_t start, size_t end) {
+		for (size_t i = start; i < end; ++i) {
+			std::vector<BVHNode>& local = subtrees[i];
+			local.reserve((size_t)deferred[i].count * 2);
+			local.push_back(nodes[deferred[i].node]);
+
+			std::vector<BuildTask> localStack = { { 0, deferred[i].first, deferred[i].count, deferred[i].depth } };
+			BuildNodes(d, local, localStack, 0, nullptr, false);
+		}
+	});
+
+	for (size_t i = 0; i < subtrees.size(); ++i) {
+		std::vector<BVHNode>& local = subtrees[i];
+		uint32_t offset = (uint32_t)nodes.size() - 1;
+		for (BVHNode& n : local) {
+			if (!n.IsLeaf()) {
+				n.leftFirst += offset;
+			}
+		}
+		nodes[deferred[i].node] = local[0];
+		nodes.insert(nodes.end(), local.begin() + 1, local.end());
+	}
+	nodes.shrink_to_fit();
+
+	pool.ParallelFor(triCount, 4096, [&](size_t start, size_t end) {
+		for (size_t slot = start; slot < end; ++slot) {
+			unsigned int a, b, c;
+			mesh.GetVertexIndicesForTri(triIndices[slot], a, b, c);
+			triPositions[slot * 3]		= positions[a];
+			triPositions[slot * 3 + 1]	= positions[b];
+			triPositions[slot * 3 + 2]	= positions[c];
+		}
+	});
+	return true;
+}
+
+bool MeshBVH::RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, BVHRayHit& hit) const {
+	if (nodes.empty()) {
+		return false;
+	}
+	Vector3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	float	closest = maxDistance;
+	bool	found	= false;
+	float	entry	= 0.0f;
+
+	uint32_t stack[MAX_STACK_DEPTH];
+	int		 stackSize = 0;
+
+	if (!RayAABB(origin, invDir, nodes[0], closest, entry)) {
+		return false;
+	}
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const BVHNode& n = nodes[stack[--stackSize]];
+		if (!RayAABB(origin, invDir, n, closest, entry)) {
+			continue;
+		}
+		if (n.IsLeaf()) {
+			for (uint32_t slot = n.leftFirst; slot < n.leftFirst + n.triCount; ++slot) {
+				Vector3 a, b, c;
+				GetTriangle(slot, a, b, c);
+				float t, u, v;
+				if (RayTriangle(origin, direction, a, b, c, t, u, v) && t <= closest) {
+					closest				= t;
+					found				= true;
+					hit.distance		= t;
+					hit.triangle		= triIndices[slot];
+					hit.barycentric		= Vector2(u, v);
+				}
+			}
+			continue;
+		}
+		float leftEntry		= 0.0f;
+		float rightEntry	= 0.0f;
+		bool  hitLeft	= RayAABB(origin, invDir, nodes[n.leftFirst], closest, leftEntry);
+		bool  hitRight	= RayAABB(origin, invDir, nodes[n.leftFirst + 1], closest, rightEntry);
+
+		//Push the far child first, so the near child is visited next
+		if (hitLeft && hitRight) {
+			bool leftFirst = leftEntry <= rightEntry;
+			stack[stackSize++] = leftFirst ? n.leftFirst + 1 : n.leftFirst;
+			stack[stackSize++] = leftFirst ? n.leftFirst : n.leftFirst + 1;
+		}
+		else if (hitLeft) {
+			stack[stackSize++] = n.leftFirst;
+		}
+		else if (hitRight) {
+			stack[stackSize++] = n.leftFirst + 1;
+		}
+	}
+	return found;
+}
+
+bool MeshBVH::RayCastAny(const Vector3& origin, const Vector3& direction, float maxDistance) const {
+	if (nodes.empty()) {
+		return false;
+	}
+	Vector3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	float	entry = 0.0f;
+
+	uint32_t stack[MAX_STACK_DEPTH];
+	int		 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const BVHNode& n = nodes[stack[--stackSize]];
+		if (!RayAABB(origin, invDir, n, maxDistance, entry)) {
+			continue;
+		}
+		if (n.IsLeaf()) {
+			for (uint32_t slot = n.leftFirst; slot < n.leftFirst + n.triCount; ++slot) {
+				Vector3 a, b, c;
+				GetTriangle(slot, a, b, c);
+				float t, u, v;
+				if (RayTriangle(origin, direction, a, b, c, t, u, v) && t <= maxDistance) {
+					return true;
+				}
+			}
+			continue;
+		}
+		stack[stackSize++] = n.leftFirst + 1;
+		stack[stackSize++] = n.leftFirst;
+	}
+	return false;
+}
+
+size_t MeshBVH::SphereOverlap(const Vector3& centre, float radius, std::vector<uint32_t>& triangles) const {
+	if (nodes.empty()) {
+		return 0;
+	}
+	size_t	found		= 0;
+	float	radiusSq	= radius * radius;
+
+	uint32_t stack[MAX_STACK_DEPTH];
+	int		 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const BVHNode& n = nodes[stack[--stackSize]];
+		if (DistanceSquaredToAABB(centre, n) > radiusSq) {
+			continue;
+		}
+		if (n.IsLeaf()) {
+			for (uint32_t slot = n.leftFirst; slot < n.leftFirst + n.triCount; ++slot) {
+				Vector3 a, b, c;
+				GetTriangle(slot, a, b, c);
+				if (Vector::LengthSquared(ClosestPointOnTriangle(centre, a, b, c) - centre) <= radiusSq) {
+					triangles.push_back(triIndices[slot]);
+					found++;
+				}
+			}
+			continue;
+		}
+		stack[stackSize++] = n.leftFirst + 1;
+		stack[stackSize++] = n.leftFirst;
+	}
+	return found;
+}
+
+bool MeshBVH::ClosestPoint(const Vector3& point, float maxDistance, Vector3& closest, uint32_t& triangle) const {
+	if (nodes.empty()) {
+		return false;
+	}
+	float	bestSq	= maxDistance * maxDistance;
+	bool	found	= false;
+
+	uint32_t stack[MAX_STACK_DEPTH];
+	int		 stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const BVHNode& n = nodes[stack[--stackSize]];
+		if (DistanceSquaredToAABB(point, n) > bestSq) {
+			continue;
+		}
+		if (n.IsLeaf()) {
+			for (uint32_t slot = n.leftFirst; slot < n.leftFirst + n.triCount; ++slot) {
+				Vector3 a, b, c;
+				GetTriangle(slot, a, b, c);
+				Vector3 p	= ClosestPointOnTriangle(point, a, b, c);
+				float	dSq = Vector::LengthSquared(p - point);
+				if (dSq <= bestSq) {
+					bestSq		= dSq;
+					closest		= p;
+					triangle	= triIndices[slot];
+					found		= true;
+				}
+			}
+			continue;
+		}
+		float leftSq	= DistanceSquaredToAABB(point, nodes[n.leftFirst]);
+		float rightSq	= DistanceSquaredToAABB(point, nodes[n.leftFirst + 1]);
+		bool  leftFirst = leftSq <= rightSq;
+		stack[stackSize++] = leftFirst ? n.leftFirst + 1 : n.leftFirst;
+		stack[stackSize++] = leftFirst ? n.leftFirst : n.leftFirst + 1;
+	}
+	return found;
+}
+
+void MeshBVH::Serialise(std::vector<char>& data) const {
+	BVHFileHeader header;
+	header.magic		= BVH_FILE_MAGIC;
+	header.version		= BVH_FILE_VERSION;
+	header.nodeCount	= (uint32_t)nodes.size();
+	header.triCount		= (uint32_t)triIndices.size();
+
+	size_t nodeBytes	 = nodes.size() * sizeof(BVHNode);
+	size_t indexBytes	 = triIndices.size() * sizeof(uint32_t);
+	size_t positionBytes = triPositions.size() * sizeof(Vector3);
+
+	data.resize(sizeof(header) + nodeBytes + indexBytes + positionBytes);
+	char* out = data.data();
+	memcpy(out, &header, sizeof(header));		out += sizeof(header);
+	memcpy(out, nodes.data(), nodeBytes);		out += nodeBytes;
+	memcpy(out, triIndices.data(), indexBytes);	out += indexBytes;
+	memcpy(out, triPositions.data(), positionBytes);
+}
+
+bool MeshBVH::Deserialise(const char* data, size_t size) {
+	BVHFileHeader header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != BVH_FILE_MAGIC || header.version != BVH_FILE_VERSION) {
+		std::cout << __FUNCTION__ << " data is not a compatible BVH!\n";
+		return false;
+	}
+	size_t nodeBytes	 = (size_t)header.nodeCount * sizeof(BVHNode);
+	size_t indexBytes	 = (size_t)header.triCount * sizeof(uint32_t);
+	size_t positionBytes = (size_t)header.triCount * 3 * sizeof(Vector3);
+
+	if (size < sizeof(header) + nodeBytes + indexBytes + positionBytes) {
+		std::cout << __FUNCTION__ << " BVH data is truncated!\n";
+		return false;
+	}
+	const char* in = data + sizeof(header);
+	std::vector<BVHNode> newNodes(header.nodeCount);
+	memcpy(newNodes.data(), in, nodeBytes);
+	in += nodeBytes;
+
+	if (!ValidateNodes(newNodes, header.triCount)) {
+		std::cout << __FUNCTION__ << " BVH data has an invalid hierarchy!\n";
+		return false;
+	}
+	nodes = std::move(newNodes);
+	triIndices.resize(header.triCount);
+	triPositions.resize((size_t)header.triCount * 3);
+
+	memcpy(triIndices.data(), in, indexBytes);	in += indexBytes;
+	memcpy(triPositions.data(), in, positionBytes);
+	return true;
+}
+
+bool MeshBVH::ValidateNodes(const std::vector<BVHNode>& checkNodes, uint32_t triCount) {
+	if (checkNodes.empty()) {
+		return triCount == 0;
+	}
+	//Every node must be reached exactly once, with its children and triangles in range,
+	//and the tree must be shallow enough for the traversal stacks
+	std::vector<bool> visited(checkNodes.size(), false);
+	std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+	visited[0] = true;
+	while (!stack.empty()) {
+		auto [index, depth] = stack.back();
+		stack.pop_back();
+		const BVHNode& n = checkNodes[index];
+		if (n.IsLeaf()) {
+			if ((uint64_t)n.leftFirst + n.triCount > triCount) {
+				return false;
+			}
+			continue;
+		}
+		if (depth >= MAX_TREE_DEPTH || n.leftFirst == 0 || (uint64_t)n.leftFirst + 1 >= checkNodes.size()) {
+			return false;
+		}
+		for (uint32_t child = n.leftFirst; child <= n.leftFirst + 1; ++child) {
+			if (visited[child]) {
+				return false;
+			}
+			visited[child] = true;
+			stack.push_back({ child, depth + 1 });
+		}
+	}
+	return std::find(visited.begin(), visited.end(), false) == visited.end();
+}
+
+bool MeshBVH::SaveToFile(const std::string& filename) const {
+	std::vector<char> data;
+	Serialise(data);
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		std::cout << __FUNCTION__ << " can't write file " << filename << "\n";
+		return false;
+	}
+	file.write(data.data(), data.size());
+	return true;
+}
+
+bool MeshBVH::LoadFromFile(const std::string& filename) {
+	char*	data = nullptr;
+	size_t	size = 0;
+	if (!Assets::ReadBinaryFile(Assets::MESHDIR + filename, &data, size)) {
+		return false;
+	}
+	bool result = Deserialise(data, size);
+	delete[] data;
+	return result;
+}
@@ -0,0 +1,86 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Vector.h"
+
+namespace NCL::Rendering {
+	class Mesh;
+	using namespace Maths;
+
+	//Interior nodes store the index of their left child, with the right child directly after it.
+	//Leaf nodes store the first triangle slot they cover, and how many triangles there are.
+	struct BVHNode {
+		Vector3		boundsMin;
+		uint32_t	leftFirst;
+		Vector3		boundsMax;
+		uint32_t	triCount;
+
+		bool IsLeaf() const {
+			return triCount > 0;
+		}
+	};
+
+	struct BVHRayHit {
+		float		distance	= 0.0f;
+		uint32_t	triangle	= 0;	//Index of the triangle in the source mesh
+		Vector2		barycentric;		//Weights of the triangle's 2nd and 3rd vertices
+	};
+
+	/*
+	A bounding volume hierarchy over a mesh's triangles, built using a binned
+	surface area heuristic. The BVH keeps its own copy of the triangle positions,
+	so it can be queried, saved and loaded without the source mesh.
+	*/
+	class MeshBVH {
+	public:
+		MeshBVH();
+		~MeshBVH();
+
+		bool Build(const Mesh& mesh, uint32_t maxLeafTris = 4);
+
+		//Finds the closest triangle hit by a ray within maxDistance. Direction must be normalised.
+		bool RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, BVHRayHit& hit) const;
+		//Returns as soon as any triangle is hit - useful for line of sight tests
+		bool RayCastAny(const Vector3& origin, const Vector3& direction, float maxDistance) const;
+
+		//Appends the mesh index of every triangle touching the sphere, returning how many were found
+		size_t SphereOverlap(const Vector3& centre, float radius, std::vector<uint32_t>& triangles) const;
+
+		//Finds the closest point on the mesh surface that is within maxDistance of point
+		bool ClosestPoint(const Vector3& point, float maxDistance, Vector3& closest, uint32_t& triangle) const;
+
+		void Serialise(std::vector<char>& data) const;
+		bool Deserialise(const char* data, size_t size);
+
+		bool SaveToFile(const std::string& filename) const;
+		bool LoadFromFile(const std::string& filename);
+
+		const std::vector<BVHNode>& GetNodes() const {
+			return nodes;
+		}
+
+		size_t GetTriangleCount() const {
+			return triIndices.size();
+		}
+
+	protected:
+		void GetTriangle(uint32_t slot, Vector3& a, Vector3& b, Vector3& c) const {
+			a = triPositions[slot * 3];
+			b = triPositions[slot * 3 + 1];
+			c = triPositions[slot * 3 + 2];
+		}
+
+		//Checks that loaded nodes form a tree that can be traversed without going out of bounds
+		static bool ValidateNodes(const std::vector<BVHNode>& checkNodes, uint32_t triCount);
+
+		std::vector<BVHNode>	nodes;
+		std::vector<uint32_t>	triIndices;		//Source mesh triangle for each slot
+		std::vector<Vector3>	triPositions;	//3 positions per slot, in BVH order
+	};
+}
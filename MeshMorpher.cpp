@@ -0,0 +1,123 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "MeshMorpher.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "SIMD.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	const size_t MORPH_BATCH_SIZE = 4096;
+
+	template<typename T>
+	void AddDeltas(T* out, const uint32_t* indices, const Vector3* deltas, size_t count, float weight) {
+		size_t i = 0;
+#ifdef NCL_SIMD_SSE
+		//Weight 4 deltas at a time, as 3 registers, before scattering them out
+		__m128 w = _mm_set1_ps(weight);
+		float weighted[12];
+		for (; i + 4 <= count; i += 4) {
+			const float* d = &deltas[i].x;
+			_mm_storeu_ps(weighted,		_mm_mul_ps(_mm_loadu_ps(d), w));
+			_mm_storeu_ps(weighted + 4, _mm_mul_ps(_mm_loadu_ps(d + 4), w));
+			_mm_storeu_ps(weighted + 8, _mm_mul_ps(_mm_loadu_ps(d + 8), w));
+			for (int j = 0; j < 4; ++j) {
+				T& o = out[indices[i + j]];
+				o.x += weighted[j * 3];
+				o.y += weighted[j * 3 + 1];
+				o.z += weighted[j * 3 + 2];
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			T& o = out[indices[i]];
+			o.x += deltas[i].x * weight;
+			o.y += deltas[i].y * weight;
+			o.z += deltas[i].z * weight;
+		}
+	}
+}
+
+bool MeshMorpher::Blend(const Mesh& mesh, const float* weights, size_t weightCount, Vector3* outPositions, Vector3* outNormals, Vector4* outTangents) {
+	size_t vertexCount = mesh.GetVertexCount();
+
+	const std::vector<Vector3>&		positions	= mesh.GetPositionData();
+	const std::vector<Vector3>&		normals		= mesh.GetNormalData();
+	const std::vector<Vector4>&		tangents	= mesh.GetTangentData();
+	const std::vector<MorphTarget>& targets		= mesh.GetMorphTargets();
+
+	if (!outPositions) {
+		std::cout << __FUNCTION__ << " no position output provided!\n";
+		return false;
+	}
+	if (normals.size() != vertexCount) {
+		outNormals = nullptr;
+	}
+	if (tangents.size() != vertexCount) {
+		outTangents = nullptr;
+	}
+
+	std::vector<const MorphTarget*> activeTargets;
+	std::vector<float>				activeWeights;
+	for (size_t i = 0; i < std::min(weightCount, targets.size()); ++i) {
+		if (weights[i] != 0.0f) {
+			activeTargets.push_back(&targets[i]);
+			activeWeights.push_back(weights[i]);
+		}
+	}
+
+	ThreadPool::GetGlobalPool().ParallelFor(vertexCount, MORPH_BATCH_SIZE, [&](size_t start, size_t end) {
+		std::copy(positions.begin() + start, positions.begin() + end, outPositions + start);
+		if (outNormals) {
+			std::copy(normals.begin() + start, normals.begin() + end, outNormals + start);
+		}
+		if (outTangents) {
+			std::copy(tangents.begin() + start, tangents.begin() + end, outTangents + start);
+		}
+
+		bool normalsChanged		= false;
+		bool tangentsChanged	= false;
+		for (size_t t = 0; t < activeTargets.size(); ++t) {
+			const MorphTarget& target = *activeTargets[t];
+
+			const uint32_t* first	= std::lower_bound(target.vertexIndices.data(), target.vertexIndices.data() + target.vertexIndices.size(), (uint32_t)start);
+			const uint32_t* last	= std::lower_bound(first, target.vertexIndices.data() + target.vertexIndices.size(), (uint32_t)end);
+			size_t offset			= first - target.vertexIndices.data();
+			size_t count			= last - first;
+			if (count == 0) {
+				continue;
+			}
+			AddDeltas(outPositions, first, target.positionDeltas.data() + offset, count, activeWeights[t]);
+
+			if (outNormals && !target.normalDeltas.empty()) {
+				AddDeltas(outNormals, first, target.normalDeltas.data() + offset, count, activeWeights[t]);
+				normalsChanged = true;
+			}
+			if (outTangents && !target.tangentDeltas.empty()) {
+				AddDeltas(outTangents, first, target.tangentDeltas.data() + offset, count, activeWeights[t]);
+				tangentsChanged = true;
+			}
+		}
+
+		if (normalsChanged) {
+			for (size_t v = start; v < end; ++v) {
+				outNormals[v] = Vector::Normalise(outNormals[v]);
+			}
+		}
+		if (tangentsChanged) {
+			for (size_t v = start; v < end; ++v) {
+				outTangents[v] = Vector4(Vector::Normalise(Vector3(outTangents[v])), outTangents[v].w);
+			}
+		}
+	});
+	return true;
+}
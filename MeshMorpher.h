@@ -0,0 +1,33 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Vector.h"
+
+namespace NCL::Rendering {
+	class Mesh;
+
+	/*
+	Blends a mesh's morph targets over its base vertex data on the CPU.
+
+	The output is split into vertex ranges which are processed in parallel. Each
+	range is copied from the base mesh once, and then every target with a non-zero
+	weight adds its weighted deltas for that range, found by binary search of the
+	target's sorted vertex indices. Blended normals and tangents are renormalised.
+	*/
+	class MeshMorpher {
+	public:
+		//weights holds one weight per morph target - any targets past weightCount are treated as 0
+		static bool Blend(const Mesh& mesh, const float* weights, size_t weightCount,
+			Maths::Vector3* outPositions, Maths::Vector3* outNormals = nullptr, Maths::Vector4* outTangents = nullptr);
+
+	protected:
+		MeshMorpher() {}
+		~MeshMorpher() {}
+	};
+}
@@ -0,0 +1,230 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "MeshRegistry.h"
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+using namespace NCL;
+using namespace Rendering;
+
+namespace {
+	struct RegistryState {
+		std::mutex						lock;
+		std::unordered_set<const Mesh*> meshes;
+		std::unordered_set<const Mesh*> loading;	//Registered, but hidden from the queries
+	};
+
+	//Never destroyed, so that meshes with static lifetimes can still unregister at exit
+	RegistryState& GetState() {
+		static RegistryState* state = new RegistryState();
+		return *state;
+	}
+
+	MeshRegistryEntry MakeEntry(const Mesh* mesh) {
+		MeshRegistryEntry e;
+		e.mesh		= mesh;
+		e.assetID	= mesh->GetAssetID();
+		e.name		= mesh->GetDebugName();
+		e.footprint = mesh->GetMemoryFootprint();
+		return e;
+	}
+
+	template<typename T>
+	uint64_t HashData(uint64_t hash, const std::vector<T>& data) {
+		const uint8_t* bytes = (const uint8_t*)data.data();
+		size_t size = data.size() * sizeof(T);
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	uint64_t HashGeometry(const Mesh& m) {
+		uint64_t hash = 0xCBF29CE484222325ull;
+		hash = HashData(hash, m.GetPositionData());
+		hash = HashData(hash, m.GetIndexData());
+		hash = HashData(hash, m.GetShortIndexData());
+		return hash;
+	}
+
+	template<typename T>
+	bool SameData(const std::vector<T>& a, const std::vector<T>& b) {
+		return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	bool SameGeometry(const Mesh& a, const Mesh& b) {
+		return	SameData(a.GetPositionData(),		b.GetPositionData())	&&
+				SameData(a.GetTextureCoordData(),	b.GetTextureCoordData())&&
+				SameData(a.GetNormalData(),			b.GetNormalData())		&&
+				SameData(a.GetTangentData(),		b.GetTangentData())		&&
+				SameData(a.GetColourData(),			b.GetColourData())		&&
+				SameData(a.GetSkinWeightData(),		b.GetSkinWeightData())	&&
+				SameData(a.GetSkinIndexData(),		b.GetSkinIndexData())	&&
+				SameData(a.GetIndexData(),			b.GetIndexData())		&&
+				SameData(a.GetShortIndexData(),		b.GetShortIndexData());
+	}
+}
+
+void MeshRegistry::Register(const Mesh* mesh) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	state.meshes.insert(mesh);
+}
+
+void MeshRegistry::Unregister(const Mesh* mesh) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	state.meshes.erase(mesh);
+	state.loading.erase(mesh);
+}
+
+void MeshRegistry::SetLoading(const Mesh* mesh, bool loading) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	std::unordered_set<const Mesh*>& from	= loading ? state.meshes	: state.loading;
+	std::unordered_set<const Mesh*>& to		= loading ? state.loading	: state.meshes;
+	if (from.erase(mesh) > 0) {
+		to.insert(mesh);
+	}
+}
+
+size_t MeshRegistry::GetMeshCount() {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	return state.meshes.size();
+}
+
+void MeshRegistry::GetEntries(std::vector<MeshRegistryEntry>& entries) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	entries.clear();
+	entries.reserve(state.meshes.size());
+	for (const Mesh* m : state.meshes) {
+		entries.push_back(MakeEntry(m));
+	}
+}
+
+MeshMemoryFootprint MeshRegistry::GetTotalFootprint() {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	MeshMemoryFootprint total;
+	for (const Mesh* m : state.meshes) {
+		total += m->GetMemoryFootprint();
+	}
+	return total;
+}
+
+void MeshRegistry::GetLargest(size_t count, std::vector<MeshRegistryEntry>& entries) {
+	GetEntries(entries);
+	count = std::min(count, entries.size());
+	std::partial_sort(entries.begin(), entries.begin() + count, entries.end(), [](const MeshRegistryEntry& a, const MeshRegistryEntry& b) {
+		return a.footprint.GetTotal() > b.footprint.GetTotal();
+	});
+	entries.resize(count);
+}
+
+void MeshRegistry::GetDuplicates(std::vector<std::vector<MeshRegistryEntry>>& groups) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	groups.clear();
+
+	std::unordered_map<uint64_t, std::vector<const Mesh*>> byHash;
+	for (const Mesh* m : state.meshes) {
+		if (m->GetVertexCount() > 0) {
+			byHash[HashGeometry(*m)].push_back(m);
+		}
+	}
+	for (auto& [hash, meshes] : byHash) {
+		//Hashes can collide, so each candidate is checked against the groups found so far
+		std::vector<std::vector<const Mesh*>> matches;
+		for (const Mesh* m : meshes) {
+			bool placed = false;
+			for (std::vector<const Mesh*>& group : matches) {
+				if (SameGeometry(*group[0], *m)) {
+					group.push_back(m);
+					placed = true;
+					break;
+				}
+			}
+			if (!placed) {
+				matches.push_back({ m });
+			}
+		}
+		for (const std::vector<const Mesh*>& group : matches) {
+			if (group.size() < 2) {
+				continue;
+			}
+			std::vector<MeshRegistryEntry>& entries = groups.emplace_back();
+			for (const Mesh* m : group) {
+				entries.push_back(MakeEntry(m));
+			}
+		}
+	}
+}
+
+const Mesh* MeshRegistry::FindByAssetID(uint32_t assetID) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	for (const Mesh* m : state.meshes) {
+		if (m->GetAssetID() == assetID) {
+			return m;
+		}
+	}
+	return nullptr;
+}
+
+const Mesh* MeshRegistry::FindByName(const std::string& name) {
+	RegistryState& state = GetState();
+	std::unique_lock<std::mutex> lock(state.lock);
+	for (const Mesh* m : state.meshes) {
+		if (m->GetDebugName() == name) {
+			return m;
+		}
+	}
+	return nullptr;
+}
+
+void MeshRegistry::PrintReport(std::ostream& output, size_t largestCount) {
+	MeshMemoryFootprint total = GetTotalFootprint();
+
+	output << "Mesh memory: " << GetMeshCount() << " meshes, " << total.GetTotal() << " bytes\n";
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		if (total.attributes[i] > 0) {
+			output << "\t" << VertexAttribute::Names[i] << ": " << total.attributes[i] << "\n";
+		}
+	}
+	output << "\tIndices: "			<< total.indices		<< "\n";
+	output << "\tSub-meshes: "		<< total.subMeshes		<< "\n";
+	output << "\tSkeleton: "		<< total.skeleton		<< "\n";
+	output << "\tBind poses: "		<< total.bindPoses		<< "\n";
+	output << "\tMorph targets: "	<< total.morphTargets	<< "\n";
+	output << "\tCached data: "		<< total.cachedData		<< "\n";
+
+	std::vector<MeshRegistryEntry> largest;
+	GetLargest(largestCount, largest);
+	output << "Largest meshes:\n";
+	for (const MeshRegistryEntry& e : largest) {
+		output << "\t" << e.footprint.GetTotal() << " bytes - " << e.name << " (asset " << e.assetID << ")\n";
+	}
+
+	std::vector<std::vector<MeshRegistryEntry>> duplicates;
+	GetDuplicates(duplicates);
+	if (!duplicates.empty()) {
+		output << "Duplicated meshes:\n";
+		for (const std::vector<MeshRegistryEntry>& group : duplicates) {
+			output << "\t" << group.size() << " copies, wasting " << group[0].footprint.GetTotal() * (group.size() - 1) << " bytes -";
+			for (const MeshRegistryEntry& e : group) {
+				output << " " << e.name << " (asset " << e.assetID << ")";
+			}
+			output << "\n";
+		}
+	}
+}
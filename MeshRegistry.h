@@ -0,0 +1,61 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Mesh.h"
+
+namespace NCL::Rendering {
+	struct MeshRegistryEntry {
+		const Mesh*			mesh	= nullptr;
+		uint32_t			assetID	= 0;
+		std::string			name;
+		MeshMemoryFootprint footprint;
+	};
+
+	/*
+	Tracks every live Mesh in the process - meshes add themselves on construction
+	and remove themselves on destruction - so that memory use can be inspected.
+
+	Registration is thread safe, but the queries read each mesh's data without
+	locking the mesh. A mesh being filled in on another thread must be marked as
+	loading, which hides it from the queries until it's done - AsyncLoader does this
+	for the meshes it loads. Otherwise, only modify registered meshes on the thread
+	that runs the queries.
+	*/
+	class MeshRegistry {
+	public:
+		static void Register(const Mesh* mesh);
+		static void Unregister(const Mesh* mesh);
+
+		//Loading meshes are left out of every query, including GetMeshCount
+		static void SetLoading(const Mesh* mesh, bool loading);
+
+		static size_t GetMeshCount();
+
+		//Entries are in no particular order
+		static void GetEntries(std::vector<MeshRegistryEntry>& entries);
+
+		static MeshMemoryFootprint GetTotalFootprint();
+
+		//Fills entries with the count meshes using the most memory, largest first
+		static void GetLargest(size_t count, std::vector<MeshRegistryEntry>& entries);
+
+		//Groups meshes whose vertex and index data is identical. Only groups of 2 or more are returned.
+		static void GetDuplicates(std::vector<std::vector<MeshRegistryEntry>>& groups);
+
+		//Returns nullptr if no registered mesh matches
+		static const Mesh* FindByAssetID(uint32_t assetID);
+		static const Mesh* FindByName(const std::string& name);
+
+		static void PrintReport(std::ostream& output, size_t largestCount = 10);
+
+	protected:
+		MeshRegistry() {}
+		~MeshRegistry() {}
+	};
+}
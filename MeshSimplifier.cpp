@@ -0,0 +1,384 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "MeshSimplifier.h"
+#include "Mesh.h"
+#include "Camera.h"
+#include "Maths.h"
+
+#include <cfloat>
+#include <queue>
+#include <unordered_map>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	//Symmetric 4x4 matrix representing the sum of squared distances to a set of planes
+	struct Quadric {
+		double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		double b2 = 0.0, bc = 0.0, bd = 0.0;
+		double c2 = 0.0, cd = 0.0;
+		double d2 = 0.0;
+		double weight = 0.0;
+
+		void AddPlane(double a, double b, double c, double d, double w) {
+			a2 += a * a * w; ab += a * b * w; ac += a * c * w; ad += a * d * w;
+			b2 += b * b * w; bc += b * c * w; bd += b * d * w;
+			c2 += c * c * w; cd += c * d * w;
+			d2 += d * d * w;
+			weight += w;
+		}
+
+		Quadric& operator+=(const Quadric& q) {
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			weight += q.weight;
+			return *this;
+		}
+
+		double Evaluate(const Vector3& p) const {
+			double x = p.x;
+			double y = p.y;
+			double z = p.z;
+			return	a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+					b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+					c2 * z * z + 2.0 * cd * z +
+					d2;
+		}
+	};
+
+	struct Collapse {
+		double		cost;
+		uint32_t	from;
+		uint32_t	to;
+		uint32_t	fromVersion;
+		uint32_t	toVersion;
+
+		bool operator>(const Collapse& c) const {
+			return cost > c.cost;
+		}
+	};
+
+	uint64_t EdgeKey(uint32_t a, uint32_t b) {
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+}
+
+bool MeshSimplifier::GenerateLODs(const Mesh& mesh, const std::vector<float>& ratios, std::vector<MeshLOD>& lods) {
+	if (mesh.GetPrimitiveType() != GeometryPrimitive::Triangles) {
+		std::cout << __FUNCTION__ << " can only simplify triangle lists!\n";
+		return false;
+	}
+	const std::vector<Vector3>&		positions	= mesh.GetPositionData();
+	const std::vector<Vector4>&		skinWeights = mesh.GetSkinWeightData();
+	const std::vector<Vector4i>&	skinIndices = mesh.GetSkinIndexData();
+
+	const uint32_t vertexCount = (uint32_t)positions.size();
+
+	if (vertexCount == 0) {
+		std::cout << __FUNCTION__ << " mesh has no vertex positions!\n";
+		return false;
+	}
+
+	std::vector<unsigned int> sourceIndices(mesh.GetIndexCount());
+	for (size_t i = 0; i < sourceIndices.size(); ++i) {
+		sourceIndices[i] = mesh.GetIndex(i);
+	}
+	if (sourceIndices.empty()) {
+		sourceIndices.resize(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			sourceIndices[i] = i;
+		}
+	}
+
+	std::vector<SubMesh> subMeshes;
+	for (size_t i = 0; i < mesh.GetSubMeshCount(); ++i) {
+		subMeshes.push_back(*mesh.GetSubMesh((unsigned int)i));
+	}
+	if (subMeshes.empty()) {
+		subMeshes.push_back({ 0, (int)sourceIndices.size(), 0 });
+	}
+
+	//Gather every triangle in absolute vertex indices, in sub-mesh order
+	std::vector<uint32_t> triVerts;
+	std::vector<size_t>	  subMeshTriStart;
+
+	for (const SubMesh& s : subMeshes) {
+		subMeshTriStart.push_back(triVerts.size() / 3);
+		for (int i = 0; i + 2 < s.count; i += 3) {
+			for (int j = 0; j < 3; ++j) {
+				size_t   entry	= (size_t)s.start + i + j;
+				uint32_t v		= entry < sourceIndices.size() ? sourceIndices[entry] + s.base : vertexCount;
+				if (v >= vertexCount) {
+					std::cout << __FUNCTION__ << " mesh has an out of range index!\n";
+					return false;
+				}
+				triVerts.push_back(v);
+			}
+		}
+	}
+	subMeshTriStart.push_back(triVerts.size() / 3);
+
+	const size_t triCount = triVerts.size() / 3;
+
+	std::vector<bool>		triAlive(triCount, true);
+	std::vector<bool>		locked(vertexCount, false);
+	std::vector<bool>		removed(vertexCount, false);
+	std::vector<uint32_t>	version(vertexCount, 0);
+	std::vector<Quadric>	quadrics(vertexCount);
+	std::vector<std::vector<uint32_t>> vertexTris(vertexCount);
+
+	//Vertices that share a position with another vertex sit on a UV / normal seam
+	std::vector<uint32_t> welded;
+	{
+		std::vector<uint32_t> groupSize(vertexCount, 0);
+		mesh.GetPositionWeldMap(welded);
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			groupSize[welded[v]]++;
+		}
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			locked[v] = groupSize[welded[v]] > 1;
+		}
+	}
+
+	//Edges only used once (or more than twice) are open borders or non-manifold
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		edgeUses.reserve(triCount * 3);
+		for (size_t t = 0; t < triCount; ++t) {
+			for (int e = 0; e < 3; ++e) {
+				edgeUses[EdgeKey(welded[triVerts[t * 3 + e]], welded[triVerts[t * 3 + (e + 1) % 3]])]++;
+			}
+		}
+		for (size_t t = 0; t < triCount; ++t) {
+			for (int e = 0; e < 3; ++e) {
+				uint32_t a = triVerts[t * 3 + e];
+				uint32_t b = triVerts[t * 3 + (e + 1) % 3];
+				if (edgeUses[EdgeKey(welded[a], welded[b])] != 2) {
+					locked[a] = true;
+					locked[b] = true;
+				}
+			}
+		}
+	}
+
+	//Vertices referenced by more than one sub-mesh pin the boundary between them
+	{
+		std::vector<int> owner(vertexCount, -1);
+		for (size_t s = 0; s < subMeshes.size(); ++s) {
+			for (size_t i = subMeshTriStart[s] * 3; i < subMeshTriStart[s + 1] * 3; ++i) {
+				uint32_t v = triVerts[i];
+				if (owner[v] >= 0 && owner[v] != (int)s) {
+					locked[v] = true;
+				}
+				owner[v] = (int)s;
+			}
+		}
+	}
+
+	for (size_t t = 0; t < triCount; ++t) {
+		const uint32_t* tri = &triVerts[t * 3];
+		Vector3 n		= Vector::Cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+		float	length	= Vector::Length(n);
+
+		for (int i = 0; i < 3; ++i) {
+			vertexTris[tri[i]].push_back((uint32_t)t);
+		}
+		if (length <= 0.0f) {
+			continue;
+		}
+		n = n / length;
+		double d = -Vector::Dot(n, positions[tri[0]]);
+		for (int i = 0; i < 3; ++i) {
+			quadrics[tri[i]].AddPlane(n.x, n.y, n.z, d, length * 0.5);
+		}
+	}
+
+	auto CanMerge = [&](uint32_t from, uint32_t to) {
+		if (skinIndices.size() != vertexCount) {
+			return true;
+		}
+		for (int i = 0; i < 4; ++i) {
+			if (skinIndices[from][i] != skinIndices[to][i]) {
+				return false;
+			}
+			if (skinWeights.size() == vertexCount && std::abs(skinWeights[from][i] - skinWeights[to][i]) > 0.05f) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+
+	auto PushCollapse = [&](uint32_t from, uint32_t to) {
+		if (locked[from] || removed[from] || removed[to] || !CanMerge(from, to)) {
+			return;
+		}
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		collapses.push({ q.Evaluate(positions[to]), from, to, version[from], version[to] });
+	};
+
+	auto PushVertex = [&](uint32_t from) {
+		for (uint32_t t : vertexTris[from]) {
+			if (!triAlive[t]) {
+				continue;
+			}
+			for (int i = 0; i < 3; ++i) {
+				uint32_t to = triVerts[t * 3 + i];
+				if (to != from) {
+					PushCollapse(from, to);
+				}
+			}
+		}
+	};
+
+	//Moving 'from' onto 'to' must not turn any surviving triangle inside out
+	auto CollapseFlips = [&](uint32_t from, uint32_t to) {
+		for (uint32_t t : vertexTris[from]) {
+			if (!triAlive[t]) {
+				continue;
+			}
+			const uint32_t* tri = &triVerts[t * 3];
+			if (tri[0] == to || tri[1] == to || tri[2] == to) {
+				continue;
+			}
+			Vector3 oldPos[3];
+			Vector3 newPos[3];
+			for (int i = 0; i < 3; ++i) {
+				oldPos[i] = positions[tri[i]];
+				newPos[i] = tri[i] == from ? positions[to] : oldPos[i];
+			}
+			Vector3 oldNormal = Vector::Cross(oldPos[1] - oldPos[0], oldPos[2] - oldPos[0]);
+			Vector3 newNormal = Vector::Cross(newPos[1] - newPos[0], newPos[2] - newPos[0]);
+			if (Vector::Dot(oldNormal, newNormal) <= 0.0f) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		PushVertex(v);
+	}
+
+	auto EmitLOD = [&](float ratio, float error) {
+		MeshLOD lod;
+		lod.targetRatio = ratio;
+		lod.error		= error;
+		for (size_t s = 0; s < subMeshes.size(); ++s) {
+			SubMesh out = subMeshes[s];
+			out.start = (int)lod.indices.size();
+			for (size_t t = subMeshTriStart[s]; t < subMeshTriStart[s + 1]; ++t) {
+				if (!triAlive[t]) {
+					continue;
+				}
+				for (int i = 0; i < 3; ++i) {
+					lod.indices.push_back(triVerts[t * 3 + i] - out.base);
+				}
+			}
+			out.count = (int)lod.indices.size() - out.start;
+			lod.subMeshes.push_back(out);
+		}
+		lods.emplace_back(std::move(lod));
+	};
+
+	lods.clear();
+	EmitLOD(1.0f, 0.0f);
+
+	std::vector<float> sortedRatios = ratios;
+	std::sort(sortedRatios.begin(), sortedRatios.end(), std::greater<float>());
+
+	size_t	liveTris = triCount;
+	float	maxError = 0.0f;
+
+	for (float ratio : sortedRatios) {
+		size_t targetTris = (size_t)(triCount * std::clamp(ratio, 0.0f, 1.0f));
+
+		while (liveTris > targetTris && !collapses.empty()) {
+			Collapse c = collapses.top();
+			collapses.pop();
+
+			if (removed[c.from] || removed[c.to] ||
+				version[c.from] != c.fromVersion || version[c.to] != c.toVersion) {
+				continue;
+			}
+			if (CollapseFlips(c.from, c.to)) {
+				continue;
+			}
+			for (uint32_t t : vertexTris[c.from]) {
+				if (!triAlive[t]) {
+					continue;
+				}
+				uint32_t* tri = &triVerts[t * 3];
+				if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+					triAlive[t] = false;
+					liveTris--;
+					continue;
+				}
+				for (int i = 0; i < 3; ++i) {
+					if (tri[i] == c.from) {
+						tri[i] = c.to;
+					}
+				}
+				vertexTris[c.to].push_back(t);
+			}
+			double weight = quadrics[c.from].weight + quadrics[c.to].weight;
+			if (weight > 0.0) {
+				maxError = std::max(maxError, (float)std::sqrt(std::max(0.0, c.cost) / weight));
+			}
+			removed[c.from] = true;
+			vertexTris[c.from].clear();
+
+			quadrics[c.to] += quadrics[c.from];
+			version[c.to]++;
+
+			std::vector<uint32_t>& toTris = vertexTris[c.to];
+			toTris.erase(std::remove_if(toTris.begin(), toTris.end(), [&](uint32_t t) { return !triAlive[t]; }), toTris.end());
+
+			PushVertex(c.to);
+			for (uint32_t t : toTris) {
+				for (int i = 0; i < 3; ++i) {
+					uint32_t n = triVerts[t * 3 + i];
+					if (n != c.to) {
+						PushCollapse(n, c.to);
+					}
+				}
+			}
+		}
+		EmitLOD(ratio, maxError);
+	}
+	return true;
+}
+
+float MeshSimplifier::ProjectedError(float error, float distance, float fov, float screenHeight) {
+	if (distance <= 0.0f) {
+		return FLT_MAX;
+	}
+	float halfFovTan = tan(Maths::DegreesToRadians(fov) * 0.5f);
+	return (error / (distance * halfFovTan)) * screenHeight * 0.5f;
+}
+
+size_t MeshSimplifier::SelectLOD(const std::vector<MeshLOD>& lods, const PerspectiveCamera& camera,
+	const Vector3& worldPosition, float worldScale, float screenHeight, float maxPixelError) {
+	float distance = Vector::Length(worldPosition - camera.GetPosition());
+
+	size_t selected = 0;
+	for (size_t i = 1; i < lods.size(); ++i) {
+		if (ProjectedError(lods[i].error * worldScale, distance, camera.GetFieldOfVision(), screenHeight) > maxPixelError) {
+			break;
+		}
+		selected = i;
+	}
+	return selected;
+}
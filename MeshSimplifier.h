@@ -0,0 +1,56 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Vector.h"
+#include "Mesh.h"
+
+namespace NCL {
+	class PerspectiveCamera;
+}
+
+namespace NCL::Rendering {
+	/*
+	A single level of detail for a mesh. The indices are laid out per sub-mesh,
+	in the same order as the source mesh, and remain relative to each sub-mesh's
+	base vertex, so they can be used with the source mesh's vertex data as-is.
+	*/
+	struct MeshLOD {
+		float					targetRatio = 1.0f;	//Fraction of the source triangle count that was asked for
+		float					error		= 0.0f;	//Geometric deviation from the source mesh, in mesh units
+		std::vector<unsigned int>	indices;
+		std::vector<SubMesh>		subMeshes;
+	};
+
+	/*
+	Builds a chain of LODs using edge collapses driven by a quadric error metric.
+	Vertices are only ever collapsed onto one of their neighbours, so no new vertex
+	data is created - each LOD is just a new index buffer.
+
+	Vertices on open borders, on attribute seams (multiple vertices sharing a
+	position), or shared between sub-meshes are locked in place, and vertices
+	with differing skin influences are never merged.
+	*/
+	class MeshSimplifier {
+	public:
+		//Fills lods with the source mesh (as LOD 0) followed by one LOD per ratio.
+		//Ratios should be in the range 0 to 1 - they are processed from largest to smallest.
+		static bool GenerateLODs(const Mesh& mesh, const std::vector<float>& ratios, std::vector<MeshLOD>& lods);
+
+		//Projects the error of each LOD onto the screen, and returns the coarsest LOD
+		//whose projected error is within maxPixelError. screenHeight is in pixels.
+		static size_t SelectLOD(const std::vector<MeshLOD>& lods, const PerspectiveCamera& camera,
+			const Maths::Vector3& worldPosition, float worldScale, float screenHeight, float maxPixelError = 1.0f);
+
+		static float ProjectedError(float error, float distance, float fov, float screenHeight);
+
+	protected:
+		MeshSimplifier() {}
+		~MeshSimplifier() {}
+	};
+}
@@ -0,0 +1,176 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "MeshSkinner.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "SIMD.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	const size_t SKINNING_BATCH_SIZE = 2048;
+
+#ifdef NCL_SIMD_SSE
+	struct BlendedMatrix {
+		__m128 columns[4];
+	};
+
+	//Returns false if the vertex has no valid influences
+	bool BlendJoints(const Matrix4* palette, size_t paletteSize, const Vector4& weights, const Vector4i& joints, BlendedMatrix& out) {
+		bool influenced = false;
+		for (int i = 0; i < 4; ++i) {
+			float w = weights[i];
+			if (w == 0.0f || joints[i] < 0 || (size_t)joints[i] >= paletteSize) {
+				continue;
+			}
+			const float* m	= &palette[joints[i]].array[0][0];
+			__m128 vw		= _mm_set1_ps(w);
+			if (!influenced) {
+				for (int c = 0; c < 4; ++c) {
+					out.columns[c] = _mm_mul_ps(_mm_loadu_ps(m + c * 4), vw);
+				}
+				influenced = true;
+			}
+			else {
+				for (int c = 0; c < 4; ++c) {
+					out.columns[c] = _mm_add_ps(out.columns[c], _mm_mul_ps(_mm_loadu_ps(m + c * 4), vw));
+				}
+			}
+		}
+		return influenced;
+	}
+
+	__m128 TransformDirection(const BlendedMatrix& m, float x, float y, float z) {
+		__m128 r = _mm_mul_ps(m.columns[0], _mm_set1_ps(x));
+		r = _mm_add_ps(r, _mm_mul_ps(m.columns[1], _mm_set1_ps(y)));
+		r = _mm_add_ps(r, _mm_mul_ps(m.columns[2], _mm_set1_ps(z)));
+		return r;
+	}
+
+	Vector3 ToVector3(__m128 v) {
+		float f[4];
+		_mm_storeu_ps(f, v);
+		return Vector3(f[0], f[1], f[2]);
+	}
+#else
+	bool BlendJoints(const Matrix4* palette, size_t paletteSize, const Vector4& weights, const Vector4i& joints, Matrix4& out) {
+		bool influenced = false;
+		for (int i = 0; i < 4; ++i) {
+			float w = weights[i];
+			if (w == 0.0f || joints[i] < 0 || (size_t)joints[i] >= paletteSize) {
+				continue;
+			}
+			const Matrix4& m = palette[joints[i]];
+			for (int c = 0; c < 4; ++c) {
+				for (int r = 0; r < 4; ++r) {
+					out.array[c][r] = (influenced ? out.array[c][r] : 0.0f) + m.array[c][r] * w;
+				}
+			}
+			influenced = true;
+		}
+		return influenced;
+	}
+
+	Vector3 TransformDirection(const Matrix4& m, const Vector3& v) {
+		return Vector3(
+			m.array[0][0] * v.x + m.array[1][0] * v.y + m.array[2][0] * v.z,
+			m.array[0][1] * v.x + m.array[1][1] * v.y + m.array[2][1] * v.z,
+			m.array[0][2] * v.x + m.array[1][2] * v.y + m.array[2][2] * v.z
+		);
+	}
+#endif
+}
+
+void MeshSkinner::BuildPalette(const Mesh& mesh, const Matrix4* joints, size_t jointCount, std::vector<Matrix4>& palette) {
+	const std::vector<Matrix4>& invBindPose = mesh.GetInverseBindPose();
+	palette.resize(jointCount);
+	for (size_t i = 0; i < jointCount; ++i) {
+		palette[i] = i < invBindPose.size() ? joints[i] * invBindPose[i] : joints[i];
+	}
+}
+
+bool MeshSkinner::Skin(const Mesh& mesh, const Matrix4* joints, size_t jointCount, Vector3* outPositions, Vector3* outNormals, Vector4* outTangents) {
+	if (!joints) {
+		std::cout << __FUNCTION__ << " no joint data provided!\n";
+		return false;
+	}
+	std::vector<Matrix4> palette;
+	BuildPalette(mesh, joints, jointCount, palette);
+	return SkinWithPalette(mesh, palette.data(), palette.size(), outPositions, outNormals, outTangents);
+}
+
+bool MeshSkinner::SkinWithPalette(const Mesh& mesh, const Matrix4* palette, size_t paletteSize, Vector3* outPositions, Vector3* outNormals, Vector4* outTangents) {
+	size_t vertexCount = mesh.GetVertexCount();
+
+	const std::vector<Vector3>&		positions	= mesh.GetPositionData();
+	const std::vector<Vector3>&		normals		= mesh.GetNormalData();
+	const std::vector<Vector4>&		tangents	= mesh.GetTangentData();
+	const std::vector<Vector4>&		weights		= mesh.GetSkinWeightData();
+	const std::vector<Vector4i>&	joints		= mesh.GetSkinIndexData();
+
+	if (weights.size() != vertexCount || joints.size() != vertexCount) {
+		std::cout << __FUNCTION__ << " mesh has no skinning data!\n";
+		return false;
+	}
+	if (!outPositions || !palette) {
+		std::cout << __FUNCTION__ << " no position output or joint palette provided!\n";
+		return false;
+	}
+	if (normals.size() != vertexCount) {
+		outNormals = nullptr;
+	}
+	if (tangents.size() != vertexCount) {
+		outTangents = nullptr;
+	}
+
+	ThreadPool::GetGlobalPool().ParallelFor(vertexCount, SKINNING_BATCH_SIZE, [&](size_t start, size_t end) {
+		for (size_t v = start; v < end; ++v) {
+#ifdef NCL_SIMD_SSE
+			BlendedMatrix m;
+			if (!BlendJoints(palette, paletteSize, weights[v], joints[v], m)) {
+				outPositions[v] = positions[v];
+				if (outNormals)  { outNormals[v]  = normals[v]; }
+				if (outTangents) { outTangents[v] = tangents[v]; }
+				continue;
+			}
+			const Vector3& p = positions[v];
+			outPositions[v] = ToVector3(_mm_add_ps(TransformDirection(m, p.x, p.y, p.z), m.columns[3]));
+
+			if (outNormals) {
+				const Vector3& n = normals[v];
+				outNormals[v] = Vector::Normalise(ToVector3(TransformDirection(m, n.x, n.y, n.z)));
+			}
+			if (outTangents) {
+				const Vector4& t = tangents[v];
+				outTangents[v] = Vector4(Vector::Normalise(ToVector3(TransformDirection(m, t.x, t.y, t.z))), t.w);
+			}
+#else
+			Matrix4 m;
+			if (!BlendJoints(palette, paletteSize, weights[v], joints[v], m)) {
+				outPositions[v] = positions[v];
+				if (outNormals)  { outNormals[v]  = normals[v]; }
+				if (outTangents) { outTangents[v] = tangents[v]; }
+				continue;
+			}
+			outPositions[v] = TransformDirection(m, positions[v]) + Vector3(m.array[3][0], m.array[3][1], m.array[3][2]);
+
+			if (outNormals) {
+				outNormals[v] = Vector::Normalise(TransformDirection(m, normals[v]));
+			}
+			if (outTangents) {
+				const Vector4& t = tangents[v];
+				outTangents[v] = Vector4(Vector::Normalise(TransformDirection(m, Vector3(t.x, t.y, t.z))), t.w);
+			}
+#endif
+		}
+	});
+	return true;
+}
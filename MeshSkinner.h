@@ -0,0 +1,42 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Vector.h"
+#include "Matrix.h"
+
+namespace NCL::Rendering {
+	class Mesh;
+
+	/*
+	CPU linear blend skinning, for when skinned geometry is needed outside of a
+	vertex shader - such as for hit detection, or on platforms without compute.
+
+	Vertices are skinned in parallel, with each vertex's (up to 4) weighted joint
+	matrices blended with SSE before being applied. Vertices with no weights are
+	copied through unchanged. Output normals and tangents are renormalised, and
+	tangents keep their w handedness.
+	*/
+	class MeshSkinner {
+	public:
+		//Skins using a frame of joint transforms, such as from MeshAnimation::GetJointData.
+		//Each is combined with the mesh's inverse bind pose, if it has one.
+		static bool Skin(const Mesh& mesh, const Maths::Matrix4* joints, size_t jointCount,
+			Maths::Vector3* outPositions, Maths::Vector3* outNormals = nullptr, Maths::Vector4* outTangents = nullptr);
+
+		//Skins using final skinning matrices, which already include the inverse bind pose
+		static bool SkinWithPalette(const Mesh& mesh, const Maths::Matrix4* palette, size_t paletteSize,
+			Maths::Vector3* outPositions, Maths::Vector3* outNormals = nullptr, Maths::Vector4* outTangents = nullptr);
+
+		static void BuildPalette(const Mesh& mesh, const Maths::Matrix4* joints, size_t jointCount, std::vector<Maths::Matrix4>& palette);
+
+	protected:
+		MeshSkinner() {}
+		~MeshSkinner() {}
+	};
+}
@@ -7,461 +7,1765 @@
 #include "Maths.h"
 
 #include "Mesh.h"
+#include "IndexCodec.h"
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <cfloat>
+#include <charconv>
+#include <cstring>
 
 using namespace NCL;
 using namespace Rendering;
 using namespace Maths;
 
-bool MshLoader::LoadMesh(const std::string& filename, Mesh& destinationMesh) {
-	std::ifstream file(Assets::MESHDIR + filename);
+namespace {
+	//Binary files share the text format's chunk types, but store each chunk as a
+	//raw little endian array at a 16 byte aligned offset, listed in a table of contents
+	const int TEXT_VERSION = 2;
+
+	const uint32_t BINARY_MAGIC		= 0x48534D4E; //"NMSH"
+	const uint32_t BINARY_VERSION	= 1;
+	const uint64_t CHUNK_ALIGNMENT	= 16;
+
+	struct BinaryMeshHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t numMeshes;
+		uint32_t numVertices;
+		uint32_t numIndices;
+		uint32_t numChunks;
+		uint64_t tocOffset;
+	};
+
+	struct BinaryChunkEntry {
+		uint32_t chunkType;
+		uint32_t dataType;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t elementCount;
+		uint32_t flags;		//ChunkFlags
+	};
+
+	enum ChunkFlags {
+		CHUNK_COMPRESSED = 1 << 0	//Payload is in ChunkCompression's format
+	};
+
+	static_assert(sizeof(BinaryMeshHeader) == 32 && sizeof(BinaryChunkEntry) == 32, "Binary mesh structs must not be padded");
+
+	bool IsValidChunkEntry(const BinaryChunkEntry& entry, uint64_t fileSize) {
+		return entry.offset % CHUNK_ALIGNMENT == 0 && entry.offset <= fileSize && entry.size <= fileSize - entry.offset &&
+			(entry.flags & ~CHUNK_COMPRESSED) == 0;
+	}
+
+	const double POWERS_OF_TEN[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	/*
+	Parses the common case of a plain decimal float, with up to 19 digits and a
+	small exponent. The mantissa and power of ten are both exact doubles, so one
+	multiply or divide rounds correctly to double. Rounding that on to float can only
+	differ from rounding the decimal directly if the double lands exactly halfway
+	between two floats, so those (and anything unusual) are left to from_chars.
+	*/
+	bool ParseSimpleFloat(const char* pos, const char* end, const char*& next, float& value) {
+		bool negative = false;
+		if (pos < end && (*pos == '-' || *pos == '+')) {
+			negative = (*pos == '-');
+			++pos;
+		}
+		uint64_t	mantissa	= 0;
+		int			exponent	= 0;
+
+		const char* digitsStart = pos;
+		for (; pos < end && (unsigned char)(*pos - '0') < 10; ++pos) {
+			mantissa = mantissa * 10 + (*pos - '0');
+		}
+		ptrdiff_t digits = pos - digitsStart;
+		if (pos < end && *pos == '.') {
+			const char* fractionStart = ++pos;
+			for (; pos < end && (unsigned char)(*pos - '0') < 10; ++pos) {
+				mantissa = mantissa * 10 + (*pos - '0');
+			}
+			exponent = -(int)(pos - fractionStart);
+			digits += pos - fractionStart;
+		}
+		//Beyond 2^53 the mantissa is no longer an exact double
+		if (digits == 0 || digits > 19 || mantissa > (1ull << 53)) {
+			return false;
+		}
+		if (pos < end && (*pos == 'e' || *pos == 'E')) {
+			++pos;
+			bool negativeExponent = false;
+			if (pos < end && (*pos == '-' || *pos == '+')) {
+				negativeExponent = (*pos == '-');
+				++pos;
+			}
+			if (pos >= end || *pos < '0' || *pos > '9') {
+				return false;
+			}
+			int e = 0;
+			for (; pos < end && *pos >= '0' && *pos <= '9' && e < 1000; ++pos) {
+				e = e * 10 + (*pos - '0');
+			}
+			exponent += negativeExponent ? -e : e;
+		}
+		if (exponent < -22 || exponent > 22) {
+			return false;
+		}
+		double d = (double)mantissa;
+		d = exponent < 0 ? d / POWERS_OF_TEN[-exponent] : d * POWERS_OF_TEN[exponent];
+		if (d > FLT_MAX) {
+			return false;
+		}
+		//Below FLT_MIN the float spacing changes, so halfway points are harder to spot
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(double));
+		if ((d < FLT_MIN && d != 0.0) || (bits & 0x1FFFFFFF) == 0x10000000) {
+			return false;
+		}
+		float f = (float)d;
+		value	= negative ? -f : f;
+		next	= pos;
+		return true;
+	}
+
+	size_t CountBits(uint32_t v) {
+		v = v - ((v >> 1) & 0x55555555);
+		v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+		return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+	}
+
+	//to_chars gives the shortest text that reads back as exactly the same float
+	template<typename T>
+	void AppendNumber(std::string& output, T value) {
+		char buffer[32];
+		auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		output.append(buffer, end);
+	}
+
+	template<typename T>
+	void AppendNumbers(std::string& output, const T* values, size_t count, const char* terminator = "\n") {
+		for (size_t i = 0; i < count; ++i) {
+			if (i > 0) {
+				output += ' ';
+			}
+			AppendNumber(output, values[i]);
+		}
+		output += terminator;
+	}
+
+	template<typename T>
+	void AppendBinary(std::string& output, const T& value) {
+		output.append((const char*)&value, sizeof(T));
+	}
+
+	//Packs triangle list indices with IndexCodec before compressing them. Triangles may
+	//come back rotated, but keep their order and winding.
+	void PackTriangles(const char* indices, size_t indexCount, uint32_t indexBytes, std::string& output) {
+		std::vector<uint8_t> coded;
+		if (indexBytes == sizeof(uint16_t)) {
+			IndexCodec::Encode((const uint16_t*)indices, indexCount, coded);
+		}
+		else {
+			IndexCodec::Encode((const unsigned int*)indices, indexCount, coded);
+		}
+		std::string payload;
+		AppendBinary(payload, indexBytes);
+		payload.append((const char*)coded.data(), coded.size());
+		ChunkCompression::Compress(payload.data(), payload.size(), ChunkFilter::None, output);
+	}
+
+	//Quantised attribute chunks start with this, followed by the packed values
+	struct QuantisationHeader {
+		float offset[4];
+		float scale[4];
+	};
+
+	uint32_t BytesPerValue(GeometryChunkData dataType) {
+		switch (dataType) {
+		case GeometryChunkData::dShort: return 2;
+		case GeometryChunkData::dByte:	return 1;
+		default:						return 0;
+		}
+	}
+
+	//An attribute's element count, which may only be held in its quantised copy
+	size_t AttributeCount(const Mesh& mesh, size_t floatCount, VertexAttribute::Type attribute) {
+		const QuantisedAttribute* q = mesh.GetQuantisedAttribute(attribute);
+		return floatCount == 0 && q ? q->GetCount() : floatCount;
+	}
+
+	//An attribute's float data, expanded from its quantised copy if that's all the mesh has
+	template<typename T>
+	const std::vector<T>& AttributeFloats(const Mesh& mesh, const std::vector<T>& floats, VertexAttribute::Type attribute, std::vector<T>& expanded) {
+		const QuantisedAttribute* q = mesh.GetQuantisedAttribute(attribute);
+		if (!floats.empty() || !q) {
+			return floats;
+		}
+		expanded.resize(q->GetCount());
+		q->Dequantise((float*)expanded.data());
+		return expanded;
+	}
+
+	//Reads forward through a chunk's payload, failing rather than reading past its end
+	struct ChunkReader {
+		const char* data;
+		const char* end;
+
+		ChunkReader(const MeshFileChunk& chunk) : data(chunk.data), end(chunk.data + chunk.size) {}
+
+		bool Read(void* out, size_t bytes) {
+			if ((size_t)(end - data) < bytes) {
+				return false;
+			}
+			memcpy(out, data, bytes);
+			data += bytes;
+			return true;
+		}
+
+		template<typename T>
+		bool ReadArray(std::vector<T>& out, size_t count) {
+			if ((size_t)(end - data) / sizeof(T) < count) {
+				return false;
+			}
+			out.resize(count);
+			return Read(out.data(), count * sizeof(T));
+		}
+
+		bool ReadString(std::string& out) {
+			uint32_t length = 0;
+			if (!Read(&length, sizeof(uint32_t)) || (size_t)(end - data) < length) {
+				return false;
+			}
+			out.assign(data, length);
+			data += length;
+			return true;
+		}
+	};
+
+	template<typename T>
+	bool ReadChunkArray(const MeshFileChunk& chunk, std::vector<T>& out) {
+		if (chunk.size != (size_t)chunk.elementCount * sizeof(T)) {
+			return false;
+		}
+		ChunkReader reader(chunk);
+		return reader.ReadArray(out, chunk.elementCount);
+	}
+
+	//Float attribute chunks may be stored quantised. Those can also be kept quantised, in which
+	//case the floats are only expanded if alwaysExpand is set - positions are needed on the CPU.
+	template<typename T>
+	bool ReadAttributeChunk(const MeshFileChunk& chunk, std::vector<T>& out, QuantisedAttribute* keep, bool alwaysExpand = false) {
+		if (chunk.dataType == GeometryChunkData::dFloat) {
+			return ReadChunkArray(chunk, out);
+		}
+		uint32_t components		= sizeof(T) / sizeof(float);
+		uint32_t bytesPerValue	= BytesPerValue(chunk.dataType);
+		size_t	 valueBytes		= (size_t)chunk.elementCount * components * bytesPerValue;
+		if (bytesPerValue == 0 || chunk.size != sizeof(QuantisationHeader) + valueBytes) {
+			return false;
+		}
+		QuantisationHeader header;
+		memcpy(&header, chunk.data, sizeof(header));
+		const char* values = chunk.data + sizeof(header);
+
+		if (keep) {
+			keep->components	= components;
+			keep->bytesPerValue = bytesPerValue;
+			memcpy(keep->offset, header.offset, sizeof(header.offset));
+			memcpy(keep->scale, header.scale, sizeof(header.scale));
+			keep->data.assign(values, values + valueBytes);
+		}
+		if (!keep || alwaysExpand) {
+			out.resize(chunk.elementCount);
+			QuantisedAttribute::Dequantise(values, chunk.elementCount, components, bytesPerValue, header.offset, header.scale, (float*)out.data());
+		}
+		return true;
+	}
+
+	bool ReadChunkStrings(const MeshFileChunk& chunk, std::vector<std::string>& out) {
+		//Every string has at least its length, so a count the payload can't hold is corrupt
+		if (chunk.elementCount > chunk.size / sizeof(uint32_t)) {
+			return false;
+		}
+		ChunkReader reader(chunk);
+		out.resize(chunk.elementCount);
+		for (std::string& s : out) {
+			if (!reader.ReadString(s)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+struct MshLoader::TextReader {
+	const char* pos;
+	const char* end;
+	bool		failed = false;
+
+	TextReader(const char* data, size_t size) : pos(data), end(data + size) {}
+
+	static bool IsSpace(char c) {
+		return (unsigned char)c <= ' ';
+	}
+
+	void SkipWhitespace() {
+		while (pos < end && IsSpace(*pos)) {
+			++pos;
+		}
+	}
+
+	//Matches operator>> for numbers, which also accepts a leading '+'
+	template<typename T>
+	void Read(T& value) {
+		SkipWhitespace();
+		const char* start = (pos < end && *pos == '+') ? pos + 1 : pos;
+		auto [next, error] = std::from_chars(start, end, value);
+		if (error == std::errc::invalid_argument) {
+			failed = true;
+			while (pos < end && !IsSpace(*pos)) {
+				++pos;
+			}
+			return;
+		}
+		pos = next;
+	}
+
+	void Read(float& value) {
+		SkipWhitespace();
+		if (!ParseSimpleFloat(pos, end, pos, value)) {
+			Read<float>(value);
+		}
+	}
+
+	void ReadFloats(float* values, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			Read(values[i]);
+		}
+	}
+
+	void ReadToken(std::string& token) {
+		SkipWhitespace();
+		const char* start = pos;
+		while (pos < end && !IsSpace(*pos)) {
+			++pos;
+		}
+		token.assign(start, pos);
+	}
+
+	//As std::getline, dropping the '\r' of files with Windows line endings
+	void ReadLine(std::string& line) {
+		const char* start = pos;
+		while (pos < end && *pos != '\n') {
+			++pos;
+		}
+		const char* lineEnd = pos;
+		if (lineEnd > start && lineEnd[-1] == '\r') {
+			--lineEnd;
+		}
+		line.assign(start, lineEnd);
+		if (pos < end) {
+			++pos;
+		}
+	}
+
+	void SkipLine() {
+		const char* lineEnd = (const char*)memchr(pos, '\n', end - pos);
+		pos = lineEnd ? lineEnd + 1 : end;
+	}
+
+	//Steps over whole numbers without converting them, for finding chunk boundaries
+	void SkipTokens(size_t count) {
+#ifdef NCL_SIMD_SSE
+		//A token starts at each non-space byte that follows a space, so whole blocks
+		//of 16 bytes can be stepped over by counting those starts
+		const __m128i spaceLimit = _mm_set1_epi8(' ');
+		uint32_t lastWasSpace = 1;
+		while (count > 0 && end - pos >= 16) {
+			__m128i		bytes		= _mm_loadu_si128((const __m128i*)pos);
+			uint32_t	spaces		= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(bytes, spaceLimit), spaceLimit));
+			uint32_t	starts		= ~spaces & ((spaces << 1) | lastWasSpace) & 0xFFFF;
+			size_t		startCount	= CountBits(starts);
+			if (startCount >= count) {
+				break;
+			}
+			count		-= startCount;
+			lastWasSpace = spaces >> 15;
+			pos			+= 16;
+		}
+		if (!lastWasSpace) {
+			while (pos < end && !IsSpace(*pos)) { //Finish off a token that was already counted
+				++pos;
+			}
+		}
+#endif
+		for (size_t i = 0; i < count && pos < end; ++i) {
+			SkipWhitespace();
+			while (pos < end && !IsSpace(*pos)) {
+				++pos;
+			}
+		}
+	}
+};
+
+//Every chunk of a file decoded into its own vectors, so that chunks can be
+//decoded on separate threads and then handed to the Mesh in one go
+struct MshLoader::LoadedChunks {
+	int fileVersion = 1;
+	int numMeshes	= 0;
+	int numVertices = 0;
+	int numIndices	= 0;
+
+	uint32_t chunkMask = 0; //Which GeometryChunkTypes were present
+
+	bool				keepQuantised = false;
+	QuantisedAttribute	quantised[VertexAttribute::MAX_ATTRIBUTES];
+
+	QuantisedAttribute* Keep(VertexAttribute::Type attribute) {
+		return keepQuantised ? &quantised[attribute] : nullptr;
+	}
+
+	vector<Vector3>			positions;
+	vector<Vector4>			colours;
+	vector<Vector3>			normals;
+	vector<Vector4>			tangents;
+	vector<Vector2>			texCoords;
+	vector<unsigned int>	indices;
+	vector<uint16_t>		shortIndices;
+	vector<Vector4>			skinWeights;
+	vector<Vector4i>		skinIndices;
+	vector<std::string>		jointNames;
+	vector<int>				jointParents;
+	vector<Matrix4>			bindPose;
+	vector<Matrix4>			inverseBindPose;
+	vector<SubMesh>			subMeshes;
+	vector<std::string>		subMeshNames;
+	BoundingVolume			meshBounds;
+	vector<BoundingVolume>	subMeshBounds;
+	vector<MorphTarget>		morphTargets;
+
+	bool Has(GeometryChunkTypes type) const {
+		return (chunkMask & (uint32_t)type) != 0;
+	}
+};
+
+bool MappedMeshFile::Open(const std::string& filename) {
+	Close();
+	if (!file.Open(Assets::MESHDIR + filename)) {
+		return false;
+	}
+	const char* data = file.GetData();
+	size_t		size = file.GetSize();
+
+	if (!MshLoader::IsBinaryMeshFile(data, size)) {
+		std::cout << __FUNCTION__ << " " << filename << " is not a binary Mesh file!\n";
+		Close();
+		return false;
+	}
+	BinaryMeshHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.version != BINARY_VERSION) {
+		std::cout << __FUNCTION__ << " Mesh file has incompatible version!\n";
+		Close();
+		return false;
+	}
+	if (header.tocOffset > size || (size - header.tocOffset) / sizeof(BinaryChunkEntry) < header.numChunks) {
+		std::cout << __FUNCTION__ << " " << filename << " has a truncated table of contents!\n";
+		Close();
+		return false;
+	}
+	numMeshes	= header.numMeshes;
+	numVertices = header.numVertices;
+	numIndices	= header.numIndices;
+
+	chunks.reserve(header.numChunks);
+	for (uint32_t i = 0; i < header.numChunks; ++i) {
+		BinaryChunkEntry entry;
+		memcpy(&entry, data + header.tocOffset + i * sizeof(BinaryChunkEntry), sizeof(entry));
+
+		if (!IsValidChunkEntry(entry, size)) {
+			std::cout << __FUNCTION__ << " " << filename << " has an invalid chunk entry!\n";
+			Close();
+			return false;
+		}
+		MeshFileChunk chunk;
+		chunk.type			= (GeometryChunkTypes)entry.chunkType;
+		chunk.dataType		= (GeometryChunkData)entry.dataType;
+		chunk.elementCount	= entry.elementCount;
+		chunk.data			= data + entry.offset;
+		chunk.size			= (size_t)entry.size;
+		chunk.compressed	= (entry.flags & CHUNK_COMPRESSED) != 0;
+		chunks.emplace_back(chunk);
+	}
+	return true;
+}
+
+void MappedMeshFile::Close() {
+	file.Close();
+	chunks.clear();
+	numMeshes	= 0;
+	numVertices = 0;
+	numIndices	= 0;
+}
+
+const MeshFileChunk* MappedMeshFile::GetChunk(GeometryChunkTypes type) const {
+	for (const MeshFileChunk& c : chunks) {
+		if (c.type == type) {
+			return &c;
+		}
+	}
+	return nullptr;
+}
+
+bool MappedMeshFile::ExpandChunk(const MeshFileChunk& chunk, std::vector<char>& storage, MeshFileChunk& expanded, CompressionStats* stats) {
+	expanded = chunk;
+	if (!chunk.compressed) {
+		return true;
+	}
+	size_t rawSize = 0;
+	if (!ChunkCompression::GetDecompressedSize(chunk.data, chunk.size, rawSize)) {
+		return false;
+	}
+	storage.resize(rawSize);
+	if (!ChunkCompression::Decompress(chunk.data, chunk.size, storage.data(), rawSize, stats)) {
+		return false;
+	}
+	expanded.data		= storage.data();
+	expanded.size		= rawSize;
+	expanded.compressed = false;
+	return true;
+}
+
+MeshStreamReader::MeshStreamReader(size_t blockSize) {
+	this->blockSize = std::max<size_t>(blockSize, 1);
+	fileSize	= 0;
+	numMeshes	= 0;
+	numVertices = 0;
+	numIndices	= 0;
+}
+
+bool MeshStreamReader::Open(const std::string& name) {
+	Close();
+	filename = name;
+	file.open(Assets::MESHDIR + filename, std::ios::binary);
+	if (!file) {
+		std::cout << __FUNCTION__ << " can't open " << filename << "!\n";
+		return false;
+	}
+	file.seekg(0, std::ios::end);
+	fileSize = (uint64_t)file.tellg();
+
+	BinaryMeshHeader header;
+	if (!ReadFileData(0, sizeof(header), &header) || !MshLoader::IsBinaryMeshFile((const char*)&header, sizeof(header))) {
+		std::cout << __FUNCTION__ << " " << filename << " is not a binary Mesh file!\n";
+		Close();
+		return false;
+	}
+	if (header.version != BINARY_VERSION) {
+		std::cout << __FUNCTION__ << " Mesh file has incompatible version!\n";
+		Close();
+		return false;
+	}
+	vector<BinaryChunkEntry> contents;
+	if (header.tocOffset <= fileSize && (fileSize - header.tocOffset) / sizeof(BinaryChunkEntry) >= header.numChunks) {
+		contents.resize(header.numChunks);
+	}
+	if (contents.size() != header.numChunks || !ReadFileData(header.tocOffset, contents.size() * sizeof(BinaryChunkEntry), contents.data())) {
+		std::cout << __FUNCTION__ << " " << filename << " has a truncated table of contents!\n";
+		Close();
+		return false;
+	}
+	numMeshes	= header.numMeshes;
+	numVertices = header.numVertices;
+	numIndices	= header.numIndices;
+
+	chunks.reserve(contents.size());
+	for (const BinaryChunkEntry& entry : contents) {
+		MeshStreamChunk chunk;
+		chunk.type			= (GeometryChunkTypes)entry.chunkType;
+		chunk.dataType		= (GeometryChunkData)entry.dataType;
+		chunk.elementCount	= entry.elementCount;
+		chunk.offset		= entry.offset;
+		chunk.storedSize	= (size_t)entry.size;
+		chunk.size			= (size_t)entry.size;
+		chunk.compressed	= (entry.flags & CHUNK_COMPRESSED) != 0;
+
+		ChunkCompression::BlockLayout layout;
+		if (!IsValidChunkEntry(entry, fileSize) || (chunk.compressed && !ReadBlockLayout(chunk, layout))) {
+			std::cout << __FUNCTION__ << " " << filename << " has an invalid chunk entry!\n";
+			Close();
+			return false;
+		}
+		if (chunk.compressed) {
+			chunk.size = layout.rawSize;
+		}
+		chunks.emplace_back(chunk);
+	}
+	return true;
+}
+
+void MeshStreamReader::Close() {
+	file.close();
+	file.clear();
+	chunks.clear();
+	fileSize	= 0;
+	numMeshes	= 0;
+	numVertices = 0;
+	numIndices	= 0;
+}
+
+const MeshStreamChunk* MeshStreamReader::GetChunk(GeometryChunkTypes type) const {
+	for (const MeshStreamChunk& c : chunks) {
+		if (c.type == type) {
+			return &c;
+		}
+	}
+	return nullptr;
+}
+
+bool MeshStreamReader::ReadFileData(uint64_t offset, size_t size, void* destination) {
+	file.clear();
+	file.seekg((std::streamoff)offset);
+	file.read((char*)destination, (std::streamsize)size);
+	return (bool)file;
+}
+
+bool MeshStreamReader::ReadBlockLayout(const MeshStreamChunk& chunk, ChunkCompression::BlockLayout& layout) {
+	char	start[16];
+	size_t	rawSize		= 0;
+	size_t	startSize	= std::min(sizeof(start), chunk.storedSize);
+	if (!ReadFileData(chunk.offset, startSize, start) || !ChunkCompression::GetDecompressedSize(start, startSize, rawSize)) {
+		return false;
+	}
+	size_t headerSize = ChunkCompression::GetHeaderSize(rawSize);
+	if (headerSize > chunk.storedSize) {
+		return false;
+	}
+	readBuffer.resize(std::max(readBuffer.size(), headerSize));
+	return ReadFileData(chunk.offset, headerSize, readBuffer.data()) &&
+		ChunkCompression::ReadBlockLayout(readBuffer.data(), headerSize, chunk.storedSize, layout);
+}
+
+bool MeshStreamReader::ReadChunk(const MeshStreamChunk& chunk, const BlockFunction& func) {
+	if (!chunk.compressed) {
+		readBuffer.resize(std::max(readBuffer.size(), std::min(blockSize, chunk.size)));
+		for (size_t done = 0; done < chunk.size; ) {
+			size_t readSize = std::min(blockSize, chunk.size - done);
+			if (!ReadFileData(chunk.offset + done, readSize, readBuffer.data()) || !func(readBuffer.data(), readSize, done)) {
+				return false;
+			}
+			done += readSize;
+		}
+		return true;
+	}
+	ChunkCompression::BlockLayout layout;
+	if (!ReadBlockLayout(chunk, layout)) {
+		return false;
+	}
+	decodeBuffer.resize(std::min(ChunkCompression::BLOCK_SIZE, chunk.size));
+	for (size_t i = 0; i < layout.GetBlockCount(); ++i) {
+		size_t storedSize = layout.offsets[i + 1] - layout.offsets[i];
+		readBuffer.resize(std::max(readBuffer.size(), storedSize));
+		if (!ReadFileData(chunk.offset + layout.offsets[i], storedSize, readBuffer.data()) ||
+			!ChunkCompression::DecompressBlock(layout, i, readBuffer.data(), decodeBuffer.data(), scratch) ||
+			!func(decodeBuffer.data(), layout.GetBlockSize(i), i * ChunkCompression::BLOCK_SIZE)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MeshStreamReader::ReadChunk(const MeshStreamChunk& chunk, void* destination, size_t destinationSize) {
+	if (destinationSize < chunk.size) {
+		std::cout << __FUNCTION__ << " destination is too small for chunk type " << (int)chunk.type << "!\n";
+		return false;
+	}
+	if (!chunk.compressed) {
+		return ReadFileData(chunk.offset, chunk.size, destination);
+	}
+	ChunkCompression::BlockLayout layout;
+	if (!ReadBlockLayout(chunk, layout)) {
+		return false;
+	}
+	char* dest = (char*)destination;
+	for (size_t i = 0; i < layout.GetBlockCount(); ++i) {
+		size_t storedSize = layout.offsets[i + 1] - layout.offsets[i];
+		readBuffer.resize(std::max(readBuffer.size(), storedSize));
+		if (!ReadFileData(chunk.offset + layout.offsets[i], storedSize, readBuffer.data()) ||
+			!ChunkCompression::DecompressBlock(layout, i, readBuffer.data(), dest + i * ChunkCompression::BLOCK_SIZE, scratch)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MshLoader::IsBinaryMeshFile(const char* data, size_t size) {
+	uint32_t magic = 0;
+	if (size < sizeof(BinaryMeshHeader)) {
+		return false;
+	}
+	memcpy(&magic, data, sizeof(uint32_t));
+	return magic == BINARY_MAGIC;
+}
+
+bool MshLoader::LoadMesh(const std::string& filename, Mesh& destinationMesh, bool keepQuantised) {
+	MappedFile mappedFile;
+	if (!mappedFile.Open(Assets::MESHDIR + filename)) {
+		return false;
+	}
+	if (IsBinaryMeshFile(mappedFile.GetData(), mappedFile.GetSize())) {
+		mappedFile.Close();
+		MappedMeshFile binaryFile;
+		return binaryFile.Open(filename) && LoadBinaryMesh(binaryFile, destinationMesh, keepQuantised);
+	}
+	TextReader file(mappedFile.GetData(), mappedFile.GetSize());
 
 	std::string filetype;
-	int fileVersion;
+	int fileVersion = 0;
 
-	file >> filetype;
+	file.ReadToken(filetype);
 
 	if (filetype != "MeshGeometry") {
 		std::cout << __FUNCTION__ << " File is not a Mesh file!\n";
 		return false;
 	}
 
-	file >> fileVersion;
+	file.Read(fileVersion);
 
-	if (fileVersion != 1) {
+	if (fileVersion < 1 || fileVersion > TEXT_VERSION) {
 		std::cout << __FUNCTION__ << " Mesh file has incompatible version!\n";
 		return false;
 	}
 
-	int numMeshes = 0; //read
-	int numVertices = 0; //read
-	int numIndices = 0; //read
-	int numChunks = 0; //read
+	LoadedChunks chunks;
+	int numChunks = 0;
+
+	chunks.fileVersion = fileVersion;
+
+	file.Read(chunks.numMeshes);
+	file.Read(chunks.numVertices);
+	file.Read(chunks.numIndices);
+	file.Read(numChunks);
 
-	file >> numMeshes;
-	file >> numVertices;
-	file >> numIndices;
-	file >> numChunks;
+	if (chunks.numMeshes < 0 || chunks.numVertices < 0 || chunks.numIndices < 0 || numChunks < 0) {
+		std::cout << __FUNCTION__ << " Mesh file has an invalid header!\n";
+		return false;
+	}
+
+	//Chunk sizes follow from the header counts, so a quick scan over the text can
+	//find where every chunk starts, and then each can be decoded on its own thread
+	struct TextChunk {
+		GeometryChunkTypes	type;
+		const char*			start;
+		const char*			end;
+		bool				failed;
+	};
+	vector<TextChunk> textChunks;
 
 	for (int i = 0; i < numChunks; ++i) {
-		int chunkType = (int)GeometryChunkTypes::VPositions;
-
-		file >> chunkType;
-
-		switch ((GeometryChunkTypes)chunkType) {
-		case GeometryChunkTypes::VPositions: {
-			vector<Vector3> positions;
-			ReadTextFloats(file, positions, numVertices);
-			destinationMesh.SetVertexPositions(positions);
-		}break;
-		case GeometryChunkTypes::VColors: {
-			vector<Vector4> colours;
-			ReadTextFloats(file, colours, numVertices);
-			destinationMesh.SetVertexColours(colours);
-		}break;
-		case GeometryChunkTypes::VNormals: {
-			vector<Vector3> normals;
-			ReadTextFloats(file, normals, numVertices);
-			destinationMesh.SetVertexNormals(normals);
-		}break;
-		case GeometryChunkTypes::VTangents: {
-			vector<Vector4> tangents;
-			ReadTextFloats(file, tangents, numVertices);
-			destinationMesh.SetVertexTangents(tangents);
-
-		}break;
-		case GeometryChunkTypes::VTex0: {
-			vector<Vector2> texCoords;
-			ReadTextFloats(file, texCoords, numVertices);
-			destinationMesh.SetVertexTextureCoords(texCoords);
-
-		}break;
-		case GeometryChunkTypes::Indices: {
-			vector<unsigned int> indices;
-			ReadIntegers(file, indices, numIndices);
-			destinationMesh.SetVertexIndices(indices);
-		}break;
-
-		case GeometryChunkTypes::VWeightValues: {
-			vector<Vector4> skinWeights;
-			ReadTextFloats(file, skinWeights, numVertices);
-			destinationMesh.SetVertexSkinWeights(skinWeights);
-		}break;
-		case GeometryChunkTypes::VWeightIndices: {
-			vector<Vector4i> skinIndices;
-			ReadTextInts(file, skinIndices, numVertices);
-			destinationMesh.SetVertexSkinIndices(skinIndices);
-		}break;
-		case GeometryChunkTypes::JointNames: {
-			std::vector<std::string> jointNames;
-			ReadJointNames(file, jointNames);
-			destinationMesh.SetJointNames(jointNames);
-		}break;
-		case GeometryChunkTypes::JointParents: {
-			vector<int> parents;
-			ReadJointParents(file, parents);
-			destinationMesh.SetJointParents(parents);
-		}break;
-		case GeometryChunkTypes::BindPose: {
-			vector<Matrix4> bindPose;
-			ReadRigPose(file, bindPose);
-			destinationMesh.SetBindPose(bindPose);
-		}break;
-		case GeometryChunkTypes::BindPoseInv: {
-			vector<Matrix4> inverseBindPose;
-			ReadRigPose(file, inverseBindPose);
-			destinationMesh.SetInverseBindPose(inverseBindPose);
-		}break;
-		case GeometryChunkTypes::SubMeshes: {
-			vector<SubMesh> subMeshes;
-			ReadSubMeshes(file, numMeshes, subMeshes);
-
-			destinationMesh.SetSubMeshes(subMeshes);
-		}break;
-		case GeometryChunkTypes::SubMeshNames: {
-			std::vector<std::string> subMeshNames;
-			ReadSubMeshNames(file, numMeshes, subMeshNames);
-			destinationMesh.SetSubMeshNames(subMeshNames);
-		}break;
+		int chunkType = 0;
+		file.Read(chunkType);
+
+		const char* start = file.pos;
+		if (file.failed || !SkipTextChunk(file, (GeometryChunkTypes)chunkType, chunks)) {
+			std::cout << __FUNCTION__ << " " << filename << " has an unknown or repeated chunk type " << chunkType << "!\n";
+			return false;
 		}
+		chunks.chunkMask |= (uint32_t)chunkType;
+		textChunks.push_back({ (GeometryChunkTypes)chunkType, start, file.pos, false });
 	}
 
-	if (!destinationMesh.GetBindPose().empty() && destinationMesh.GetInverseBindPose().empty()) {
-		destinationMesh.CalculateInverseBindPose();
-	}
+	ThreadPool::GetGlobalPool().ParallelFor(textChunks.size(), 1, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			TextChunk& c = textChunks[i];
+			TextReader reader(c.start, c.end - c.start);
+			DecodeTextChunk(reader, c.type, chunks);
+			c.failed = reader.failed;
+		}
+	});
 
-	destinationMesh.SetPrimitiveType(GeometryPrimitive::Triangles);
+	for (const TextChunk& c : textChunks) {
+		if (c.failed || file.failed) {
+			std::cout << __FUNCTION__ << " " << filename << " contains malformed numbers!\n";
+			return false;
+		}
+	}
+	AssembleMesh(chunks, destinationMesh);
+	return true;
+}
 
+bool MshLoader::SkipTextChunk(TextReader& file, GeometryChunkTypes type, const LoadedChunks& chunks) {
+	if (chunks.Has(type)) {
+		return false; //Two chunks of one type would be decoded into the same vector at once
+	}
+	size_t numVertices	= (size_t)chunks.numVertices;
+	size_t numMeshes	= (size_t)chunks.numMeshes;
+	int count = 0;
+
+	switch (type) {
+	case GeometryChunkTypes::VPositions:
+	case GeometryChunkTypes::VNormals:		file.SkipTokens(numVertices * 3); break;
+	case GeometryChunkTypes::VColors:
+	case GeometryChunkTypes::VTangents:
+	case GeometryChunkTypes::VWeightValues:
+	case GeometryChunkTypes::VWeightIndices:file.SkipTokens(numVertices * 4); break;
+	case GeometryChunkTypes::VTex0:			file.SkipTokens(numVertices * 2); break;
+	case GeometryChunkTypes::Indices:		file.SkipTokens((size_t)chunks.numIndices); break;
+	case GeometryChunkTypes::SubMeshes:		file.SkipTokens(numMeshes * (chunks.fileVersion >= 2 ? 3 : 2)); break;
+	case GeometryChunkTypes::Bounds:		file.SkipTokens((numMeshes + 1) * 10); break;
+	case GeometryChunkTypes::JointParents: {
+		file.Read(count);
+		file.SkipTokens(std::max(count, 0));
+	}break;
+	case GeometryChunkTypes::BindPose:
+	case GeometryChunkTypes::BindPoseInv: {
+		file.Read(count);
+		file.SkipTokens((size_t)std::max(count, 0) * 16);
+	}break;
+	case GeometryChunkTypes::JointNames: {
+		file.Read(count);
+		for (int i = 0; i <= count; ++i) {
+			file.SkipLine(); //Including the rest of the count's line
+		}
+	}break;
+	case GeometryChunkTypes::SubMeshNames: {
+		for (size_t i = 0; i <= numMeshes; ++i) {
+			file.SkipLine();
+		}
+	}break;
+	case GeometryChunkTypes::MorphTargets: {
+		file.Read(count);
+		for (int i = 0; i < count; ++i) {
+			int entryCount	= 0;
+			int hasNormals	= 0;
+			int hasTangents = 0;
+			file.SkipLine(); //As in ReadMorphTargets, then the name
+			file.SkipLine();
+			file.Read(entryCount);
+			file.Read(hasNormals);
+			file.Read(hasTangents);
+			file.SkipTokens((size_t)std::max(entryCount, 0) * (4 + (hasNormals ? 3 : 0) + (hasTangents ? 3 : 0)));
+		}
+	}break;
+	default: return false;
+	}
 	return true;
 }
 
-bool MshLoader::SaveMesh(const std::string& filename, Mesh& sourceMesh) {
-	std::ofstream file(filename);
+void MshLoader::DecodeTextChunk(TextReader& file, GeometryChunkTypes type, LoadedChunks& chunks) {
+	switch (type) {
+	case GeometryChunkTypes::VPositions:	ReadTextFloats(file, chunks.positions, chunks.numVertices);		break;
+	case GeometryChunkTypes::VColors:		ReadTextFloats(file, chunks.colours, chunks.numVertices);		break;
+	case GeometryChunkTypes::VNormals:		ReadTextFloats(file, chunks.normals, chunks.numVertices);		break;
+	case GeometryChunkTypes::VTangents:		ReadTextFloats(file, chunks.tangents, chunks.numVertices);		break;
+	case GeometryChunkTypes::VTex0:			ReadTextFloats(file, chunks.texCoords, chunks.numVertices);		break;
+	case GeometryChunkTypes::Indices:		ReadIntegers(file, chunks.indices, chunks.numIndices);			break;
+	case GeometryChunkTypes::VWeightValues: ReadTextFloats(file, chunks.skinWeights, chunks.numVertices);	break;
+	case GeometryChunkTypes::VWeightIndices:ReadTextInts(file, chunks.skinIndices, chunks.numVertices);		break;
+	case GeometryChunkTypes::JointNames:	ReadJointNames(file, chunks.jointNames);						break;
+	case GeometryChunkTypes::JointParents:	ReadJointParents(file, chunks.jointParents);					break;
+	case GeometryChunkTypes::BindPose:		ReadRigPose(file, chunks.bindPose);								break;
+	case GeometryChunkTypes::BindPoseInv:	ReadRigPose(file, chunks.inverseBindPose);						break;
+	case GeometryChunkTypes::SubMeshes:		ReadSubMeshes(file, chunks.numMeshes, chunks.fileVersion, chunks.subMeshes); break;
+	case GeometryChunkTypes::SubMeshNames:	ReadSubMeshNames(file, chunks.numMeshes, chunks.subMeshNames);	break;
+	case GeometryChunkTypes::MorphTargets:	ReadMorphTargets(file, chunks.morphTargets);					break;
+	case GeometryChunkTypes::Bounds: {
+		ReadBounds(file, chunks.meshBounds);
+		chunks.subMeshBounds.resize(chunks.numMeshes);
+		for (BoundingVolume& b : chunks.subMeshBounds) {
+			ReadBounds(file, b);
+		}
+	}break;
+	default: break;
+	}
+}
 
+bool MshLoader::LoadBinaryMesh(const MappedMeshFile& file, Mesh& destinationMesh, bool keepQuantised) {
+	LoadedChunks chunks;
+	chunks.keepQuantised = keepQuantised;
+	chunks.numMeshes	= (int)file.GetMeshCount();
+	chunks.numVertices	= (int)file.GetVertexCount();
+	chunks.numIndices	= (int)file.GetIndexCount();
+
+	const vector<MeshFileChunk>& fileChunks = file.GetChunks();
+	for (const MeshFileChunk& chunk : fileChunks) {
+		if (chunks.Has(chunk.type)) {
+			std::cout << __FUNCTION__ << " Chunk type " << (int)chunk.type << " is repeated!\n";
+			return false;
+		}
+		chunks.chunkMask |= (uint32_t)chunk.type;
+	}
 
-	static int FORMAT_VERSION = 1;
+	std::unique_ptr<bool[]> chunkRead(new bool[fileChunks.size()]);
+	ThreadPool::GetGlobalPool().ParallelFor(fileChunks.size(), 1, [&](size_t first, size_t last) {
+		std::vector<char> storage;
+		for (size_t i = first; i < last; ++i) {
+			MeshFileChunk chunk;
+			chunkRead[i] = MappedMeshFile::ExpandChunk(fileChunks[i], storage, chunk) && DecodeBinaryChunk(chunk, chunks);
+		}
+	});
 
-	file << "MeshGeometry\n";
-	file << FORMAT_VERSION;
+	for (size_t i = 0; i < fileChunks.size(); ++i) {
+		if (!chunkRead[i]) {
+			std::cout << __FUNCTION__ << " Chunk type " << (int)fileChunks[i].type << " has an invalid payload!\n";
+			return false;
+		}
+	}
+	AssembleMesh(chunks, destinationMesh);
+	return true;
+}
 
-	/*
-	int numMeshes = 0; //read
-	int numVertices = 0; //read
-	int numIndices = 0; //read
-	int numChunks = 0; //read
-	*/
+bool MshLoader::DecodeBinaryChunk(const MeshFileChunk& chunk, LoadedChunks& chunks) {
+	switch (chunk.type) {
+	case GeometryChunkTypes::VPositions:	return ReadAttributeChunk(chunk, chunks.positions,	chunks.Keep(VertexAttribute::Positions), true);
+	case GeometryChunkTypes::VColors:		return ReadAttributeChunk(chunk, chunks.colours,	chunks.Keep(VertexAttribute::Colours));
+	case GeometryChunkTypes::VNormals:		return ReadAttributeChunk(chunk, chunks.normals,	chunks.Keep(VertexAttribute::Normals));
+	case GeometryChunkTypes::VTangents:		return ReadAttributeChunk(chunk, chunks.tangents,	chunks.Keep(VertexAttribute::Tangents));
+	case GeometryChunkTypes::VTex0:			return ReadAttributeChunk(chunk, chunks.texCoords,	chunks.Keep(VertexAttribute::TextureCoords));
+	case GeometryChunkTypes::VWeightValues: return ReadAttributeChunk(chunk, chunks.skinWeights, chunks.Keep(VertexAttribute::JointWeights));
+	case GeometryChunkTypes::VWeightIndices:return ReadChunkArray(chunk, chunks.skinIndices);
+	case GeometryChunkTypes::JointNames:	return ReadChunkStrings(chunk, chunks.jointNames);
+	case GeometryChunkTypes::JointParents:	return ReadChunkArray(chunk, chunks.jointParents);
+	case GeometryChunkTypes::BindPose:		return ReadChunkArray(chunk, chunks.bindPose);
+	case GeometryChunkTypes::BindPoseInv:	return ReadChunkArray(chunk, chunks.inverseBindPose);
+	case GeometryChunkTypes::SubMeshes:		return ReadChunkArray(chunk, chunks.subMeshes);
+	case GeometryChunkTypes::SubMeshNames:	return ReadChunkStrings(chunk, chunks.subMeshNames);
+	case GeometryChunkTypes::Indices: {
+		if (chunk.dataType == GeometryChunkData::dTriangles) {
+			uint32_t indexBytes = 0;
+			if (chunk.size < sizeof(indexBytes)) {
+				return false;
+			}
+			memcpy(&indexBytes, chunk.data, sizeof(indexBytes));
+			const uint8_t*	coded		= (const uint8_t*)chunk.data + sizeof(indexBytes);
+			size_t			codedSize	= chunk.size - sizeof(indexBytes);
+			if (chunk.elementCount % 3 != 0 || chunk.elementCount > IndexCodec::MaxIndexCount(codedSize)) {
+				return false;
+			}
+			if (indexBytes == sizeof(uint16_t)) {
+				chunks.shortIndices.resize(chunk.elementCount);
+				return IndexCodec::Decode(coded, codedSize, chunks.shortIndices.data(), chunk.elementCount);
+			}
+			chunks.indices.resize(chunk.elementCount);
+			return indexBytes == sizeof(uint32_t) && IndexCodec::Decode(coded, codedSize, chunks.indices.data(), chunk.elementCount);
+		}
+		//Index width is implied by the payload size
+		if (chunk.size == (size_t)chunk.elementCount * sizeof(uint16_t)) {
+			return ReadChunkArray(chunk, chunks.shortIndices);
+		}
+		return ReadChunkArray(chunk, chunks.indices);
+	}
+	case GeometryChunkTypes::Bounds: {
+		//The whole mesh's bounds, then one per sub-mesh
+		if (!ReadChunkArray(chunk, chunks.subMeshBounds) || chunks.subMeshBounds.empty()) {
+			return false;
+		}
+		chunks.meshBounds = chunks.subMeshBounds[0];
+		chunks.subMeshBounds.erase(chunks.subMeshBounds.begin());
+		return true;
+	}
+	case GeometryChunkTypes::MorphTargets: {
+		//Each target has at least a name length, entry count, and delta flags
+		if (chunk.elementCount > chunk.size / (sizeof(uint32_t) * 3)) {
+			return false;
+		}
+		ChunkReader reader(chunk);
+		chunks.morphTargets.resize(chunk.elementCount);
+		for (MorphTarget& t : chunks.morphTargets) {
+			uint32_t entryCount = 0;
+			uint32_t deltaFlags = 0; //Bit 0 for normal deltas, bit 1 for tangent deltas
+			bool targetRead = reader.ReadString(t.name)
+				&& reader.Read(&entryCount, sizeof(uint32_t))
+				&& reader.Read(&deltaFlags, sizeof(uint32_t))
+				&& reader.ReadArray(t.vertexIndices, entryCount)
+				&& reader.ReadArray(t.positionDeltas, entryCount)
+				&& (!(deltaFlags & 1) || reader.ReadArray(t.normalDeltas, entryCount))
+				&& (!(deltaFlags & 2) || reader.ReadArray(t.tangentDeltas, entryCount));
+			if (!targetRead) {
+				return false;
+			}
+		}
+		return true;
+	}
+	default: return true;
+	}
+}
 
-	int numChunks = 0;
+void MshLoader::AssembleMesh(LoadedChunks& chunks, Mesh& destinationMesh) {
+	if (chunks.Has(GeometryChunkTypes::VPositions)) {
+		destinationMesh.SetVertexPositions(std::move(chunks.positions));
+	}
+	if (chunks.Has(GeometryChunkTypes::VColors)) {
+		destinationMesh.SetVertexColours(std::move(chunks.colours));
+	}
+	if (chunks.Has(GeometryChunkTypes::VNormals)) {
+		destinationMesh.SetVertexNormals(std::move(chunks.normals));
+	}
+	if (chunks.Has(GeometryChunkTypes::VTangents)) {
+		destinationMesh.SetVertexTangents(std::move(chunks.tangents));
+	}
+	if (chunks.Has(GeometryChunkTypes::VTex0)) {
+		destinationMesh.SetVertexTextureCoords(std::move(chunks.texCoords));
+	}
+	if (chunks.Has(GeometryChunkTypes::Indices)) {
+		if (chunks.shortIndices.empty()) {
+			destinationMesh.SetVertexIndices(std::move(chunks.indices));
+		}
+		else {
+			destinationMesh.SetVertexIndices(std::move(chunks.shortIndices));
+		}
+	}
+	if (chunks.Has(GeometryChunkTypes::VWeightValues)) {
+		destinationMesh.SetVertexSkinWeights(std::move(chunks.skinWeights));
+	}
+	if (chunks.Has(GeometryChunkTypes::VWeightIndices)) {
+		destinationMesh.SetVertexSkinIndices(std::move(chunks.skinIndices));
+	}
+	if (chunks.Has(GeometryChunkTypes::JointNames)) {
+		destinationMesh.SetJointNames(chunks.jointNames);
+	}
+	if (chunks.Has(GeometryChunkTypes::JointParents)) {
+		destinationMesh.SetJointParents(chunks.jointParents);
+	}
+	if (chunks.Has(GeometryChunkTypes::BindPose)) {
+		destinationMesh.SetBindPose(std::move(chunks.bindPose));
+	}
+	if (chunks.Has(GeometryChunkTypes::BindPoseInv)) {
+		destinationMesh.SetInverseBindPose(std::move(chunks.inverseBindPose));
+	}
+	if (chunks.Has(GeometryChunkTypes::SubMeshes)) {
+		destinationMesh.SetSubMeshes(std::move(chunks.subMeshes));
+	}
+	if (chunks.Has(GeometryChunkTypes::SubMeshNames)) {
+		destinationMesh.SetSubMeshNames(chunks.subMeshNames);
+	}
+	for (const MorphTarget& t : chunks.morphTargets) {
+		destinationMesh.AddMorphTarget(t);
+	}
+	//After the float data, as setting that discards any quantised copy
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		if (!chunks.quantised[i].IsEmpty()) {
+			destinationMesh.SetQuantisedAttribute((VertexAttribute::Type)i, std::move(chunks.quantised[i]));
+		}
+	}
 
-	if (!sourceMesh.GetPositionData().empty()) {
-		numChunks++;
+	//Bounds can be stored before the positions they cover, so are applied once everything else is set
+	if (chunks.Has(GeometryChunkTypes::Bounds)) {
+		destinationMesh.SetBounds(chunks.meshBounds, chunks.subMeshBounds);
 	}
-	if (!sourceMesh.GetColourData().empty()) {
-		numChunks++;
+	else {
+		destinationMesh.CalculateBounds();
 	}
-	if (!sourceMesh.GetNormalData().empty()) {
-		numChunks++;
+
+	if (!destinationMesh.GetBindPose().empty() && destinationMesh.GetInverseBindPose().empty()) {
+		destinationMesh.CalculateInverseBindPose();
 	}
-	if (!sourceMesh.GetTangentData().empty()) {
-		numChunks++;
+
+	destinationMesh.SetPrimitiveType(GeometryPrimitive::Triangles);
+}
+
+uint32_t MshLoader::GetSaveChunks(const Mesh& sourceMesh) {
+	size_t numVertices = sourceMesh.GetVertexCount();
+	uint32_t chunks = 0;
+
+	//Each vertex attribute is stored as numVertices elements, so must be complete to be saved
+	struct Attribute {
+		GeometryChunkTypes	type;
+		size_t				count;
+		const char*			name;
+	};
+	const Attribute attributes[] = {
+		{ GeometryChunkTypes::VPositions,		sourceMesh.GetPositionData().size(),	"positions"		},
+		{ GeometryChunkTypes::VColors,			AttributeCount(sourceMesh, sourceMesh.GetColourData().size(),		VertexAttribute::Colours),		"colours"		},
+		{ GeometryChunkTypes::VNormals,			AttributeCount(sourceMesh, sourceMesh.GetNormalData().size(),		VertexAttribute::Normals),		"normals"		},
+		{ GeometryChunkTypes::VTangents,		AttributeCount(sourceMesh, sourceMesh.GetTangentData().size(),		VertexAttribute::Tangents),		"tangents"		},
+		{ GeometryChunkTypes::VTex0,			AttributeCount(sourceMesh, sourceMesh.GetTextureCoordData().size(),	VertexAttribute::TextureCoords),"tex coords"	},
+		{ GeometryChunkTypes::VWeightValues,	AttributeCount(sourceMesh, sourceMesh.GetSkinWeightData().size(),	VertexAttribute::JointWeights), "skin weights"	},
+		{ GeometryChunkTypes::VWeightIndices,	sourceMesh.GetSkinIndexData().size(),	"skin indices"	},
+	};
+	for (const Attribute& a : attributes) {
+		if (a.count == 0) {
+			continue;
+		}
+		if (a.count != numVertices) {
+			std::cout << __FUNCTION__ << " Mesh has " << a.count << " " << a.name << " but " << numVertices << " vertices!\n";
+			return 0;
+		}
+		chunks |= (uint32_t)a.type;
 	}
-	if (!sourceMesh.GetTextureCoordData().empty()) {
-		numChunks++;
+	if (!sourceMesh.GetSubMeshNames().empty() && sourceMesh.GetSubMeshNames().size() != sourceMesh.GetSubMeshCount()) {
+		std::cout << __FUNCTION__ << " Mesh has " << sourceMesh.GetSubMeshNames().size() << " sub-mesh names but " << sourceMesh.GetSubMeshCount() << " sub-meshes!\n";
+		return 0;
 	}
-	if (!sourceMesh.GetIndexData().empty()) {
-		numChunks++;
+	for (const std::string& name : sourceMesh.GetSubMeshNames()) {
+		if (name.find('\n') != std::string::npos) {
+			std::cout << __FUNCTION__ << " Sub-mesh names can't contain line breaks!\n";
+			return 0;
+		}
 	}
-	if (!sourceMesh.GetSkinWeightData().empty()) {
-		numChunks++;
+	for (const std::string& name : sourceMesh.GetJointNames()) {
+		if (name.find('\n') != std::string::npos) {
+			std::cout << __FUNCTION__ << " Joint names can't contain line breaks!\n";
+			return 0;
+		}
 	}
-	if (!sourceMesh.GetSkinIndexData().empty()) {
-		numChunks++;
+	if (sourceMesh.GetIndexCount() > 0) {
+		chunks |= (uint32_t)GeometryChunkTypes::Indices;
 	}
 	if (!sourceMesh.GetJointNames().empty()) {
-		numChunks++;
+		chunks |= (uint32_t)GeometryChunkTypes::JointNames;
 	}
 	if (!sourceMesh.GetJointParents().empty()) {
-		numChunks++;
+		chunks |= (uint32_t)GeometryChunkTypes::JointParents;
 	}
 	if (!sourceMesh.GetBindPose().empty()) {
-		numChunks++;
+		chunks |= (uint32_t)GeometryChunkTypes::BindPose;
 	}
 	if (!sourceMesh.GetInverseBindPose().empty()) {
-		numChunks++;
+		chunks |= (uint32_t)GeometryChunkTypes::BindPoseInv;
 	}
 	if (sourceMesh.GetSubMeshCount() >= 1) {
-		numChunks++;
+		chunks |= (uint32_t)GeometryChunkTypes::SubMeshes;
 	}
 	if (!sourceMesh.GetSubMeshNames().empty()) {
-		numChunks++;
+		chunks |= (uint32_t)GeometryChunkTypes::SubMeshNames;
 	}
-	
-	file << sourceMesh.GetSubMeshCount();
-	file << sourceMesh.GetVertexCount();
-	file << sourceMesh.GetIndexCount();
-	file << numChunks;
-
-	//And now to save each chunk out!
-
+	if (numVertices > 0) {
+		chunks |= (uint32_t)GeometryChunkTypes::Bounds;
+	}
+	if (!sourceMesh.GetMorphTargets().empty()) {
+		chunks |= (uint32_t)GeometryChunkTypes::MorphTargets;
+	}
+	if (chunks == 0) {
+		std::cout << __FUNCTION__ << " Mesh has no data to save!\n";
+	}
+	return chunks;
+}
 
-	if (!sourceMesh.GetPositionData().empty()) {
-		file << (int)GeometryChunkTypes::VPositions << "\n";
+bool MshLoader::SaveMesh(const std::string& filename, const Mesh& sourceMesh) {
+	uint32_t chunks = GetSaveChunks(sourceMesh);
+	if (chunks == 0) {
+		return false;
+	}
+	auto Has = [chunks](GeometryChunkTypes type) {
+		return (chunks & (uint32_t)type) != 0;
+	};
+	//The whole file is built in memory and written at once, rather than a number at a time
+	std::string file;
+	file.reserve(sourceMesh.GetVertexCount() * 64 + sourceMesh.GetIndexCount() * 8 + 256);
+
+	file += "MeshGeometry\n";
+	AppendNumber(file, TEXT_VERSION);
+	file += "\n";
+	AppendNumber(file, sourceMesh.GetSubMeshCount());
+	file += " ";
+	AppendNumber(file, sourceMesh.GetVertexCount());
+	file += " ";
+	AppendNumber(file, sourceMesh.GetIndexCount());
+	file += " ";
+	AppendNumber(file, CountBits(chunks));
+	file += "\n";
+
+	auto BeginChunk = [&](GeometryChunkTypes type) {
+		AppendNumber(file, (int)type);
+		file += "\n";
+	};
+
+	if (Has(GeometryChunkTypes::VPositions)) {
+		BeginChunk(GeometryChunkTypes::VPositions);
 		WriteTextFloats(file, sourceMesh.GetPositionData());
 	}
-	if (!sourceMesh.GetColourData().empty()) {
-		file << (int)GeometryChunkTypes::VColors << "\n";
-		WriteTextFloats(file, sourceMesh.GetColourData());
+	if (Has(GeometryChunkTypes::VColors)) {
+		BeginChunk(GeometryChunkTypes::VColors);
+		vector<Vector4> expanded;
+		WriteTextFloats(file, AttributeFloats(sourceMesh, sourceMesh.GetColourData(), VertexAttribute::Colours, expanded));
 	}
-	if (!sourceMesh.GetNormalData().empty()) {
-		file << (int)GeometryChunkTypes::VNormals << "\n";
-		WriteTextFloats(file, sourceMesh.GetNormalData());
+	if (Has(GeometryChunkTypes::VNormals)) {
+		BeginChunk(GeometryChunkTypes::VNormals);
+		vector<Vector3> expanded;
+		WriteTextFloats(file, AttributeFloats(sourceMesh, sourceMesh.GetNormalData(), VertexAttribute::Normals, expanded));
 	}
-	if (!sourceMesh.GetTangentData().empty()) {
-		file << (int)GeometryChunkTypes::VTangents << "\n";
-		WriteTextFloats(file, sourceMesh.GetTangentData());
+	if (Has(GeometryChunkTypes::VTangents)) {
+		BeginChunk(GeometryChunkTypes::VTangents);
+		vector<Vector4> expanded;
+		WriteTextFloats(file, AttributeFloats(sourceMesh, sourceMesh.GetTangentData(), VertexAttribute::Tangents, expanded));
 	}
-	if (!sourceMesh.GetTextureCoordData().empty()) {
-		file << (int)GeometryChunkTypes::VTex0 << "\n";
-		WriteTextFloats(file, sourceMesh.GetTextureCoordData());
+	if (Has(GeometryChunkTypes::VTex0)) {
+		BeginChunk(GeometryChunkTypes::VTex0);
+		vector<Vector2> expanded;
+		WriteTextFloats(file, AttributeFloats(sourceMesh, sourceMesh.GetTextureCoordData(), VertexAttribute::TextureCoords, expanded));
 	}
-	if (!sourceMesh.GetIndexData().empty()) {
-		file << (int)GeometryChunkTypes::Indices << "\n";
-		WriteIntegers(file, sourceMesh.GetIndexData());
+	if (Has(GeometryChunkTypes::Indices)) {
+		BeginChunk(GeometryChunkTypes::Indices);
+		if (sourceMesh.GetIndexFormat() == IndexFormat::UnsignedShort) {
+			WriteIntegers(file, sourceMesh.GetShortIndexData());
+		}
+		else {
+			WriteIntegers(file, sourceMesh.GetIndexData());
+		}
 	}
-	if (!sourceMesh.GetSkinWeightData().empty()) {
-		file << (int)GeometryChunkTypes::VWeightValues << "\n";
-		WriteTextFloats(file, sourceMesh.GetSkinWeightData());
+	if (Has(GeometryChunkTypes::VWeightValues)) {
+		BeginChunk(GeometryChunkTypes::VWeightValues);
+		vector<Vector4> expanded;
+		WriteTextFloats(file, AttributeFloats(sourceMesh, sourceMesh.GetSkinWeightData(), VertexAttribute::JointWeights, expanded));
 	}
-	if (!sourceMesh.GetSkinIndexData().empty()) {
-		file << (int)GeometryChunkTypes::VWeightIndices << "\n";
+	if (Has(GeometryChunkTypes::VWeightIndices)) {
+		BeginChunk(GeometryChunkTypes::VWeightIndices);
 		WriteIntegers(file, sourceMesh.GetSkinIndexData());
 	}
-	if (!sourceMesh.GetJointNames().empty()) {
-		file << (int)GeometryChunkTypes::JointNames << "\n";
-
+	if (Has(GeometryChunkTypes::JointNames)) {
+		BeginChunk(GeometryChunkTypes::JointNames);
+		AppendNumber(file, sourceMesh.GetJointNames().size());
+		file += "\n";
+		WriteStrings(file, sourceMesh.GetJointNames());
 	}
-	if (!sourceMesh.GetJointParents().empty()) {
-		file << (int)GeometryChunkTypes::JointParents << "\n";
-
+	if (Has(GeometryChunkTypes::JointParents)) {
+		BeginChunk(GeometryChunkTypes::JointParents);
+		AppendNumber(file, sourceMesh.GetJointParents().size());
+		file += "\n";
+		WriteIntegers(file, sourceMesh.GetJointParents());
 	}
-	if (!sourceMesh.GetBindPose().empty()) {
-		file << (int)GeometryChunkTypes::BindPose << "\n";
+	if (Has(GeometryChunkTypes::BindPose)) {
+		BeginChunk(GeometryChunkTypes::BindPose);
 		WriteMatrices(file, sourceMesh.GetBindPose());
 	}
-	if (!sourceMesh.GetInverseBindPose().empty()) {
-		file << (int)GeometryChunkTypes::BindPoseInv << "\n";
+	if (Has(GeometryChunkTypes::BindPoseInv)) {
+		BeginChunk(GeometryChunkTypes::BindPoseInv);
 		WriteMatrices(file, sourceMesh.GetInverseBindPose());
 	}
-	if (sourceMesh.GetSubMeshCount() >= 1) {
-		file << (int)GeometryChunkTypes::SubMeshes << "\n";
+	if (Has(GeometryChunkTypes::SubMeshes)) {
+		BeginChunk(GeometryChunkTypes::SubMeshes);
+		vector<SubMesh> subMeshes(sourceMesh.GetSubMeshCount());
+		for (size_t i = 0; i < subMeshes.size(); ++i) {
+			subMeshes[i] = *sourceMesh.GetSubMesh((unsigned int)i);
+		}
+		WriteSubMeshes(file, subMeshes);
+	}
+	if (Has(GeometryChunkTypes::SubMeshNames)) {
+		BeginChunk(GeometryChunkTypes::SubMeshNames);
+		WriteStrings(file, sourceMesh.GetSubMeshNames());
+	}
+	if (Has(GeometryChunkTypes::Bounds)) {
+		BeginChunk(GeometryChunkTypes::Bounds);
+		WriteBounds(file, sourceMesh.GetBounds());
+		for (size_t i = 0; i < sourceMesh.GetSubMeshCount(); ++i) {
+			WriteBounds(file, sourceMesh.GetSubMeshBounds(i));
+		}
+	}
+	if (Has(GeometryChunkTypes::MorphTargets)) {
+		BeginChunk(GeometryChunkTypes::MorphTargets);
+		WriteMorphTargets(file, sourceMesh.GetMorphTargets());
+	}
 
+	std::ofstream output(filename, std::ios::binary);
+	if (!output.write(file.data(), file.size())) {
+		std::cout << __FUNCTION__ << " can't write to " << filename << "!\n";
+		return false;
 	}
-	if (!sourceMesh.GetSubMeshNames().empty()) {
-		file << (int)GeometryChunkTypes::SubMeshNames << "\n";
+	return true;
+}
 
+//Arrays are written straight from the mesh, other chunks are packed into a payload first
+struct MshLoader::OutputChunk {
+	OutputChunk(GeometryChunkTypes type, const void* data, size_t size, uint32_t elementCount, std::string&& payload = std::string())
+		: type(type), data(data), size(size), elementCount(elementCount), payload(std::move(payload)) {
 	}
 
+	GeometryChunkTypes	type;
+	const void*			data;
+	size_t				size;
+	uint32_t			elementCount;
+	std::string			payload;
+	GeometryChunkData	dataType	= GeometryChunkData::dFloat;
+	ChunkFilter			filter		= ChunkFilter::None;	//Used if the chunk is compressed
+	uint32_t			flags		= 0;
+
+	const char* GetData() const {
+		return data ? (const char*)data : payload.data();
+	}
+};
+
+bool MshLoader::GetOutputChunks(const Mesh& sourceMesh, GeometryChunkData attributeFormat, vector<OutputChunk>& chunks) {
+	uint32_t attributeBytes = BytesPerValue(attributeFormat);
+	if (attributeFormat != GeometryChunkData::dFloat && attributeBytes == 0) {
+		std::cout << __FUNCTION__ << " vertex attributes can only be saved as floats, shorts or bytes!\n";
+		return false;
+	}
+	uint32_t chunkMask = GetSaveChunks(sourceMesh);
+	if (chunkMask == 0) {
+		return false;
+	}
+	auto Has = [chunkMask](GeometryChunkTypes type) {
+		return (chunkMask & (uint32_t)type) != 0;
+	};
 
+	auto AddArray = [&](GeometryChunkTypes type, const auto& elements) {
+		if (!Has(type)) {
+			return;
+		}
+		chunks.emplace_back(type, elements.data(), elements.size() * sizeof(elements[0]), (uint32_t)elements.size());
+		if (type == GeometryChunkTypes::Indices || type == GeometryChunkTypes::JointParents) {
+			chunks.back().filter = sizeof(elements[0]) == 2 ? ChunkFilter::Delta16 : ChunkFilter::Delta32;
+		}
+		else {
+			chunks.back().filter = ChunkFilter::Shuffle4;
+		}
+	};
+	auto AddPayload = [&](GeometryChunkTypes type, uint32_t elementCount, std::string&& payload) {
+		size_t size = payload.size();
+		chunks.emplace_back(type, nullptr, size, elementCount, std::move(payload));
+	};
+	auto AddQuantised = [&](GeometryChunkTypes type, const QuantisedAttribute& q) {
+		QuantisationHeader header;
+		memcpy(header.offset, q.offset, sizeof(header.offset));
+		memcpy(header.scale, q.scale, sizeof(header.scale));
+
+		std::string payload;
+		AppendBinary(payload, header);
+		payload.append((const char*)q.data.data(), q.data.size());
+		AddPayload(type, (uint32_t)q.GetCount(), std::move(payload));
+		chunks.back().dataType	= q.bytesPerValue == 2 ? GeometryChunkData::dShort : GeometryChunkData::dByte;
+		chunks.back().filter	= q.bytesPerValue == 2 ? ChunkFilter::Shuffle2 : ChunkFilter::None;
+	};
+	//Float attributes are quantised if asked for, and those the mesh only holds quantised are written as they are.
+	//Positions and tex coords always get 16 bits, as 8 isn't enough precision for either.
+	auto AddAttribute = [&](GeometryChunkTypes type, VertexAttribute::Type attribute, const auto& elements) {
+		if (!Has(type)) {
+			return;
+		}
+		const QuantisedAttribute* existing = sourceMesh.GetQuantisedAttribute(attribute);
+		if (elements.empty() && existing) {
+			AddQuantised(type, *existing);
+		}
+		else if (attributeFormat == GeometryChunkData::dFloat) {
+			AddArray(type, elements);
+		}
+		else {
+			bool highPrecision = attribute == VertexAttribute::Positions || attribute == VertexAttribute::TextureCoords;
+			uint32_t components = sizeof(elements[0]) / sizeof(float);
+			AddQuantised(type, QuantisedAttribute::Quantise((const float*)elements.data(), elements.size(), components, highPrecision ? 2 : attributeBytes));
+		}
+	};
+	auto AppendStrings = [](std::string& payload, const vector<std::string>& strings) {
+		for (const std::string& s : strings) {
+			AppendBinary(payload, (uint32_t)s.size());
+			payload += s;
+		}
+	};
+
+	AddAttribute(GeometryChunkTypes::VPositions,	VertexAttribute::Positions,		sourceMesh.GetPositionData());
+	AddAttribute(GeometryChunkTypes::VColors,		VertexAttribute::Colours,		sourceMesh.GetColourData());
+	AddAttribute(GeometryChunkTypes::VNormals,		VertexAttribute::Normals,		sourceMesh.GetNormalData());
+	AddAttribute(GeometryChunkTypes::VTangents,		VertexAttribute::Tangents,		sourceMesh.GetTangentData());
+	AddAttribute(GeometryChunkTypes::VTex0,			VertexAttribute::TextureCoords, sourceMesh.GetTextureCoordData());
+	if (sourceMesh.GetIndexFormat() == IndexFormat::UnsignedShort) {
+		AddArray(GeometryChunkTypes::Indices, sourceMesh.GetShortIndexData());
+	}
+	else {
+		AddArray(GeometryChunkTypes::Indices, sourceMesh.GetIndexData());
+	}
+	AddAttribute(GeometryChunkTypes::VWeightValues, VertexAttribute::JointWeights,	sourceMesh.GetSkinWeightData());
+	AddArray(GeometryChunkTypes::VWeightIndices,sourceMesh.GetSkinIndexData());
+	if (Has(GeometryChunkTypes::JointNames)) {
+		std::string payload;
+		AppendStrings(payload, sourceMesh.GetJointNames());
+		AddPayload(GeometryChunkTypes::JointNames, (uint32_t)sourceMesh.GetJointNames().size(), std::move(payload));
+	}
+	AddArray(GeometryChunkTypes::JointParents,	sourceMesh.GetJointParents());
+	AddArray(GeometryChunkTypes::BindPose,		sourceMesh.GetBindPose());
+	AddArray(GeometryChunkTypes::BindPoseInv,	sourceMesh.GetInverseBindPose());
+	if (Has(GeometryChunkTypes::SubMeshes)) {
+		std::string payload;
+		for (size_t i = 0; i < sourceMesh.GetSubMeshCount(); ++i) {
+			AppendBinary(payload, *sourceMesh.GetSubMesh((unsigned int)i));
+		}
+		AddPayload(GeometryChunkTypes::SubMeshes, (uint32_t)sourceMesh.GetSubMeshCount(), std::move(payload));
+		chunks.back().filter = ChunkFilter::Shuffle4;
+	}
+	if (Has(GeometryChunkTypes::SubMeshNames)) {
+		std::string payload;
+		AppendStrings(payload, sourceMesh.GetSubMeshNames());
+		AddPayload(GeometryChunkTypes::SubMeshNames, (uint32_t)sourceMesh.GetSubMeshNames().size(), std::move(payload));
+	}
+	if (Has(GeometryChunkTypes::Bounds)) {
+		std::string payload;
+		AppendBinary(payload, sourceMesh.GetBounds());
+		for (size_t i = 0; i < sourceMesh.GetSubMeshCount(); ++i) {
+			AppendBinary(payload, sourceMesh.GetSubMeshBounds(i));
+		}
+		AddPayload(GeometryChunkTypes::Bounds, (uint32_t)sourceMesh.GetSubMeshCount() + 1, std::move(payload));
+		chunks.back().filter = ChunkFilter::Shuffle4;
+	}
+	if (Has(GeometryChunkTypes::MorphTargets)) {
+		std::string payload;
+		for (const MorphTarget& t : sourceMesh.GetMorphTargets()) {
+			AppendBinary(payload, (uint32_t)t.name.size());
+			payload += t.name;
+			AppendBinary(payload, (uint32_t)t.vertexIndices.size());
+			AppendBinary(payload, (uint32_t)((t.normalDeltas.empty() ? 0 : 1) | (t.tangentDeltas.empty() ? 0 : 2)));
+			payload.append((const char*)t.vertexIndices.data(),	t.vertexIndices.size()	* sizeof(uint32_t));
+			payload.append((const char*)t.positionDeltas.data(),t.positionDeltas.size() * sizeof(Vector3));
+			payload.append((const char*)t.normalDeltas.data(),	t.normalDeltas.size()	* sizeof(Vector3));
+			payload.append((const char*)t.tangentDeltas.data(),	t.tangentDeltas.size()	* sizeof(Vector3));
+		}
+		AddPayload(GeometryChunkTypes::MorphTargets, (uint32_t)sourceMesh.GetMorphTargets().size(), std::move(payload));
+	}
 
 	return true;
 }
 
-void MshLoader::ReadRigPose(std::ifstream& file, vector<Matrix4>& into) {
-	int matCount = 0;
-	file >> matCount;
+bool MshLoader::SaveBinaryMesh(const std::string& filename, const Mesh& sourceMesh, GeometryChunkData attributeFormat, bool compress) {
+	vector<OutputChunk> chunks;
+	if (!GetOutputChunks(sourceMesh, attributeFormat, chunks)) {
+		return false;
+	}
+	if (compress) {
+		bool triangles = sourceMesh.GetPrimitiveType() == GeometryPrimitive::Triangles;
+		//Chunks that don't shrink are left as they are
+		ThreadPool::GetGlobalPool().ParallelFor(chunks.size(), 1, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				OutputChunk& c = chunks[i];
+				std::string packed;
+				ChunkCompression::Compress(c.GetData(), c.size, c.filter, packed);
+
+				GeometryChunkData dataType = c.dataType;
+				if (c.type == GeometryChunkTypes::Indices && triangles && c.elementCount > 0) {
+					std::string coded;
+					PackTriangles(c.GetData(), c.elementCount, (uint32_t)(c.size / c.elementCount), coded);
+					if (coded.size() < packed.size()) {
+						packed		= std::move(coded);
+						dataType	= GeometryChunkData::dTriangles;
+					}
+				}
+				if (packed.size() < c.size) {
+					c.payload	= std::move(packed);
+					c.data		= nullptr;
+					c.size		= c.payload.size();
+					c.dataType	= dataType;
+					c.flags		= CHUNK_COMPRESSED;
+				}
+			}
+		});
+	}
 
-	for (int m = 0; m < matCount; ++m) {
-		Matrix4 mat;
+	//Every offset is known up front, so the header, payloads and contents go out in one pass
+	vector<BinaryChunkEntry> contents;
+	uint64_t offset = sizeof(BinaryMeshHeader);
+	for (const OutputChunk& c : chunks) {
+		offset = (offset + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1);
+		contents.push_back({ (uint32_t)c.type, (uint32_t)c.dataType, offset, c.size, c.elementCount, c.flags });
+		offset += c.size;
+	}
+	offset = (offset + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1);
+
+	BinaryMeshHeader header;
+	header.magic		= BINARY_MAGIC;
+	header.version		= BINARY_VERSION;
+	header.numMeshes	= (uint32_t)sourceMesh.GetSubMeshCount();
+	header.numVertices	= (uint32_t)sourceMesh.GetVertexCount();
+	header.numIndices	= (uint32_t)sourceMesh.GetIndexCount();
+	header.numChunks	= (uint32_t)chunks.size();
+	header.tocOffset	= offset;
+
+	std::ofstream output(filename, std::ios::binary);
+	const char padding[CHUNK_ALIGNMENT] = {};
+	uint64_t written = sizeof(header);
+	output.write((const char*)&header, sizeof(header));
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		output.write(padding, contents[i].offset - written);
+		output.write(chunks[i].GetData(), chunks[i].size);
+		written = contents[i].offset + chunks[i].size;
+	}
+	output.write(padding, offset - written);
+	output.write((const char*)contents.data(), contents.size() * sizeof(BinaryChunkEntry));
 
-		for (int i = 0; i < 4; ++i) {
-			for (int j = 0; j < 4; ++j) {
-				file >> mat.array[i][j];
-			}
+	if (!output) {
+		std::cout << __FUNCTION__ << " can't write to " << filename << "!\n";
+		return false;
+	}
+	return true;
+}
+
+bool MshLoader::ReportCompression(const Mesh& sourceMesh, vector<ChunkCompressionReport>& report, GeometryChunkData attributeFormat) {
+	vector<OutputChunk> chunks;
+	if (!GetOutputChunks(sourceMesh, attributeFormat, chunks)) {
+		return false;
+	}
+	report.clear();
+	std::string	 packed;
+	vector<char> unpacked;
+	for (const OutputChunk& c : chunks) {
+		ChunkCompressionReport chunkReport;
+		chunkReport.type = c.type;
+
+		packed.clear();
+		ChunkCompression::Compress(c.GetData(), c.size, c.filter, packed, &chunkReport.compression);
+		unpacked.resize(c.size);
+		if (!ChunkCompression::Decompress(packed.data(), packed.size(), unpacked.data(), c.size, &chunkReport.decompression) ||
+			memcmp(unpacked.data(), c.GetData(), c.size) != 0) {
+			std::cout << __FUNCTION__ << " Chunk type " << (int)c.type << " did not survive compression!\n";
+			return false;
 		}
+		report.emplace_back(chunkReport);
+	}
+	return true;
+}
 
-		into.emplace_back(mat);
+void MshLoader::ReadRigPose(TextReader& file, vector<Matrix4>& into) {
+	int matCount = 0;
+	file.Read(matCount);
+
+	size_t first = into.size();
+	into.resize(first + std::max(matCount, 0));
+	for (size_t m = first; m < into.size(); ++m) {
+		file.ReadFloats(&into[m].array[0][0], 16);
 	}
 }
 
-void MshLoader::ReadJointParents(std::ifstream& file, std::vector<int>& parentIDs) {
+void MshLoader::ReadJointParents(TextReader& file, std::vector<int>& parentIDs) {
 	int jointCount = 0;
-	file >> jointCount;
+	file.Read(jointCount);
 
 	for (int i = 0; i < jointCount; ++i) {
 		int id = -1;
-		file >> id;
+		file.Read(id);
 		parentIDs.emplace_back(id);
 	}
 }
 
-void MshLoader::ReadJointNames(std::ifstream& file, std::vector<std::string>& jointNames) {
+void MshLoader::ReadJointNames(TextReader& file, std::vector<std::string>& jointNames) {
 	int jointCount = 0;
-	file >> jointCount;
+	file.Read(jointCount);
 	std::string jointName;
-	std::getline(file, jointName);
+	file.ReadLine(jointName);
 
 	for (int i = 0; i < jointCount; ++i) {
 		std::string jointName;
-		std::getline(file, jointName);
+		file.ReadLine(jointName);
 		jointNames.emplace_back(jointName);
 	}
 }
 
-void MshLoader::ReadSubMeshes(std::ifstream& file, int count, std::vector<SubMesh>& subMeshes) {
+void MshLoader::ReadSubMeshes(TextReader& file, int count, int fileVersion, std::vector<SubMesh>& subMeshes) {
 	for (int i = 0; i < count; ++i) {
 		SubMesh m;
-		file >> m.start;
-		file >> m.count;
+		file.Read(m.start);
+		file.Read(m.count);
+		if (fileVersion >= 2) { //Version 1 files had no base vertex
+			file.Read(m.base);
+		}
 		subMeshes.emplace_back(m);
 	}
 }
 
-void MshLoader::ReadSubMeshNames(std::ifstream& file, int count, std::vector<std::string>& subMeshNames) {
+void MshLoader::ReadSubMeshNames(TextReader& file, int count, std::vector<std::string>& subMeshNames) {
 	std::string scrap;
-	std::getline(file, scrap);
+	file.ReadLine(scrap);
 
 	for (int i = 0; i < count; ++i) {
 		std::string meshName;
-		std::getline(file, meshName);
+		file.ReadLine(meshName);
 		subMeshNames.emplace_back(meshName);
 	}
 }
 
-void* MshLoader::ReadVertexData(GeometryChunkData dataType, GeometryChunkTypes chunkType, int numVertices) {
-	int numElements = 3;
+void MshLoader::ReadBounds(TextReader& file, BoundingVolume& bounds) {
+	file.ReadFloats(&bounds.boxMin.x, 3);
+	file.ReadFloats(&bounds.boxMax.x, 3);
+	file.ReadFloats(&bounds.sphereCentre.x, 3);
+	file.Read(bounds.sphereRadius);
+}
 
-	if (chunkType == GeometryChunkTypes::VTex0 ||
-		chunkType == GeometryChunkTypes::VTex1) {
-		numElements = 2;
-	}
-	else if (chunkType == GeometryChunkTypes::VColors) {
-		numElements = 4;
+void MshLoader::ReadMorphTargets(TextReader& file, vector<MorphTarget>& targets) {
+	int targetCount = 0;
+	file.Read(targetCount);
+
+	for (int i = 0; i < targetCount; ++i) {
+		MorphTarget t;
+		file.SkipLine(); //The rest of the count's line, or of the previous target's last line
+		file.ReadLine(t.name);
+
+		int entryCount		= 0;
+		int hasNormals		= 0;
+		int hasTangents		= 0;
+		file.Read(entryCount);
+		file.Read(hasNormals);
+		file.Read(hasTangents);
+
+		for (int e = 0; e < entryCount; ++e) {
+			uint32_t index = 0;
+			Vector3 delta;
+			file.Read(index);
+			file.ReadFloats(&delta.x, 3);
+			t.vertexIndices.emplace_back(index);
+			t.positionDeltas.emplace_back(delta);
+			if (hasNormals) {
+				file.ReadFloats(&delta.x, 3);
+				t.normalDeltas.emplace_back(delta);
+			}
+			if (hasTangents) {
+				file.ReadFloats(&delta.x, 3);
+				t.tangentDeltas.emplace_back(delta);
+			}
+		}
+		targets.emplace_back(std::move(t));
 	}
+}
 
-	int bytesPerElement = 4;
 
-	if (dataType == GeometryChunkData::dShort) {
-		bytesPerElement = 2;
+void MshLoader::ReadTextInts(TextReader& file, vector<Vector2i>& element, int numVertices) {
+	size_t first = element.size();
+	element.resize(first + numVertices);
+	for (size_t i = first; i < element.size(); ++i) {
+		file.Read(element[i].x);
+		file.Read(element[i].y);
 	}
-	else if (dataType == GeometryChunkData::dByte) {
-		bytesPerElement = 1;
+}
+
+void MshLoader::ReadTeReadTextIntsxtFloats(TextReader& file, vector<Vector3i>& element, int numVertices) {
+	size_t first = element.size();
+	element.resize(first + numVertices);
+	for (size_t i = first; i < element.size(); ++i) {
+		file.Read(element[i].x);
+		file.Read(element[i].y);
+		file.Read(element[i].z);
 	}
+}
 
-	char* data = new char[numElements * bytesPerElement];
+void MshLoader::ReadTextInts(TextReader& file, vector<Vector4i>& element, int numVertices) {
+	size_t first = element.size();
+	element.resize(first + numVertices);
+	for (size_t i = first; i < element.size(); ++i) {
+		file.Read(element[i].x);
+		file.Read(element[i].y);
+		file.Read(element[i].z);
+		file.Read(element[i].w);
+	}
+}
 
-	return data;
+void MshLoader::ReadTextFloats(TextReader& file, vector<Vector2>& element, int numVertices) {
+	size_t first = element.size();
+	element.resize(first + numVertices);
+	file.ReadFloats((float*)(element.data() + first), (size_t)numVertices * 2);
 }
 
-void MshLoader::ReadTextInts(std::ifstream& file, vector<Vector2i>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector2i temp;
-		file >> temp[0];
-		file >> temp[1];
-		element.emplace_back(temp);
-	}
+void MshLoader::ReadTextFloats(TextReader& file, vector<Vector3>& element, int numVertices) {
+	size_t first = element.size();
+	element.resize(first + numVertices);
+	file.ReadFloats((float*)(element.data() + first), (size_t)numVertices * 3);
 }
 
-void MshLoader::ReadTeReadTextIntsxtFloats(std::ifstream& file, vector<Vector3i>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector3i temp;
-		file >> temp[0];
-		file >> temp[1];
-		file >> temp[2];
-		element.emplace_back(temp);
-	}
+void MshLoader::ReadTextFloats(TextReader& file, vector<Vector4>& element, int numVertices) {
+	size_t first = element.size();
+	element.resize(first + numVertices);
+	file.ReadFloats((float*)(element.data() + first), (size_t)numVertices * 4);
 }
 
-void MshLoader::ReadTextInts(std::ifstream& file, vector<Vector4i>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector4i temp;
-		file >> temp[0];
-		file >> temp[1];
-		file >> temp[2];
-		file >> temp[3];
-		element.emplace_back(temp);
+void MshLoader::ReadIntegers(TextReader& file, vector<unsigned int>& elements, int intCount) {
+	size_t first = elements.size();
+	elements.resize(first + intCount);
+	for (size_t i = first; i < elements.size(); ++i) {
+		file.Read(elements[i]);
 	}
 }
 
-void MshLoader::ReadTextFloats(std::ifstream& file, vector<Vector2>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector2 temp;
-		file >> temp.x;
-		file >> temp.y;
-		element.emplace_back(temp);
+void MshLoader::WriteTextFloats(std::string& file, const vector<Maths::Vector2>& elements) {
+	for (const auto& v : elements) {
+		AppendNumbers(file, &v.x, 2);
 	}
 }
 
-void MshLoader::ReadTextFloats(std::ifstream& file, vector<Vector3>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector3 temp;
-		file >> temp.x;
-		file >> temp.y;
-		file >> temp.z;
-		element.emplace_back(temp);
+void MshLoader::WriteTextFloats(std::string& file, const vector<Maths::Vector3>& elements) {
+	for (const auto& v : elements) {
+		AppendNumbers(file, &v.x, 3);
 	}
 }
 
-void MshLoader::ReadTextFloats(std::ifstream& file, vector<Vector4>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector4 temp;
-		file >> temp.x;
-		file >> temp.y;
-		file >> temp.z;
-		file >> temp.w;
-		element.emplace_back(temp);
+void MshLoader::WriteTextFloats(std::string& file, const vector<Maths::Vector4>& elements) {
+	for (const auto& v : elements) {
+		AppendNumbers(file, &v.x, 4);
 	}
 }
 
-void MshLoader::ReadIntegers(std::ifstream& file, vector<unsigned int>& elements, int intCount) {
-	for (int i = 0; i < intCount; ++i) {
-		unsigned int temp;
-		file >> temp;
-		elements.emplace_back(temp);
+void MshLoader::WriteIntegers(std::string& file, const vector<unsigned int>& elements) {
+	for (const auto& i : elements) {
+		AppendNumbers(file, &i, 1);
 	}
 }
 
-void MshLoader::WriteTextFloats(std::ofstream& file, const vector<Maths::Vector2>& elements) {
-	for(const auto& v : elements) {
-		file << v.x << " " << v.y << "\n";
+void MshLoader::WriteIntegers(std::string& file, const vector<uint16_t>& elements) {
+	for (const auto& i : elements) {
+		AppendNumbers(file, &i, 1);
 	}
 }
 
-void MshLoader::WriteTextFloats(std::ofstream& file, const vector<Maths::Vector3>& elements) {
-	for (const auto& v : elements) {
-		file << v.x << " " << v.y << " " << v.z << "\n";
+void MshLoader::WriteIntegers(std::string& file, const vector<int>& elements) {
+	for (const auto& i : elements) {
+		AppendNumbers(file, &i, 1);
 	}
 }
 
-void MshLoader::WriteTextFloats(std::ofstream& file, const vector<Maths::Vector4>& elements) {
+void MshLoader::WriteIntegers(std::string& file, const vector<Maths::Vector4i>& elements) {
 	for (const auto& v : elements) {
-		file << v.x << " " << v.y << " " << v.z << " " << v.w << "\n";
+		AppendNumbers(file, &v.x, 4);
 	}
 }
 
-void MshLoader::WriteIntegers(std::ofstream& file, const vector<unsigned int>& elements) {
-	for (const auto& i : elements) {
-		file << i << "\n";
+void MshLoader::WriteMatrices(std::string& file, const vector<Matrix4>& elements) {
+	AppendNumber(file, elements.size());
+	file += "\n";
+	for (const auto& m : elements) {
+		AppendNumbers(file, &m.array[0][0], 16);
 	}
 }
 
-void MshLoader::WriteIntegers(std::ofstream& file, const vector<Maths::Vector4i>& elements) {
-	for (const auto& v : elements) {
-		file << v.x << " " << v.y << " " << v.z << " " << v.w << "\n";
+void MshLoader::WriteStrings(std::string& file, const vector<std::string>& elements) {
+	for (const std::string& s : elements) {
+		file += s;
+		file += "\n";
 	}
 }
 
-void MshLoader::WriteMatrices(std::ofstream& file, const vector<Matrix4>& elements) {
+void MshLoader::WriteSubMeshes(std::string& file, const vector<struct SubMesh>& elements) {
 	for (const auto& m : elements) {
-		for (int i = 0; i < 4; ++i) {
-			for (int j = 0; j < 4; ++j) {
-				file << m.array[i][j] << " ";
-			}
-		}
-		file << "\n";
+		const int values[3] = { m.start, m.count, m.base };
+		AppendNumbers(file, values, 3);
 	}
 }
 
-void MshLoader::WriteSubMeshes(std::ofstream& file, const vector<struct SubMesh>& elements) {
-	for (const auto& m : elements) {
-		file << m.start << " " << m.count << "\n";
+void MshLoader::WriteBounds(std::string& file, const BoundingVolume& bounds) {
+	const float values[10] = {
+		bounds.boxMin.x, bounds.boxMin.y, bounds.boxMin.z,
+		bounds.boxMax.x, bounds.boxMax.y, bounds.boxMax.z,
+		bounds.sphereCentre.x, bounds.sphereCentre.y, bounds.sphereCentre.z,
+		bounds.sphereRadius
+	};
+	AppendNumbers(file, values, 10);
+}
+
+void MshLoader::WriteMorphTargets(std::string& file, const vector<MorphTarget>& targets) {
+	AppendNumber(file, targets.size());
+	file += "\n";
+	for (const MorphTarget& t : targets) {
+		file += t.name;
+		file += "\n";
+		const size_t header[3] = { t.vertexIndices.size(), (size_t)!t.normalDeltas.empty(), (size_t)!t.tangentDeltas.empty() };
+		AppendNumbers(file, header, 3);
+		for (size_t i = 0; i < t.vertexIndices.size(); ++i) {
+			AppendNumber(file, t.vertexIndices[i]);
+			file += " ";
+			AppendNumbers(file, &t.positionDeltas[i].x, 3, !t.normalDeltas.empty() || !t.tangentDeltas.empty() ? " " : "\n");
+			if (!t.normalDeltas.empty()) {
+				AppendNumbers(file, &t.normalDeltas[i].x, 3, !t.tangentDeltas.empty() ? " " : "\n");
+			}
+			if (!t.tangentDeltas.empty()) {
+				AppendNumbers(file, &t.tangentDeltas[i].x, 3);
+			}
+		}
 	}
-}
\ No newline at end of file
+}
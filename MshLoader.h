@@ -9,14 +9,14 @@ https://research.ncl.ac.uk/game/
 #pragma once
 #include "Vector.h"
 #include "Matrix.h"
+#include "MappedFile.h"
+#include "ChunkCompression.h"
 
 using std::vector;
 
 namespace NCL::Rendering {
 	class Mesh;
 
-	class MshLoader	{
-
 	enum class GeometryChunkTypes {
 		VPositions = 1 << 0,
 		VNormals = 1 << 1,
@@ -33,48 +33,211 @@ namespace NCL::Rendering {
 		BindPoseInv = 1 << 12,
 		Material = 1 << 13,
 		SubMeshes = 1 << 14,
-		SubMeshNames = 1 << 15
+		SubMeshNames = 1 << 15,
+		Bounds = 1 << 16,
+		MorphTargets = 1 << 17
 	};
 
 	enum class GeometryChunkData {
 		dFloat, //Just float data
 		dShort, //Translate from -32k to 32k to a float
 		dByte,	//Translate from -128 to 127 to a float
+		dTriangles,	//Triangle list indices packed with IndexCodec, after a uint32_t of their width in bytes
 	};
 
-	public:		
-		static bool LoadMesh(const std::string& filename, Mesh& destinationMesh);
+	//A chunk of a binary mesh file, pointing straight into the file's mapped memory.
+	//Payloads are 16 byte aligned, so attribute arrays can be read in place.
+	//Compressed chunks must be expanded with MappedMeshFile::ExpandChunk first.
+	struct MeshFileChunk {
+		GeometryChunkTypes	type;
+		GeometryChunkData	dataType;
+		uint32_t			elementCount;
+		const char*			data;
+		size_t				size;
+		bool				compressed = false;
+
+		template<typename T>
+		const T* GetData() const {
+			return (const T*)data;
+		}
+	};
+
+	//Maps a binary mesh file into memory, and reads its table of contents
+	class MappedMeshFile {
+	public:
+		//Filename is relative to the mesh asset directory, as with MshLoader::LoadMesh
+		bool Open(const std::string& filename);
+		void Close();
+
+		bool IsOpen() const {
+			return file.IsOpen();
+		}
+
+		const MeshFileChunk* GetChunk(GeometryChunkTypes type) const;
+
+		//Decompresses a compressed chunk into storage, with expanded describing the result.
+		//Uncompressed chunks are just copied to expanded, still pointing into the file.
+		static bool ExpandChunk(const MeshFileChunk& chunk, std::vector<char>& storage, MeshFileChunk& expanded, CompressionStats* stats = nullptr);
+
+		const std::vector<MeshFileChunk>& GetChunks() const {
+			return chunks;
+		}
 
-		static bool SaveMesh(const std::string& filename, Mesh& sourceMesh);
+		uint32_t GetMeshCount()		const { return numMeshes;	}
+		uint32_t GetVertexCount()	const { return numVertices;	}
+		uint32_t GetIndexCount()	const { return numIndices;	}
 
 	protected:
-		static void* ReadVertexData(GeometryChunkData dataType, GeometryChunkTypes chunkType, int numVertices);
-		static void ReadTextInts(std::ifstream& file, vector<Maths::Vector2i>& element, int numVertices);
-		static void ReadTeReadTextIntsxtFloats(std::ifstream& file, vector<Maths::Vector3i>& element, int numVertices);
-		static void ReadTextInts(std::ifstream& file, vector<Maths::Vector4i>& element, int numVertices);
-		static void ReadTextFloats(std::ifstream& file, vector<Maths::Vector2>& element, int numVertices);
-		static void ReadTextFloats(std::ifstream& file, vector<Maths::Vector3>& element, int numVertices);
-		static void ReadTextFloats(std::ifstream& file, vector<Maths::Vector4>& element, int numVertices);
-		static void ReadIntegers(std::ifstream& file, vector<unsigned int>& elements, int intCount);
+		MappedFile					file;
+		std::vector<MeshFileChunk>	chunks;
+		uint32_t					numMeshes	= 0;
+		uint32_t					numVertices = 0;
+		uint32_t					numIndices	= 0;
+	};
+
+	//Describes a chunk of a binary mesh file being streamed by a MeshStreamReader
+	struct MeshStreamChunk {
+		GeometryChunkTypes	type;
+		GeometryChunkData	dataType;	//dTriangles index chunks are read still packed, for IndexCodec::Decode
+		uint32_t			elementCount;
+		uint64_t			offset;		//Of the chunk's stored data within the file
+		size_t				storedSize;
+		size_t				size;		//Once decompressed
+		bool				compressed;
+	};
+
+	/*
+	Reads a binary mesh file's chunks a block at a time, so that huge meshes can be
+	moved to their destination (such as a mapped GPU buffer) without ever holding a
+	whole chunk in memory. Only the table of contents and a few blocks are kept.
+	Data is passed on as it is stored - quantised chunks are not expanded.
+	*/
+	class MeshStreamReader {
+	public:
+		//Called with each block of a chunk in turn, and where it starts within the chunk.
+		//Returning false stops the read.
+		using BlockFunction = std::function<bool(const char* data, size_t size, size_t chunkOffset)>;
+
+		//Uncompressed chunks are read in blocks of this size, compressed ones in their own blocks
+		MeshStreamReader(size_t blockSize = ChunkCompression::BLOCK_SIZE);
+
+		//Filename is relative to the mesh asset directory, as with MshLoader::LoadMesh
+		bool Open(const std::string& filename);
+		void Close();
+
+		bool IsOpen() const {
+			return file.is_open();
+		}
+
+		const MeshStreamChunk* GetChunk(GeometryChunkTypes type) const;
+
+		const std::vector<MeshStreamChunk>& GetChunks() const {
+			return chunks;
+		}
+
+		uint32_t GetMeshCount()		const { return numMeshes;	}
+		uint32_t GetVertexCount()	const { return numVertices;	}
+		uint32_t GetIndexCount()	const { return numIndices;	}
+
+		bool ReadChunk(const MeshStreamChunk& chunk, const BlockFunction& func);
+
+		//Reads straight into destination, which must be at least chunk.size bytes
+		bool ReadChunk(const MeshStreamChunk& chunk, void* destination, size_t destinationSize);
+
+	protected:
+		bool ReadFileData(uint64_t offset, size_t size, void* destination);
+		bool ReadBlockLayout(const MeshStreamChunk& chunk, ChunkCompression::BlockLayout& layout);
+
+		std::ifstream					file;
+		std::string						filename;
+		uint64_t						fileSize;
+		size_t							blockSize;
+		std::vector<MeshStreamChunk>	chunks;
+		uint32_t						numMeshes;
+		uint32_t						numVertices;
+		uint32_t						numIndices;
+
+		std::vector<char>				readBuffer;
+		std::vector<char>				decodeBuffer;
+		std::vector<uint8_t>			scratch;
+	};
+
+	class MshLoader	{
+	public:		
+		//keepQuantised leaves quantised attribute chunks in that form, for GPU upload, rather than
+		//expanding them to floats. Positions are always expanded too, as bounds and BVHs need them.
+		static bool LoadMesh(const std::string& filename, Mesh& destinationMesh, bool keepQuantised = false);
+
+		//Filenames for saving are full paths, not relative to the mesh asset directory
+		static bool SaveMesh(const std::string& filename, const Mesh& sourceMesh);
+		//A dShort or dByte attributeFormat quantises the float vertex attributes. Positions and
+		//tex coords are quantised to 16 bits either way.
+		//Compressed chunks are decompressed in parallel on load. Compressed triangle indices are
+		//also tried packed with IndexCodec, which is kept if it comes out smaller.
+		static bool SaveBinaryMesh(const std::string& filename, const Mesh& sourceMesh, GeometryChunkData attributeFormat = GeometryChunkData::dFloat, bool compress = false);
+
+		struct ChunkCompressionReport {
+			GeometryChunkTypes	type;
+			CompressionStats	compression;
+			CompressionStats	decompression;
+		};
+		//Compresses and decompresses each chunk SaveBinaryMesh would write, measuring the ratio and speed
+		static bool ReportCompression(const Mesh& sourceMesh, std::vector<ChunkCompressionReport>& report, GeometryChunkData attributeFormat = GeometryChunkData::dFloat);
+
+		//True if data starts with the binary mesh header, rather than "MeshGeometry" text
+		static bool IsBinaryMeshFile(const char* data, size_t size);
+
+	protected:
+		struct TextReader; //Scans numbers and lines straight out of a mapped text file
+
+		struct LoadedChunks;
+		struct OutputChunk; //A chunk to be written to a binary mesh file
+
+		static bool LoadBinaryMesh(const MappedMeshFile& file, Mesh& destinationMesh, bool keepQuantised);
+		static bool DecodeBinaryChunk(const MeshFileChunk& chunk, LoadedChunks& chunks);
+
+		static bool SkipTextChunk(TextReader& file, GeometryChunkTypes type, const LoadedChunks& chunks);
+		static void DecodeTextChunk(TextReader& file, GeometryChunkTypes type, LoadedChunks& chunks);
+
+		static void AssembleMesh(LoadedChunks& chunks, Mesh& destinationMesh);
+
+		static void ReadTextInts(TextReader& file, vector<Maths::Vector2i>& element, int numVertices);
+		static void ReadTeReadTextIntsxtFloats(TextReader& file, vector<Maths::Vector3i>& element, int numVertices);
+		static void ReadTextInts(TextReader& file, vector<Maths::Vector4i>& element, int numVertices);
+		static void ReadTextFloats(TextReader& file, vector<Maths::Vector2>& element, int numVertices);
+		static void ReadTextFloats(TextReader& file, vector<Maths::Vector3>& element, int numVertices);
+		static void ReadTextFloats(TextReader& file, vector<Maths::Vector4>& element, int numVertices);
+		static void ReadIntegers(TextReader& file, vector<unsigned int>& elements, int intCount);
+
 
+		//Which GeometryChunkTypes a mesh will be saved with, or 0 if it can't be saved
+		static uint32_t GetSaveChunks(const Mesh& sourceMesh);
+		static bool GetOutputChunks(const Mesh& sourceMesh, GeometryChunkData attributeFormat, std::vector<OutputChunk>& chunks);
 
-		static void WriteTextFloats(std::ofstream& file, const vector<Maths::Vector2>& element);
-		static void WriteTextFloats(std::ofstream& file, const vector<Maths::Vector3>& element);
-		static void WriteTextFloats(std::ofstream& file, const vector<Maths::Vector4>& element);
+		static void WriteTextFloats(std::string& file, const vector<Maths::Vector2>& element);
+		static void WriteTextFloats(std::string& file, const vector<Maths::Vector3>& element);
+		static void WriteTextFloats(std::string& file, const vector<Maths::Vector4>& element);
 
-		static void WriteIntegers(std::ofstream& file, const vector<unsigned int>& elements);
-		static void WriteIntegers(std::ofstream& file, const vector<Maths::Vector4i>& element);
+		static void WriteIntegers(std::string& file, const vector<unsigned int>& elements);
+		static void WriteIntegers(std::string& file, const vector<uint16_t>& elements);
+		static void WriteIntegers(std::string& file, const vector<int>& elements);
+		static void WriteIntegers(std::string& file, const vector<Maths::Vector4i>& element);
 
-		static void WriteMatrices(std::ofstream& file, const vector<Maths::Matrix4>& elements);
+		static void WriteMatrices(std::string& file, const vector<Maths::Matrix4>& elements);
+		static void WriteStrings(std::string& file, const vector<std::string>& elements);
 
-		static void WriteSubMeshes(std::ofstream& file, const vector<struct SubMesh>& elements);
+		static void WriteSubMeshes(std::string& file, const vector<struct SubMesh>& elements);
+		static void WriteBounds(std::string& file, const struct BoundingVolume& bounds);
+		static void WriteMorphTargets(std::string& file, const vector<struct MorphTarget>& targets);
 
 
-		static void ReadRigPose(std::ifstream& file, vector<Maths::Matrix4>& into);
-		static void ReadJointParents(std::ifstream& file, std::vector<int>& parentIDs);
-		static void ReadJointNames(std::ifstream& file, std::vector<std::string>& names);
-		static void ReadSubMeshes(std::ifstream& file, int count, std::vector<struct SubMesh>& subMeshes);
-		static void ReadSubMeshNames(std::ifstream& file, int count, std::vector<std::string>& names);
+		static void ReadRigPose(TextReader& file, vector<Maths::Matrix4>& into);
+		static void ReadJointParents(TextReader& file, std::vector<int>& parentIDs);
+		static void ReadJointNames(TextReader& file, std::vector<std::string>& names);
+		static void ReadSubMeshes(TextReader& file, int count, int fileVersion, std::vector<struct SubMesh>& subMeshes);
+		static void ReadSubMeshNames(TextReader& file, int count, std::vector<std::string>& names);
+		static void ReadBounds(TextReader& file, struct BoundingVolume& bounds);
+		static void ReadMorphTargets(TextReader& file, vector<struct MorphTarget>& targets);
 
 		MshLoader() {}
 		~MshLoader() {}
@@ -0,0 +1,131 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "QuantisedAttribute.h"
+#include "SIMD.h"
+
+#include <cfloat>
+#include <cstring>
+
+using namespace NCL;
+using namespace Rendering;
+
+namespace {
+	//12 values is a whole number of vertices for 1 to 4 components, and 3 SSE registers
+	const size_t PATTERN_LENGTH = 12;
+
+#ifdef NCL_SIMD_SSE
+	//Sign extends the low 4 int16_t values of v to floats
+	inline __m128 ShortsToFloats(__m128i v) {
+		return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+	}
+
+	inline __m128i LoadShorts(const int16_t* values) {
+		return _mm_loadl_epi64((const __m128i*)values);
+	}
+
+	//Widens 4 int8_t values to int16_t, leaving them in the low half
+	inline __m128i LoadBytes(const int8_t* values) {
+		int32_t packed;
+		memcpy(&packed, values, sizeof(int32_t));
+		__m128i v = _mm_cvtsi32_si128(packed);
+		return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+	}
+#endif
+
+	template<typename T>
+	void DequantiseValues(const T* values, size_t valueCount, uint32_t components, const float* offset, const float* scale, float* output) {
+		float offsetPattern[PATTERN_LENGTH];
+		float scalePattern[PATTERN_LENGTH];
+		for (size_t i = 0; i < PATTERN_LENGTH; ++i) {
+			offsetPattern[i]	= offset[i % components];
+			scalePattern[i]		= scale[i % components];
+		}
+		size_t i = 0;
+#ifdef NCL_SIMD_SSE
+		__m128 o[3] = { _mm_loadu_ps(offsetPattern), _mm_loadu_ps(offsetPattern + 4), _mm_loadu_ps(offsetPattern + 8) };
+		__m128 s[3] = { _mm_loadu_ps(scalePattern), _mm_loadu_ps(scalePattern + 4), _mm_loadu_ps(scalePattern + 8) };
+		for (; i + PATTERN_LENGTH <= valueCount; i += PATTERN_LENGTH) {
+			for (int j = 0; j < 3; ++j) {
+				__m128i packed;
+				if constexpr (sizeof(T) == 2) {
+					packed = LoadShorts((const int16_t*)values + i + j * 4);
+				}
+				else {
+					packed = LoadBytes((const int8_t*)values + i + j * 4);
+				}
+				__m128 f = ShortsToFloats(packed);
+				_mm_storeu_ps(output + i + j * 4, _mm_add_ps(o[j], _mm_mul_ps(s[j], f)));
+			}
+		}
+#endif
+		for (; i < valueCount; ++i) {
+			size_t p = i % PATTERN_LENGTH;
+			output[i] = offsetPattern[p] + scalePattern[p] * (float)values[i];
+		}
+	}
+
+	template<typename T>
+	void QuantiseValues(const float* input, size_t valueCount, uint32_t components, const float* offset, const float* invScale, float limit, T* output) {
+		for (size_t i = 0; i < valueCount; ++i) {
+			uint32_t c = i % components;
+			float q = std::round((input[i] - offset[c]) * invScale[c]);
+			output[i] = (T)std::clamp(q, -limit, limit);
+		}
+	}
+}
+
+void QuantisedAttribute::Dequantise(const void* values, size_t count, uint32_t components, uint32_t bytesPerValue,
+	const float* offset, const float* scale, float* output) {
+	if (components == 0 || components > 4) {
+		return;
+	}
+	size_t valueCount = count * components;
+	if (bytesPerValue == 2) {
+		DequantiseValues((const int16_t*)values, valueCount, components, offset, scale, output);
+	}
+	else if (bytesPerValue == 1) {
+		DequantiseValues((const int8_t*)values, valueCount, components, offset, scale, output);
+	}
+}
+
+QuantisedAttribute QuantisedAttribute::Quantise(const float* input, size_t count, uint32_t components, uint32_t bytesPerValue) {
+	QuantisedAttribute q;
+	if (components == 0 || components > 4 || (bytesPerValue != 1 && bytesPerValue != 2)) {
+		return q;
+	}
+	q.components	= components;
+	q.bytesPerValue = bytesPerValue;
+
+	float minValue[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+	float maxValue[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < count * components; ++i) {
+		uint32_t c = i % components;
+		minValue[c] = std::min(minValue[c], input[i]);
+		maxValue[c] = std::max(maxValue[c], input[i]);
+	}
+
+	//The range is centred on offset, using -limit to +limit of the integer type
+	float limit = bytesPerValue == 2 ? 32767.0f : 127.0f;
+	float invScale[4] = {};
+	for (uint32_t c = 0; c < components && count > 0; ++c) {
+		float halfRange = (maxValue[c] - minValue[c]) * 0.5f;
+		q.offset[c] = minValue[c] + halfRange;
+		q.scale[c]	= halfRange / limit;
+		invScale[c] = halfRange > 0.0f ? limit / halfRange : 0.0f;
+	}
+
+	q.data.resize(count * components * bytesPerValue);
+	if (bytesPerValue == 2) {
+		QuantiseValues(input, count * components, components, q.offset, invScale, limit, (int16_t*)q.data.data());
+	}
+	else {
+		QuantiseValues(input, count * components, components, q.offset, invScale, limit, (int8_t*)q.data.data());
+	}
+	return q;
+}
@@ -0,0 +1,42 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+
+namespace NCL::Rendering {
+	/*
+	Vertex data stored as signed normalised integers, each component decoding to
+	offset + scale * value. Offset and scale come from the range of the source
+	data, so positions are stored relative to their bounds.
+	*/
+	struct QuantisedAttribute {
+		uint32_t				components		= 0;	//Per vertex, up to 4
+		uint32_t				bytesPerValue	= 0;	//2 for int16_t values, 1 for int8_t
+		float					offset[4]		= {};
+		float					scale[4]		= {};
+		std::vector<uint8_t>	data;
+
+		bool IsEmpty() const {
+			return data.empty();
+		}
+
+		size_t GetCount() const {
+			return components && bytesPerValue ? data.size() / (components * bytesPerValue) : 0;
+		}
+
+		//Writes GetCount() * components floats
+		void Dequantise(float* output) const {
+			Dequantise(data.data(), GetCount(), components, bytesPerValue, offset, scale, output);
+		}
+
+		static void Dequantise(const void* values, size_t count, uint32_t components, uint32_t bytesPerValue,
+			const float* offset, const float* scale, float* output);
+
+		static QuantisedAttribute Quantise(const float* input, size_t count, uint32_t components, uint32_t bytesPerValue);
+	};
+}
@@ -0,0 +1,288 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "ReducedAnimation.h"
+#include "MeshAnimation.h"
+
+#include <cfloat>
+#include <climits>
+#include <cstring>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	//Each pass that finds joints outside the budget halves their tolerances and reduces them again
+	const int MAX_REDUCTION_PASSES = 16;
+
+	//A cursor entry that hasn't been used yet, so the track's keys must be searched
+	const uint32_t NO_KEY = UINT32_MAX;
+
+	int TrackComponents(size_t track) {
+		return track % 3 == 0 ? 4 : 3;
+	}
+
+	//Rotations are nlerped, everything else is lerped
+	void Interpolate(const float* from, const float* to, int components, float t, float* output) {
+		if (components == 4) {
+			Quaternion q = JointTransform::NLerp(Quaternion(from[0], from[1], from[2], from[3]), Quaternion(to[0], to[1], to[2], to[3]), t);
+			memcpy(output, &q.x, sizeof(float) * 4);
+			return;
+		}
+		for (int i = 0; i < components; ++i) {
+			output[i] = from[i] + (to[i] - from[i]) * t;
+		}
+	}
+
+	float TrackError(const float* a, const float* b, int components) {
+		if (components == 4) {
+			return JointTransform::AngleBetween(Quaternion(a[0], a[1], a[2], a[3]), Quaternion(b[0], b[1], b[2], b[3]));
+		}
+		return Vector::Length(Vector3(a[0] - b[0], a[1] - b[1], a[2] - b[2]));
+	}
+
+	//Greedily extends each linear segment for as long as every frame it covers stays within tolerance
+	void ReduceTrack(const float* samples, size_t frames, int components, float tolerance, std::vector<uint32_t>& keys) {
+		keys.assign(1, 0);
+
+		bool constant = true;
+		for (size_t f = 1; f < frames && constant; ++f) {
+			constant = TrackError(samples + f * components, samples, components) <= tolerance;
+		}
+		if (constant) {
+			return;
+		}
+		auto SegmentFits = [&](size_t start, size_t end) {
+			float interpolated[4];
+			for (size_t f = start + 1; f < end; ++f) {
+				float t = ((float)f - start) / ((float)end - start);
+				Interpolate(samples + start * components, samples + end * components, components, t, interpolated);
+				if (TrackError(interpolated, samples + f * components, components) > tolerance) {
+					return false;
+				}
+			}
+			return true;
+		};
+		size_t start = 0;
+		while (start + 1 < frames) {
+			size_t end = start + 1;
+			while (end + 1 < frames && SegmentFits(start, end + 1)) {
+				++end;
+			}
+			keys.push_back((uint32_t)end);
+			start = end;
+		}
+	}
+}
+
+ReducedAnimation::ReducedAnimation() {
+	jointCount	= 0;
+	frameCount	= 0;
+	frameRate	= 0.0f;
+}
+
+ReducedAnimation::~ReducedAnimation() {
+}
+
+bool ReducedAnimation::Reduce(const MeshAnimation& anim, const KeyframeErrorBudget& budget) {
+	size_t joints = anim.GetJointCount();
+	size_t frames = anim.GetFrameCount();
+	if (joints == 0 || frames == 0) {
+		std::cout << __FUNCTION__ << " can't reduce an empty animation!\n";
+		return false;
+	}
+
+	//Each track's value on every frame, packed together so that tracks can be reduced independently
+	std::vector<JointTransform>		poses(joints * frames);
+	std::vector<std::vector<float>> samples(joints * 3);
+	for (size_t t = 0; t < samples.size(); ++t) {
+		samples[t].resize(frames * TrackComponents(t));
+	}
+	for (size_t f = 0; f < frames; ++f) {
+		const Matrix4* frame = anim.GetJointData(f);
+		for (size_t j = 0; j < joints; ++j) {
+			JointTransform& pose = poses[f * joints + j];
+			pose = JointTransform::FromMatrix(frame[j]);
+			pose.rotation.Normalise();
+			memcpy(&samples[j * 3 + 0][f * 4], &pose.rotation.x,		sizeof(float) * 4);
+			memcpy(&samples[j * 3 + 1][f * 3], &pose.translation.x,	sizeof(float) * 3);
+			memcpy(&samples[j * 3 + 2][f * 3], &pose.scale.x,			sizeof(float) * 3);
+		}
+	}
+
+	//Rotation and scale errors are magnified out to the shell points, so start them off that much tighter
+	const float d		= budget.shellDistance;
+	const float reach	= std::max(d, FLT_EPSILON);
+	std::vector<float> tolerances(joints * 3);
+	for (size_t j = 0; j < joints; ++j) {
+		tolerances[j * 3 + 0] = std::min(budget.rotation, budget.position / reach);
+		tolerances[j * 3 + 1] = budget.position;
+		tolerances[j * 3 + 2] = budget.position / reach;
+	}
+
+	jointCount	= joints;
+	frameCount	= frames;
+	frameRate	= anim.GetFrameRate();
+
+	std::vector<std::vector<uint32_t>> trackKeys(joints * 3);
+	std::vector<bool>			trackChanged(joints * 3, true);
+	std::vector<bool>			tightened(joints);
+	std::vector<JointTransform> reducedPose(joints);
+
+	const Vector4 points[4] = { Vector4(0, 0, 0, 1), Vector4(d, 0, 0, 1), Vector4(0, d, 0, 1), Vector4(0, 0, d, 1) };
+
+	for (int pass = 0; ; ++pass) {
+		tracks.assign(joints * 3, Track());
+		keyFrames.clear();
+		keyValues.clear();
+		for (size_t t = 0; t < trackKeys.size(); ++t) {
+			int components = TrackComponents(t);
+			if (trackChanged[t]) {
+				ReduceTrack(samples[t].data(), frames, components, tolerances[t], trackKeys[t]);
+				trackChanged[t] = false;
+			}
+			tracks[t].firstKey		= (uint32_t)keyFrames.size();
+			tracks[t].keyCount		= (uint32_t)trackKeys[t].size();
+			tracks[t].firstValue	= (uint32_t)keyValues.size();
+			for (uint32_t key : trackKeys[t]) {
+				keyFrames.push_back(key);
+				const float* value = samples[t].data() + key * components;
+				keyValues.insert(keyValues.end(), value, value + components);
+			}
+		}
+		if (pass == MAX_REDUCTION_PASSES) {
+			break;
+		}
+
+		//Frames are already in model space, so each joint's error is its own tracks' doing
+		std::fill(tightened.begin(), tightened.end(), false);
+		bool withinBudget = true;
+		std::vector<uint32_t> cursor(joints * 3, NO_KEY);
+		for (size_t f = 0; f < frames; ++f) {
+			const Matrix4* frame = anim.GetJointData(f);
+			for (size_t j = 0; j < joints; ++j) {
+				SampleJoint(j, (float)f, &cursor[j * 3], reducedPose[j]);
+				if (tightened[j]) {
+					continue;
+				}
+				Matrix4 reduced = reducedPose[j].ToMatrix();
+				float positionError = 0.0f;
+				for (const Vector4& p : points) {
+					positionError = std::max(positionError, Vector::Length(frame[j] * p - reduced * p));
+				}
+				float rotationError = JointTransform::AngleBetween(poses[f * joints + j].rotation, reducedPose[j].rotation);
+				if (positionError <= budget.position && rotationError <= budget.rotation) {
+					continue;
+				}
+				withinBudget	= false;
+				tightened[j]	= true;
+				for (size_t t = j * 3; t < j * 3 + 3; ++t) {
+					tolerances[t]	*= 0.5f;
+					trackChanged[t]	= true;
+				}
+			}
+		}
+		if (withinBudget) {
+			break;
+		}
+	}
+	return true;
+}
+
+size_t ReducedAnimation::GetMemoryUsage() const {
+	return sizeof(*this) + tracks.size() * sizeof(Track) + keyFrames.size() * sizeof(uint32_t) + keyValues.size() * sizeof(float);
+}
+
+uint32_t ReducedAnimation::FindKey(const Track& track, float position, uint32_t key) const {
+	const uint32_t* frames	= keyFrames.data() + track.firstKey;
+	uint32_t		last	= track.keyCount - 1;
+	if (key > last || position < frames[key]) {
+		//Either a new cursor, or playback has jumped backwards
+		key = (uint32_t)(std::upper_bound(frames, frames + track.keyCount, position) - frames);
+		key = key > 0 ? key - 1 : 0;
+	}
+	while (key < last && frames[key + 1] <= position) {
+		++key;
+	}
+	return key;
+}
+
+void ReducedAnimation::SampleJoint(size_t joint, float position, uint32_t* keys, JointTransform& output) const {
+	float values[3][4];
+	for (int k = 0; k < 3; ++k) {
+		const Track&	track		= tracks[joint * 3 + k];
+		int				components	= TrackComponents(k);
+		const float*	trackValues	= keyValues.data() + track.firstValue;
+
+		uint32_t key = FindKey(track, position, keys[k]);
+		keys[k] = key;
+		if (key + 1 >= track.keyCount) {
+			memcpy(values[k], trackValues + key * components, sizeof(float) * components);
+			continue;
+		}
+		float from	= (float)keyFrames[track.firstKey + key];
+		float to	= (float)keyFrames[track.firstKey + key + 1];
+		Interpolate(trackValues + key * components, trackValues + (key + 1) * components, components, (position - from) / (to - from), values[k]);
+	}
+	output.rotation		= Quaternion(values[0][0], values[0][1], values[0][2], values[0][3]);
+	output.translation	= Vector3(values[1][0], values[1][1], values[1][2]);
+	output.scale		= Vector3(values[2][0], values[2][1], values[2][2]);
+}
+
+void ReducedAnimation::Sample(float time, JointTransform* output, Cursor& cursor) const {
+	if (frameCount == 0) {
+		return;
+	}
+	if (cursor.keys.size() != tracks.size()) {
+		cursor.keys.assign(tracks.size(), NO_KEY);
+	}
+	float position = GetPosition(time);
+	for (size_t j = 0; j < jointCount; ++j) {
+		SampleJoint(j, position, &cursor.keys[j * 3], output[j]);
+	}
+}
+
+void ReducedAnimation::Sample(float time, Matrix4* output, Cursor& cursor) const {
+	if (frameCount == 0) {
+		return;
+	}
+	if (cursor.keys.size() != tracks.size()) {
+		cursor.keys.assign(tracks.size(), NO_KEY);
+	}
+	float position = GetPosition(time);
+	for (size_t j = 0; j < jointCount; ++j) {
+		JointTransform t;
+		SampleJoint(j, position, &cursor.keys[j * 3], t);
+		output[j] = t.ToMatrix();
+	}
+}
+
+void ReducedAnimation::Sample(float time, JointTransform* output) const {
+	if (frameCount == 0) {
+		return;
+	}
+	float position = GetPosition(time);
+	for (size_t j = 0; j < jointCount; ++j) {
+		uint32_t keys[3] = { NO_KEY, NO_KEY, NO_KEY };
+		SampleJoint(j, position, keys, output[j]);
+	}
+}
+
+void ReducedAnimation::Sample(float time, Matrix4* output) const {
+	if (frameCount == 0) {
+		return;
+	}
+	float position = GetPosition(time);
+	for (size_t j = 0; j < jointCount; ++j) {
+		uint32_t keys[3] = { NO_KEY, NO_KEY, NO_KEY };
+		JointTransform t;
+		SampleJoint(j, position, keys, t);
+		output[j] = t.ToMatrix();
+	}
+}
@@ -0,0 +1,100 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Skeleton.h"
+
+namespace NCL::Rendering {
+	class MeshAnimation;
+
+	//The largest error a reduced animation may have, measured against the source animation's frames
+	struct KeyframeErrorBudget {
+		float position		= 0.001f;	//In the animation's units
+		float rotation		= 0.002f;	//In radians
+		//Errors are measured at points this far along each joint's axes, as well as at the joint itself,
+		//so that errors in rotation and scale also show up as errors in position
+		float shellDistance = 0.1f;
+	};
+
+	/*
+	A MeshAnimation with each joint's rotation, translation, and scale tracks cut down
+	to only the keyframes needed to rebuild the animation within an error budget.
+	Frames between keys are linearly interpolated, so still and linearly moving joints
+	end up with only a key or two each.
+
+	Errors are checked on each joint's own matrix, at the joint and at points around it.
+	Output is in the source animation's joint order, and in the same space as
+	MeshAnimation's matrices - model space, ready for MeshSkinner's palette.
+	*/
+	class ReducedAnimation {
+	public:
+		//Remembers which key each track was last sampled from. Sampling onwards from
+		//there, as playback does, only has to step over the keys that have been passed.
+		struct Cursor {
+			std::vector<uint32_t> keys;
+		};
+
+		ReducedAnimation();
+		~ReducedAnimation();
+
+		bool Reduce(const MeshAnimation& anim, const KeyframeErrorBudget& budget = KeyframeErrorBudget());
+
+		size_t GetJointCount() const {
+			return jointCount;
+		}
+
+		size_t GetFrameCount() const {
+			return frameCount;
+		}
+
+		float GetFrameRate() const {
+			return frameRate;
+		}
+
+		float GetAnimationTime() const {
+			return frameCount / (float)frameRate;
+		}
+
+		//Across all tracks
+		size_t GetKeyCount() const {
+			return keyFrames.size();
+		}
+
+		//In bytes
+		size_t GetMemoryUsage() const;
+
+		//Samples at time, in seconds, clamped to the clip. Output must have room for GetJointCount() entries.
+		void Sample(float time, JointTransform* output, Cursor& cursor) const;
+		void Sample(float time, Matrix4* output, Cursor& cursor) const;
+
+		//Without a cursor, each track's keys have to be searched
+		void Sample(float time, JointTransform* output) const;
+		void Sample(float time, Matrix4* output) const;
+
+	protected:
+		struct Track {
+			uint32_t firstKey	= 0;	//Into keyFrames
+			uint32_t keyCount	= 0;
+			uint32_t firstValue = 0;	//Into keyValues, with 4 floats per rotation key, and 3 per translation or scale key
+		};
+
+		uint32_t	FindKey(const Track& track, float position, uint32_t key) const;
+		void		SampleJoint(size_t joint, float position, uint32_t* keys, JointTransform& output) const;
+
+		float GetPosition(float time) const {
+			return std::clamp(time * frameRate, 0.0f, (float)(frameCount - 1));
+		}
+
+		size_t					jointCount;
+		size_t					frameCount;
+		float					frameRate;
+		std::vector<Track>		tracks;		//Rotation, translation, and scale per joint
+		std::vector<uint32_t>	keyFrames;	//The frame each key is from. Tracks start with a key on frame 0, and unless they're constant, end on the last frame.
+		std::vector<float>		keyValues;
+	};
+}
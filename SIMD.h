@@ -0,0 +1,14 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+//Code using SSE intrinsics should be wrapped in #ifdef NCL_SIMD_SSE, with a scalar fallback
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define NCL_SIMD_SSE
+#include <immintrin.h>
+#endif
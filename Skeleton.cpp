@@ -0,0 +1,218 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "Skeleton.h"
+#include "Mesh.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Maths;
+
+namespace {
+	//Matches the convention of Quaternion::RotationMatrix, using the largest
+	//diagonal term to stay accurate for rotations close to 180 degrees
+	Quaternion RotationToQuaternion(const Matrix4& m) {
+		auto M = [&](int r, int c) { return m.array[c][r]; };
+		float trace = M(0, 0) + M(1, 1) + M(2, 2);
+		Quaternion q;
+		if (trace > 0.0f) {
+			float s = sqrt(trace + 1.0f) * 2.0f;
+			q = Quaternion((M(2, 1) - M(1, 2)) / s, (M(0, 2) - M(2, 0)) / s, (M(1, 0) - M(0, 1)) / s, 0.25f * s);
+		}
+		else if (M(0, 0) > M(1, 1) && M(0, 0) > M(2, 2)) {
+			float s = sqrt(1.0f + M(0, 0) - M(1, 1) - M(2, 2)) * 2.0f;
+			q = Quaternion(0.25f * s, (M(0, 1) + M(1, 0)) / s, (M(0, 2) + M(2, 0)) / s, (M(2, 1) - M(1, 2)) / s);
+		}
+		else if (M(1, 1) > M(2, 2)) {
+			float s = sqrt(1.0f + M(1, 1) - M(0, 0) - M(2, 2)) * 2.0f;
+			q = Quaternion((M(0, 1) + M(1, 0)) / s, 0.25f * s, (M(1, 2) + M(2, 1)) / s, (M(0, 2) - M(2, 0)) / s);
+		}
+		else {
+			float s = sqrt(1.0f + M(2, 2) - M(0, 0) - M(1, 1)) * 2.0f;
+			q = Quaternion((M(0, 2) + M(2, 0)) / s, (M(1, 2) + M(2, 1)) / s, 0.25f * s, (M(1, 0) - M(0, 1)) / s);
+		}
+		return q.Normalised();
+	}
+}
+
+Matrix4 JointTransform::ToMatrix() const {
+	Matrix4 m = Quaternion::RotationMatrix<Matrix4>(rotation);
+	for (int c = 0; c < 3; ++c) {
+		for (int r = 0; r < 3; ++r) {
+			m.array[c][r] *= scale[c];
+		}
+	}
+	m.array[3][0] = translation.x;
+	m.array[3][1] = translation.y;
+	m.array[3][2] = translation.z;
+	return m;
+}
+
+JointTransform JointTransform::FromMatrix(const Matrix4& m) {
+	JointTransform t;
+	t.translation = Vector3(m.array[3][0], m.array[3][1], m.array[3][2]);
+
+	Matrix4 rotation;
+	for (int c = 0; c < 3; ++c) {
+		Vector3 column(m.array[c][0], m.array[c][1], m.array[c][2]);
+		t.scale[c] = Vector::Length(column);
+		for (int r = 0; r < 3; ++r) {
+			rotation.array[c][r] = t.scale[c] > 0.0f ? column[r] / t.scale[c] : 0.0f;
+		}
+	}
+	//A mirrored matrix can't be represented by a rotation, so move the flip into the scale
+	Vector3 x(rotation.array[0][0], rotation.array[0][1], rotation.array[0][2]);
+	Vector3 y(rotation.array[1][0], rotation.array[1][1], rotation.array[1][2]);
+	Vector3 z(rotation.array[2][0], rotation.array[2][1], rotation.array[2][2]);
+	if (Vector::Dot(Vector::Cross(x, y), z) < 0.0f) {
+		t.scale.x = -t.scale.x;
+		for (int r = 0; r < 3; ++r) {
+			rotation.array[0][r] = -rotation.array[0][r];
+		}
+	}
+	t.rotation = RotationToQuaternion(rotation);
+	return t;
+}
+
+JointTransform JointTransform::Combine(const JointTransform& parent, const JointTransform& child) {
+	JointTransform t;
+	t.rotation		= parent.rotation * child.rotation;
+	t.scale			= parent.scale * child.scale;
+	t.translation	= parent.translation + parent.rotation * (parent.scale * child.translation);
+	return t;
+}
+
+JointTransform JointTransform::Blend(const JointTransform& from, const JointTransform& to, float t) {
+	JointTransform blended;
+	blended.rotation	= NLerp(from.rotation, to.rotation, t);
+	blended.translation	= from.translation + (to.translation - from.translation) * t;
+	blended.scale		= from.scale + (to.scale - from.scale) * t;
+	return blended;
+}
+
+Quaternion JointTransform::NLerp(const Quaternion& from, const Quaternion& to, float t) {
+	return Quaternion::Lerp(from, to, t).Normalised();
+}
+
+float JointTransform::AngleBetween(const Quaternion& a, const Quaternion& b) {
+	float sign	= Quaternion::Dot(a, b) < 0.0f ? -1.0f : 1.0f;
+	float dx	= a.x - b.x * sign;
+	float dy	= a.y - b.y * sign;
+	float dz	= a.z - b.z * sign;
+	float dw	= a.w - b.w * sign;
+	float chord = std::sqrt(dx * dx + dy * dy + dz * dz + dw * dw);
+	return 4.0f * std::asin(std::min(1.0f, chord * 0.5f));
+}
+
+Skeleton::Skeleton() {
+}
+
+Skeleton::Skeleton(const Mesh& mesh) {
+	Build(mesh.GetJointNames(), mesh.GetJointParents());
+}
+
+Skeleton::~Skeleton() {
+}
+
+bool Skeleton::Build(const std::vector<std::string>& newNames, const std::vector<int>& newParents) {
+	parents.clear();
+	names.clear();
+	sourceIndices.clear();
+	skeletonIndices.clear();
+	nameLookup.clear();
+
+	size_t jointCount = newParents.size();
+	if (jointCount > INT16_MAX) {
+		std::cout << __FUNCTION__ << " skeleton has too many joints (" << jointCount << ")!\n";
+		return false;
+	}
+
+	//Children are listed per parent, with roots stored under an extra slot at the end
+	std::vector<uint32_t> childStart(jointCount + 2, 0);
+	std::vector<uint16_t> children(jointCount);
+	auto ParentSlot = [&](size_t joint) {
+		int p = newParents[joint];
+		return (p < 0 || (size_t)p >= jointCount || (size_t)p == joint) ? jointCount : (size_t)p;
+	};
+	for (size_t i = 0; i < jointCount; ++i) {
+		childStart[ParentSlot(i) + 1]++;
+	}
+	for (size_t i = 0; i <= jointCount; ++i) {
+		childStart[i + 1] += childStart[i];
+	}
+	std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+	for (size_t i = 0; i < jointCount; ++i) {
+		children[fill[ParentSlot(i)]++] = (uint16_t)i;
+	}
+
+	//Depth first, so each subtree ends up contiguous
+	std::vector<uint16_t> stack;
+	for (uint32_t i = childStart[jointCount + 1]; i > childStart[jointCount]; --i) {
+		stack.push_back(children[i - 1]);
+	}
+	while (!stack.empty()) {
+		uint16_t joint = stack.back();
+		stack.pop_back();
+		sourceIndices.push_back(joint);
+		for (uint32_t i = childStart[joint + 1]; i > childStart[joint]; --i) {
+			stack.push_back(children[i - 1]);
+		}
+	}
+	if (sourceIndices.size() != jointCount) {
+		std::cout << __FUNCTION__ << " skeleton hierarchy contains a cycle!\n";
+		sourceIndices.clear();
+		return false;
+	}
+
+	skeletonIndices.resize(jointCount);
+	for (size_t i = 0; i < jointCount; ++i) {
+		skeletonIndices[sourceIndices[i]] = (uint16_t)i;
+	}
+
+	parents.resize(jointCount);
+	names.resize(jointCount);
+	nameLookup.reserve(jointCount);
+	for (size_t i = 0; i < jointCount; ++i) {
+		size_t source	= sourceIndices[i];
+		size_t parent	= ParentSlot(source);
+		parents[i]		= parent == jointCount ? -1 : (int16_t)skeletonIndices[parent];
+
+		if (source < newNames.size()) {
+			names[i] = newNames[source];
+			nameLookup.emplace(names[i], (int16_t)i);
+		}
+	}
+	return true;
+}
+
+int Skeleton::GetJointIndex(const std::string& name) const {
+	auto i = nameLookup.find(name);
+	return i == nameLookup.end() ? -1 : i->second;
+}
+
+void Skeleton::LocalToModel(const Matrix4* localPose, Matrix4* modelPose) const {
+	for (size_t i = 0; i < parents.size(); ++i) {
+		int16_t p = parents[i];
+		modelPose[i] = p < 0 ? localPose[i] : modelPose[p] * localPose[i];
+	}
+}
+
+void Skeleton::LocalToModel(const JointTransform* localPose, JointTransform* modelPose) const {
+	for (size_t i = 0; i < parents.size(); ++i) {
+		int16_t p = parents[i];
+		modelPose[i] = p < 0 ? localPose[i] : JointTransform::Combine(modelPose[p], localPose[i]);
+	}
+}
+
+void Skeleton::LocalToModel(const JointTransform* localPose, Matrix4* modelPose) const {
+	//Composing as matrices keeps any shear from non-uniformly scaled parents
+	for (size_t i = 0; i < parents.size(); ++i) {
+		int16_t p = parents[i];
+		modelPose[i] = p < 0 ? localPose[i].ToMatrix() : modelPose[p] * localPose[i].ToMatrix();
+	}
+}
@@ -0,0 +1,107 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Vector.h"
+#include "Matrix.h"
+#include "Quaternion.h"
+
+#include <unordered_map>
+
+namespace NCL::Rendering {
+	class Mesh;
+	using namespace Maths;
+
+	//A joint's transform relative to its parent, split into its components
+	struct JointTransform {
+		Quaternion	rotation;
+		Vector3		translation;
+		Vector3		scale = Vector3(1, 1, 1);
+
+		Matrix4 ToMatrix() const;
+
+		//Assumes the matrix has no shear
+		static JointTransform FromMatrix(const Matrix4& m);
+
+		//The equivalent of parent.ToMatrix() * child.ToMatrix(), for uniformly scaled parents
+		static JointTransform Combine(const JointTransform& parent, const JointTransform& child);
+
+		//Nlerps the rotation, and lerps the translation and scale
+		static JointTransform Blend(const JointTransform& from, const JointTransform& to, float t);
+
+		//Blends towards whichever of to and -to is nearer, as they're the same rotation
+		static Quaternion NLerp(const Quaternion& from, const Quaternion& to, float t);
+
+		//In radians, measured along the chord between them, which stays accurate for tiny angles
+		static float AngleBetween(const Quaternion& a, const Quaternion& b);
+	};
+
+	/*
+	A joint hierarchy, reordered so that every joint comes after its parent, which
+	lets a whole pose be taken from local to model space in a single linear pass.
+	Joints within a subtree are kept together, and siblings keep their source order.
+
+	Poses passed to a Skeleton must be in skeleton order - GetSourceIndex and
+	GetSkeletonIndex convert between this and the order of the source mesh's joints.
+	*/
+	class Skeleton {
+	public:
+		Skeleton();
+		Skeleton(const Mesh& mesh);
+		~Skeleton();
+
+		//Parents outside the valid joint range are treated as roots. Fails on cycles.
+		bool Build(const std::vector<std::string>& names, const std::vector<int>& parents);
+
+		size_t GetJointCount() const {
+			return parents.size();
+		}
+
+		//Returns -1 if there's no joint with the name
+		int GetJointIndex(const std::string& name) const;
+
+		int GetSourceIndex(int skeletonIndex) const {
+			return sourceIndices[skeletonIndex];
+		}
+
+		int GetSkeletonIndex(int sourceIndex) const {
+			return skeletonIndices[sourceIndex];
+		}
+
+		//-1 for root joints
+		const std::vector<int16_t>& GetParents() const {
+			return parents;
+		}
+
+		const std::vector<std::string>& GetJointNames() const {
+			return names;
+		}
+
+		//Reorders an array of per-joint data from source order into skeleton order
+		template<typename T>
+		void ToSkeletonOrder(const T* source, T* dest) const {
+			for (size_t i = 0; i < sourceIndices.size(); ++i) {
+				dest[i] = source[sourceIndices[i]];
+			}
+		}
+
+		//Concatenates each joint's local transform onto its parent's model space
+		//transform. The local and model pose arrays must not overlap.
+		void LocalToModel(const Matrix4* localPose, Matrix4* modelPose) const;
+		void LocalToModel(const JointTransform* localPose, JointTransform* modelPose) const;
+		void LocalToModel(const JointTransform* localPose, Matrix4* modelPose) const;
+
+	protected:
+		std::vector<int16_t>		parents;
+		std::vector<std::string>	names;
+		std::vector<uint16_t>		sourceIndices;
+		std::vector<uint16_t>		skeletonIndices;
+
+		std::unordered_map<std::string, int16_t> nameLookup;
+	};
+}
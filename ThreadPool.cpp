@@ -0,0 +1,114 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "ThreadPool.h"
+
+#include <atomic>
+
+using namespace NCL;
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	shuttingDown = false;
+
+	if (threadCount == 0) {
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		workers.emplace_back(&ThreadPool::WorkerThread, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> lock(taskMutex);
+		shuttingDown = true;
+	}
+	taskSignal.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+ThreadPool& ThreadPool::GetGlobalPool() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> task, int priority) {
+	{
+		std::unique_lock<std::mutex> lock(taskMutex);
+		tasks[priority].emplace_back(std::move(task));
+	}
+	taskSignal.notify_one();
+}
+
+void ThreadPool::WorkerThread() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(taskMutex);
+			taskSignal.wait(lock, [&] { return shuttingDown || !tasks.empty(); });
+			if (tasks.empty()) {
+				return;
+			}
+			auto highest = std::prev(tasks.end());
+			task = std::move(highest->second.front());
+			highest->second.pop_front();
+			if (highest->second.empty()) {
+				tasks.erase(highest);
+			}
+		}
+		task();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t batchSize, const ParallelForFunction& func) {
+	if (count == 0) {
+		return;
+	}
+	batchSize = std::max<size_t>(batchSize, 1);
+	size_t batchCount = (count + batchSize - 1) / batchSize;
+
+	if (batchCount == 1 || workers.empty()) {
+		func(0, count);
+		return;
+	}
+
+	//Helpers may only get to run after the work is done, so the shared state must outlive this call
+	struct BatchState {
+		std::atomic<size_t>		nextBatch	= 0;
+		std::atomic<size_t>		doneBatches = 0;
+		std::mutex				doneMutex;
+		std::condition_variable doneSignal;
+	};
+	std::shared_ptr<BatchState> state = std::make_shared<BatchState>();
+	const ParallelForFunction*	job	  = &func;
+
+	auto RunBatches = [state, job, count, batchSize, batchCount]() {
+		size_t batch;
+		while ((batch = state->nextBatch.fetch_add(1)) < batchCount) {
+			size_t start = batch * batchSize;
+			(*job)(start, std::min(start + batchSize, count));
+
+			if (state->doneBatches.fetch_add(1) + 1 == batchCount) {
+				std::unique_lock<std::mutex> lock(state->doneMutex);
+				state->doneSignal.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min<size_t>(workers.size(), batchCount - 1);
+	for (size_t i = 0; i < helpers; ++i) {
+		Submit(RunBatches, HELPER_PRIORITY);
+	}
+	RunBatches();
+
+	std::unique_lock<std::mutex> lock(state->doneMutex);
+	state->doneSignal.wait(lock, [&] { return state->doneBatches == batchCount; });
+}
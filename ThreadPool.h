@@ -0,0 +1,50 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace NCL {
+	using ParallelForFunction = std::function<void(size_t start, size_t end)>;
+
+	class ThreadPool {
+	public:
+		//A thread count of 0 uses one worker per hardware thread, minus one for the caller
+		ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		//Tasks with a higher priority are started first, and equal priorities run in submission order
+		void Submit(std::function<void()> task, int priority = 0);
+
+		//Splits [0, count) into batches of batchSize, and runs them across the pool.
+		//The calling thread works on batches too, so this is safe to call from
+		//inside a pool task. Returns once every batch has completed.
+		void ParallelFor(size_t count, size_t batchSize, const ParallelForFunction& func);
+
+		uint32_t GetThreadCount() const {
+			return (uint32_t)workers.size();
+		}
+
+		static ThreadPool& GetGlobalPool();
+
+		//ParallelFor helpers jump the queue, as their caller is already waiting on them
+		static const int HELPER_PRIORITY = INT_MAX;
+
+	protected:
+		void WorkerThread();
+
+		std::vector<std::thread>			workers;
+		std::map<int, std::deque<std::function<void()>>> tasks; //Keyed by priority
+		std::mutex							taskMutex;
+		std::condition_variable				taskSignal;
+		bool								shuttingDown;
+	};
+}